@@ -0,0 +1,1000 @@
+// bench.cpp
+// Benchmark suite: synthetic corpora across an entropy sweep, real files, and machine readable (JSON/CSV) output, Richard Geldreich, Jr., public domain (see full text at unlicense.org)
+#include "sserangecoder.h"
+#include "sserangeperf.h"
+#include "sserangealloc.h"
+#include <stdarg.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <algorithm>
+#include <chrono>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#elif defined(__linux__)
+#include <sched.h>
+#endif
+
+#ifdef _MSC_VER
+#pragma warning (disable:4127) // warning C4127: conditional expression is constant
+#endif
+
+using namespace sserangecoder;
+
+enum bench_format
+{
+	cFormatText,
+	cFormatCSV,
+	cFormatJSON
+};
+
+enum bench_codec
+{
+	cCodecRange,
+	cCodecRangeScalar,	// range coded, decoded with vrange_decode_scalar()
+	cCodecRANS,
+	cTotalCodecs
+};
+
+static const char* g_codec_names[cTotalCodecs] = { "range", "scalar", "rans" };
+
+// Hardware counters (only when compiled with SSER_USE_PERF_COUNTERS=1), each phase is counted in a separate untimed pass
+enum bench_phase
+{
+	cPhaseCreateCumProbs,
+	cPhaseInitTable,
+	cPhaseEncode,
+	cPhaseDecode,
+	cTotalPhases
+};
+
+static const char* g_phase_names[cTotalPhases] = { "create_cum_probs", "init_table", "encode", "decode" };
+
+// Model creation is counted over this many calls, and reported per call instead of per byte
+const uint32_t cModelPerfCalls = 64;
+
+static vrange_perf_counters g_perf_counters;
+
+struct bench_params
+{
+	bench_params() { clear(); }
+
+	void clear()
+	{
+		m_min_size = 64;
+		m_max_size = 16 * 1024 * 1024;
+		m_runs = 5;
+		m_min_run_time = .01f;
+		m_warmup_time = .25f;
+		m_cpu = -2;
+		m_num_lanes = 0;
+		m_codec_mask = (1 << cTotalCodecs) - 1;
+		m_format = cFormatText;
+		m_synthetic = true;
+		m_out_filename.clear();
+		m_files.clear();
+	}
+
+	// Synthetic corpora are coded at m_min_size, m_min_size * 4, etc. up to m_max_size
+	size_t m_min_size;
+	size_t m_max_size;
+
+	// Every measurement is repeated m_runs times, each run calling the coder enough times to take at least m_min_run_time seconds
+	uint32_t m_runs;
+	float m_min_run_time;
+
+	// Seconds spent decoding before the first measurement, so the CPU is at its steady state clock
+	float m_warmup_time;
+
+	// CPU to pin the benchmark thread to: -2 picks the first allowed CPU, -1 doesn't pin
+	int m_cpu;
+
+	// 0 picks the lane count with vrange_choose_num_lanes()
+	uint32_t m_num_lanes;
+
+	uint32_t m_codec_mask;
+	bench_format m_format;
+	bool m_synthetic;
+
+	std::string m_out_filename;
+	std::vector<std::string> m_files;
+};
+
+struct bench_result
+{
+	std::string m_corpus;
+	size_t m_size;
+	uint32_t m_codec;
+	uint32_t m_num_lanes;
+
+	// Order-0 entropy of the input in bits per byte
+	double m_entropy;
+	size_t m_comp_size;
+
+	uint32_t m_iters;
+
+	// Medians and standard deviations over the runs
+	double m_enc_mibs, m_enc_mibs_stddev, m_enc_cpb;
+	double m_dec_mibs, m_dec_mibs_stddev, m_dec_cpb;
+
+	// Heap allocations per encode/decode call during the timed runs (see sserangealloc.h)
+	double m_enc_allocs, m_dec_allocs;
+
+	// Hardware counter totals of each phase, and the number of bytes (or calls, for the model phases) they cover
+	vrange_perf_sample m_perf[cTotalPhases];
+	uint64_t m_perf_units[cTotalPhases];
+};
+
+static void panic(const char* pMsg, ...)
+{
+	fprintf(stderr, "ERROR: ");
+
+	va_list args;
+	va_start(args, pMsg);
+	vfprintf(stderr, pMsg, args);
+	va_end(args);
+	exit(EXIT_FAILURE);
+}
+
+static double get_time()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool read_file_to_vec(const char* pFilename, uint8_vec& data)
+{
+	FILE* pFile = fopen(pFilename, "rb");
+	if (!pFile)
+		return false;
+
+	fseek(pFile, 0, SEEK_END);
+	const long file_size = ftell(pFile);
+	fseek(pFile, 0, SEEK_SET);
+
+	if (file_size < 0)
+	{
+		fclose(pFile);
+		return false;
+	}
+
+	data.resize((size_t)file_size);
+	const bool success = (!file_size) || (fread(&data[0], file_size, 1, pFile) == 1);
+
+	fclose(pFile);
+	return success;
+}
+
+// Pins the calling thread to a CPU (see bench_params::m_cpu). Returns the CPU used, or -1 if the thread isn't pinned.
+static int pin_thread(int cpu)
+{
+	if (cpu == -1)
+		return -1;
+
+#ifdef _WIN32
+	if (cpu < 0)
+		cpu = 0;
+
+	if (!SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu))
+		return -1;
+
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+	return cpu;
+#elif defined(__linux__)
+	cpu_set_t set;
+
+	if (cpu < 0)
+	{
+		CPU_ZERO(&set);
+		if (sched_getaffinity(0, sizeof(set), &set) != 0)
+			return -1;
+
+		for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+			if (CPU_ISSET(cpu, &set))
+				break;
+
+		if (cpu == CPU_SETSIZE)
+			return -1;
+	}
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set) != 0)
+		return -1;
+
+	return cpu;
+#else
+	return -1;
+#endif
+}
+
+static uint64_t splitmix64(uint64_t& state)
+{
+	uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+// A synthetic corpus: bytes drawn independently from a 256 entry distribution
+struct synth_corpus
+{
+	const char* m_pDist;
+	double m_param;
+};
+
+// Ordered roughly from high to low entropy, so the table reads as an entropy sweep. Uniform-K has log2(K) bits per byte.
+static const synth_corpus g_synth_corpora[] =
+{
+	{ "random", 0 },
+	{ "uniform", 64 },
+	{ "uniform", 16 },
+	{ "uniform", 4 },
+	{ "uniform", 2 },
+	{ "zipf", 1.0 },
+	{ "zipf", 1.5 },
+	{ "zipf", 2.0 },
+	{ "geometric", .02 },
+	{ "geometric", .1 },
+	{ "geometric", .3 },
+	{ "geometric", .6 },
+	{ "geometric", .9 },
+	{ "single", 0 }
+};
+
+static std::string get_corpus_name(const synth_corpus& corpus)
+{
+	char buf[64];
+	if ((!strcmp(corpus.m_pDist, "random")) || (!strcmp(corpus.m_pDist, "single")))
+		snprintf(buf, sizeof(buf), "%s", corpus.m_pDist);
+	else
+		snprintf(buf, sizeof(buf), "%s-%g", corpus.m_pDist, corpus.m_param);
+	return buf;
+}
+
+static void generate_corpus(const synth_corpus& corpus, size_t size, uint8_vec& data)
+{
+	double pdf[256];
+	for (uint32_t i = 0; i < 256; i++)
+		pdf[i] = 0;
+
+	const char* pDist = corpus.m_pDist;
+
+	if ((!strcmp(pDist, "random")) || (!strcmp(pDist, "uniform")))
+	{
+		const uint32_t num_syms = strcmp(pDist, "random") ? (uint32_t)corpus.m_param : 256;
+		for (uint32_t i = 0; i < num_syms; i++)
+			pdf[i] = 1.0f;
+	}
+	else if (!strcmp(pDist, "zipf"))
+	{
+		for (uint32_t i = 0; i < 256; i++)
+			pdf[i] = 1.0f / pow((double)(i + 1), corpus.m_param);
+	}
+	else if (!strcmp(pDist, "geometric"))
+	{
+		for (uint32_t i = 0; i < 256; i++)
+			pdf[i] = corpus.m_param * pow(1.0f - corpus.m_param, (double)i);
+	}
+	else
+	{
+		assert(!strcmp(pDist, "single"));
+		pdf['A'] = 1.0f;
+	}
+
+	double total = 0;
+	for (uint32_t i = 0; i < 256; i++)
+		total += pdf[i];
+
+	// Sample through a 64K entry inverse CDF table, 4 bytes per 64-bit random number. Symbols with very small probabilities may not appear,
+	// which doesn't matter because the results are relative to the generated data's actual entropy.
+	const uint32_t cTableBits = 16;
+	uint8_vec sym_table(1 << cTableBits);
+
+	double cum = 0;
+	uint32_t cur = 0;
+	for (uint32_t i = 0; i < 256; i++)
+	{
+		cum += pdf[i];
+		const uint32_t end = (i == 255) ? (1 << cTableBits) : std::min<uint32_t>((uint32_t)((cum / total) * (1 << cTableBits) + .5f), 1 << cTableBits);
+		while (cur < end)
+			sym_table[cur++] = (uint8_t)i;
+	}
+
+	data.resize(size);
+
+	uint64_t seed = 0x5EED1234ULL ^ (uint64_t)(corpus.m_param * 1000.0f);
+	for (size_t i = 0; i < size; i += 4)
+	{
+		const uint64_t r = splitmix64(seed);
+		const size_t n = std::min<size_t>(4, size - i);
+		for (size_t j = 0; j < n; j++)
+			data[i + j] = sym_table[(r >> (j * cTableBits)) & ((1 << cTableBits) - 1)];
+	}
+}
+
+static double compute_entropy(const uint32_t* pHist, size_t size)
+{
+	double total_bits = 0;
+	for (uint32_t i = 0; i < 256; i++)
+		if (pHist[i])
+			total_bits += (double)pHist[i] * -log2((double)pHist[i] / (double)size);
+	return total_bits / (double)size;
+}
+
+// Times op over params.m_runs runs. Returns the median MiB/sec. and cycles per byte, the MiB/sec. standard deviation and the heap allocations per call.
+template<typename F>
+static uint32_t time_op(const bench_params& params, size_t size, F op, double& mibs, double& mibs_stddev, double& cpb, double& allocs)
+{
+	// Untimed call, which also calibrates the number of calls per run
+	double t = get_time();
+	op();
+	t = get_time() - t;
+
+	const uint32_t iters = (uint32_t)std::min<double>(std::max<double>(ceil(params.m_min_run_time / std::max(t, 1e-9)), 1.0f), 1 << 20);
+
+	std::vector<double> run_mibs(params.m_runs), run_cpb(params.m_runs);
+
+	const uint64_t start_allocs = vrange_get_total_heap_allocs();
+
+	for (uint32_t r = 0; r < params.m_runs; r++)
+	{
+		const double start_time = get_time();
+		const uint64_t start_cycles = __rdtsc();
+
+		for (uint32_t i = 0; i < iters; i++)
+			op();
+
+		const uint64_t total_cycles = __rdtsc() - start_cycles;
+		const double total_time = std::max(get_time() - start_time, 1e-9);
+
+		run_mibs[r] = ((double)size * iters / total_time) / (1024 * 1024);
+		run_cpb[r] = (double)total_cycles / ((double)size * iters);
+	}
+
+	allocs = (double)(vrange_get_total_heap_allocs() - start_allocs) / ((double)iters * params.m_runs);
+
+	double mean = 0;
+	for (uint32_t r = 0; r < params.m_runs; r++)
+		mean += run_mibs[r];
+	mean /= params.m_runs;
+
+	double var = 0;
+	for (uint32_t r = 0; r < params.m_runs; r++)
+		var += (run_mibs[r] - mean) * (run_mibs[r] - mean);
+	mibs_stddev = (params.m_runs > 1) ? sqrt(var / (params.m_runs - 1)) : 0.0f;
+
+	std::sort(run_mibs.begin(), run_mibs.end());
+	std::sort(run_cpb.begin(), run_cpb.end());
+
+	mibs = run_mibs[params.m_runs / 2];
+	cpb = run_cpb[params.m_runs / 2];
+
+	return iters;
+}
+
+// Counts the hardware events of calling op num_calls times
+template<typename F>
+static void count_op(uint32_t num_calls, F op, vrange_perf_sample& sample)
+{
+	g_perf_counters.start();
+
+	for (uint32_t i = 0; i < num_calls; i++)
+		op();
+
+	g_perf_counters.stop(sample);
+}
+
+// Returns each valid phase's counts per unit (byte or call), e.g. "ipc=2.10 cycles=5.61 instructions=11.8 ...", or an empty string
+static std::string get_perf_summary(const bench_result& res, uint32_t phase)
+{
+	const vrange_perf_sample& sample = res.m_perf[phase];
+	if (!res.m_perf_units[phase])
+		return "";
+
+	std::string str;
+	char buf[64];
+
+	if ((sample.m_valid[cPerfCycles]) && (sample.m_valid[cPerfInstructions]) && (sample.m_counts[cPerfCycles]))
+	{
+		snprintf(buf, sizeof(buf), "ipc=%.2f ", (double)sample.m_counts[cPerfInstructions] / sample.m_counts[cPerfCycles]);
+		str += buf;
+	}
+
+	for (uint32_t i = 0; i < cTotalPerfEvents; i++)
+	{
+		if (!sample.m_valid[i])
+			continue;
+
+		snprintf(buf, sizeof(buf), "%s=%.4g ", vrange_get_perf_event_name(i), (double)sample.m_counts[i] / res.m_perf_units[phase]);
+		str += buf;
+	}
+
+	if (str.size())
+		str.resize(str.size() - 1);
+
+	return str;
+}
+
+// Decodes a random buffer until params.m_warmup_time seconds have passed
+static void warmup(const bench_params& params)
+{
+	if (params.m_warmup_time <= 0.0f)
+		return;
+
+	synth_corpus corpus = { "random", 0 };
+	uint8_vec data;
+	generate_corpus(corpus, 65536, data);
+
+	uint32_vec freq(256, 1), scaled_cum_prob, dec_table;
+	vrange_create_cum_probs(scaled_cum_prob, freq);
+	vrange_init_table(256, scaled_cum_prob, dec_table);
+
+	uint8_vec enc_buf;
+	vrange_encode(data, enc_buf, scaled_cum_prob);
+
+	const double start_time = get_time();
+	while ((get_time() - start_time) < params.m_warmup_time)
+	{
+		if (!vrange_decode(&enc_buf[0], enc_buf.size(), &data[0], data.size(), &dec_table[0]))
+			panic("vrange_decode() failed during warmup!\n");
+	}
+}
+
+static void print_text_header(FILE* pFile)
+{
+	fprintf(pFile, "%-16s %10s %-6s %5s %7s %8s %9s %17s %7s %17s %7s %6s %6s\n",
+		"corpus", "size", "codec", "lanes", "bits/B", "ratio%", "entropy%", "enc MiB/s", "enc c/B", "dec MiB/s", "dec c/B", "enc a", "dec a");
+}
+
+static void print_text_result(FILE* pFile, const bench_result& res)
+{
+	char vs_entropy[32];
+	if (res.m_entropy > 0.0f)
+		snprintf(vs_entropy, sizeof(vs_entropy), "%.3f", (res.m_comp_size * 8.0f) / (res.m_entropy * res.m_size) * 100.0f);
+	else
+		snprintf(vs_entropy, sizeof(vs_entropy), "-");
+
+	fprintf(pFile, "%-16s %10zu %-6s %5u %7.4f %8.3f %9s %9.1f +-%4.1f%% %7.2f %9.1f +-%4.1f%% %7.2f %6.2f %6.2f\n",
+		res.m_corpus.c_str(), res.m_size, g_codec_names[res.m_codec], res.m_num_lanes, res.m_entropy,
+		(double)res.m_comp_size / res.m_size * 100.0f, vs_entropy,
+		res.m_enc_mibs, res.m_enc_mibs ? res.m_enc_mibs_stddev / res.m_enc_mibs * 100.0f : 0.0f, res.m_enc_cpb,
+		res.m_dec_mibs, res.m_dec_mibs ? res.m_dec_mibs_stddev / res.m_dec_mibs * 100.0f : 0.0f, res.m_dec_cpb,
+		res.m_enc_allocs, res.m_dec_allocs);
+
+	for (uint32_t phase = 0; phase < cTotalPhases; phase++)
+	{
+		const std::string summary(get_perf_summary(res, phase));
+		if (summary.size())
+			fprintf(pFile, "  %-16s per %s: %s\n", g_phase_names[phase], (phase >= cPhaseEncode) ? "byte" : "call", summary.c_str());
+	}
+
+	fflush(pFile);
+}
+
+static std::string json_escape(const std::string& str)
+{
+	std::string res;
+	for (size_t i = 0; i < str.size(); i++)
+	{
+		const uint8_t c = (uint8_t)str[i];
+		if ((c == '"') || (c == '\\'))
+		{
+			res.push_back('\\');
+			res.push_back((char)c);
+		}
+		else if (c < 32)
+		{
+			char buf[8];
+			snprintf(buf, sizeof(buf), "\\u%04x", c);
+			res += buf;
+		}
+		else
+			res.push_back((char)c);
+	}
+	return res;
+}
+
+static std::string csv_escape(const std::string& str)
+{
+	if (str.find_first_of(",\"\n") == std::string::npos)
+		return str;
+
+	std::string res("\"");
+	for (size_t i = 0; i < str.size(); i++)
+	{
+		if (str[i] == '"')
+			res.push_back('"');
+		res.push_back(str[i]);
+	}
+	res.push_back('"');
+	return res;
+}
+
+static void write_csv(FILE* pFile, const std::vector<bench_result>& results)
+{
+	fprintf(pFile, "corpus,size,codec,lanes,entropy_bits_per_byte,comp_size,ratio_pct,vs_entropy_pct,iters,enc_mibs,enc_mibs_stddev,enc_cycles_per_byte,dec_mibs,dec_mibs_stddev,dec_cycles_per_byte,enc_allocs_per_call,dec_allocs_per_call");
+
+	// Per byte (per call for the model phases) hardware counts, empty if unavailable
+	if (SSER_USE_PERF_COUNTERS)
+	{
+		for (uint32_t phase = 0; phase < cTotalPhases; phase++)
+			for (uint32_t i = 0; i < cTotalPerfEvents; i++)
+				fprintf(pFile, ",%s_%s", g_phase_names[phase], vrange_get_perf_event_name(i));
+	}
+
+	fprintf(pFile, "\n");
+
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const bench_result& res = results[i];
+
+		char vs_entropy[32] = { 0 };
+		if (res.m_entropy > 0.0f)
+			snprintf(vs_entropy, sizeof(vs_entropy), "%.4f", (res.m_comp_size * 8.0f) / (res.m_entropy * res.m_size) * 100.0f);
+
+		fprintf(pFile, "%s,%zu,%s,%u,%.6f,%zu,%.4f,%s,%u,%.2f,%.2f,%.4f,%.2f,%.2f,%.4f,%.4f,%.4f",
+			csv_escape(res.m_corpus).c_str(), res.m_size, g_codec_names[res.m_codec], res.m_num_lanes, res.m_entropy, res.m_comp_size,
+			(double)res.m_comp_size / res.m_size * 100.0f, vs_entropy, res.m_iters,
+			res.m_enc_mibs, res.m_enc_mibs_stddev, res.m_enc_cpb,
+			res.m_dec_mibs, res.m_dec_mibs_stddev, res.m_dec_cpb, res.m_enc_allocs, res.m_dec_allocs);
+
+		if (SSER_USE_PERF_COUNTERS)
+		{
+			for (uint32_t phase = 0; phase < cTotalPhases; phase++)
+			{
+				for (uint32_t e = 0; e < cTotalPerfEvents; e++)
+				{
+					if ((res.m_perf_units[phase]) && (res.m_perf[phase].m_valid[e]))
+						fprintf(pFile, ",%.6g", (double)res.m_perf[phase].m_counts[e] / res.m_perf_units[phase]);
+					else
+						fprintf(pFile, ",");
+				}
+			}
+		}
+
+		fprintf(pFile, "\n");
+	}
+}
+
+static void write_json(FILE* pFile, const bench_params& params, int pinned_cpu, const std::vector<bench_result>& results)
+{
+	char time_buf[64] = { 0 };
+	const time_t cur_time = time(NULL);
+	strftime(time_buf, sizeof(time_buf), "%Y-%m-%dT%H:%M:%SZ", gmtime(&cur_time));
+
+	fprintf(pFile, "{\n");
+	fprintf(pFile, "  \"timestamp\": \"%s\",\n", time_buf);
+#if defined(__clang__)
+	fprintf(pFile, "  \"compiler\": \"clang %s\",\n", json_escape(__clang_version__).c_str());
+#elif defined(__GNUC__)
+	fprintf(pFile, "  \"compiler\": \"gcc %s\",\n", json_escape(__VERSION__).c_str());
+#elif defined(_MSC_VER)
+	fprintf(pFile, "  \"compiler\": \"msvc %u\",\n", (uint32_t)_MSC_FULL_VER);
+#else
+	fprintf(pFile, "  \"compiler\": \"unknown\",\n");
+#endif
+	fprintf(pFile, "  \"settings\": { \"runs\": %u, \"min_run_time\": %g, \"warmup_time\": %g, \"cpu\": %i, \"perf_counters\": %s },\n",
+		params.m_runs, params.m_min_run_time, params.m_warmup_time, pinned_cpu, g_perf_counters.is_available() ? "true" : "false");
+	fprintf(pFile, "  \"results\": [\n");
+
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const bench_result& res = results[i];
+
+		char vs_entropy[32];
+		if (res.m_entropy > 0.0f)
+			snprintf(vs_entropy, sizeof(vs_entropy), "%.4f", (res.m_comp_size * 8.0f) / (res.m_entropy * res.m_size) * 100.0f);
+		else
+			snprintf(vs_entropy, sizeof(vs_entropy), "null");
+
+		fprintf(pFile, "    { \"corpus\": \"%s\", \"size\": %zu, \"codec\": \"%s\", \"lanes\": %u, \"entropy_bits_per_byte\": %.6f, \"comp_size\": %zu, "
+			"\"ratio_pct\": %.4f, \"vs_entropy_pct\": %s, \"iters\": %u, "
+			"\"enc_mibs\": %.2f, \"enc_mibs_stddev\": %.2f, \"enc_cycles_per_byte\": %.4f, "
+			"\"dec_mibs\": %.2f, \"dec_mibs_stddev\": %.2f, \"dec_cycles_per_byte\": %.4f, "
+			"\"enc_allocs_per_call\": %.4f, \"dec_allocs_per_call\": %.4f",
+			json_escape(res.m_corpus).c_str(), res.m_size, g_codec_names[res.m_codec], res.m_num_lanes, res.m_entropy, res.m_comp_size,
+			(double)res.m_comp_size / res.m_size * 100.0f, vs_entropy, res.m_iters,
+			res.m_enc_mibs, res.m_enc_mibs_stddev, res.m_enc_cpb,
+			res.m_dec_mibs, res.m_dec_mibs_stddev, res.m_dec_cpb, res.m_enc_allocs, res.m_dec_allocs);
+
+		// Hardware counts per byte (per call for the model phases), only present if the counters are available
+		if (res.m_perf_units[cPhaseDecode])
+		{
+			fprintf(pFile, ", \"perf\": { ");
+
+			for (uint32_t phase = 0; phase < cTotalPhases; phase++)
+			{
+				fprintf(pFile, "%s\"%s\": { ", phase ? ", " : "", g_phase_names[phase]);
+
+				bool first = true;
+				for (uint32_t e = 0; e < cTotalPerfEvents; e++)
+				{
+					if (!res.m_perf[phase].m_valid[e])
+						continue;
+
+					fprintf(pFile, "%s\"%s\": %.6g", first ? "" : ", ", vrange_get_perf_event_name(e), (double)res.m_perf[phase].m_counts[e] / res.m_perf_units[phase]);
+					first = false;
+				}
+
+				fprintf(pFile, " }");
+			}
+
+			fprintf(pFile, " }");
+		}
+
+		fprintf(pFile, " }%s\n", (i + 1 < results.size()) ? "," : "");
+	}
+
+	fprintf(pFile, "  ]\n}\n");
+}
+
+// Benchmarks every enabled codec on pData. Each decode is verified against the input.
+static void bench_data(const bench_params& params, const std::string& corpus_name, const uint8_t* pData, size_t size, FILE* pText_file, std::vector<bench_result>& results)
+{
+	uint32_t hist[256];
+	memset(hist, 0, sizeof(hist));
+	vrange_histogram(pData, size, hist);
+
+	uint32_vec freq(hist, hist + 256), scaled_cum_prob, dec_table;
+	if (!vrange_create_cum_probs(scaled_cum_prob, freq))
+		panic("vrange_create_cum_probs() failed!\n");
+	vrange_init_table(256, scaled_cum_prob, dec_table);
+
+	const double entropy = compute_entropy(hist, size);
+
+	vrange_perf_sample model_perf[2];
+	if (g_perf_counters.is_available())
+	{
+		uint32_vec temp_freq, temp_cum_prob, temp_table;
+
+		count_op(cModelPerfCalls, [&]()
+			{
+				temp_freq = freq;
+				vrange_create_cum_probs(temp_cum_prob, temp_freq);
+			}, model_perf[0]);
+
+		count_op(cModelPerfCalls, [&]() { vrange_init_table(256, scaled_cum_prob, temp_table); }, model_perf[1]);
+	}
+
+	uint8_vec comp_buf;
+	uint8_vec decomp_buf(size);
+
+	vrange_encoder_context enc_ctx;
+
+	for (uint32_t codec = 0; codec < cTotalCodecs; codec++)
+	{
+		if (!(params.m_codec_mask & (1 << codec)))
+			continue;
+
+		bench_result res;
+		res.m_corpus = corpus_name;
+		res.m_size = size;
+		res.m_codec = codec;
+		res.m_entropy = entropy;
+
+		for (uint32_t phase = 0; phase < cTotalPhases; phase++)
+			res.m_perf_units[phase] = 0;
+
+		if (g_perf_counters.is_available())
+		{
+			res.m_perf[cPhaseCreateCumProbs] = model_perf[0];
+			res.m_perf[cPhaseInitTable] = model_perf[1];
+			res.m_perf_units[cPhaseCreateCumProbs] = cModelPerfCalls;
+			res.m_perf_units[cPhaseInitTable] = cModelPerfCalls;
+		}
+
+		size_t comp_size = 0;
+
+		if ((codec == cCodecRange) || (codec == cCodecRangeScalar))
+		{
+			const bool use_scalar = (codec == cCodecRangeScalar);
+
+			const uint32_t num_lanes = params.m_num_lanes ? params.m_num_lanes : vrange_choose_num_lanes(size);
+			res.m_num_lanes = num_lanes;
+
+			comp_buf.resize(vrange_compress_bound(size));
+			if (!enc_ctx.reserve(size))
+				panic("Out of memory!\n");
+
+			auto encode_op = [&]()
+			{
+				if (!enc_ctx.encode(pData, size, &scaled_cum_prob[0], &comp_buf[0], comp_buf.size(), comp_size, num_lanes))
+					panic("vrange_encoder_context::encode() failed!\n");
+			};
+
+			auto decode = [&]()
+			{
+				return use_scalar ? vrange_decode_scalar(&comp_buf[0], comp_size, &decomp_buf[0], size, &dec_table[0], num_lanes) :
+					vrange_decode(&comp_buf[0], comp_size, &decomp_buf[0], size, &dec_table[0], num_lanes);
+			};
+
+			auto decode_op = [&]() { decode(); };
+
+			res.m_iters = time_op(params, size, encode_op, res.m_enc_mibs, res.m_enc_mibs_stddev, res.m_enc_cpb, res.m_enc_allocs);
+
+			if ((!decode()) || (memcmp(&decomp_buf[0], pData, size) != 0))
+				panic("%s decoding failed on corpus %s, size %zu!\n", use_scalar ? "Scalar range" : "Range", corpus_name.c_str(), size);
+
+			const uint32_t dec_iters = time_op(params, size, decode_op, res.m_dec_mibs, res.m_dec_mibs_stddev, res.m_dec_cpb, res.m_dec_allocs);
+
+			if (g_perf_counters.is_available())
+			{
+				count_op(res.m_iters, encode_op, res.m_perf[cPhaseEncode]);
+				count_op(dec_iters, decode_op, res.m_perf[cPhaseDecode]);
+				res.m_perf_units[cPhaseEncode] = (uint64_t)size * res.m_iters;
+				res.m_perf_units[cPhaseDecode] = (uint64_t)size * dec_iters;
+			}
+		}
+		else
+		{
+			res.m_num_lanes = LANES;
+
+			auto encode_op = [&]()
+			{
+				vrange_rans_encode(pData, size, comp_buf, scaled_cum_prob);
+			};
+
+			auto decode_op = [&]()
+			{
+				vrange_rans_decode(&comp_buf[0], comp_size, &decomp_buf[0], size, &dec_table[0]);
+			};
+
+			res.m_iters = time_op(params, size, encode_op, res.m_enc_mibs, res.m_enc_mibs_stddev, res.m_enc_cpb, res.m_enc_allocs);
+
+			comp_size = comp_buf.size();
+
+			if ((!vrange_rans_decode(&comp_buf[0], comp_size, &decomp_buf[0], size, &dec_table[0])) || (memcmp(&decomp_buf[0], pData, size) != 0))
+				panic("rANS decoding failed on corpus %s, size %zu!\n", corpus_name.c_str(), size);
+
+			const uint32_t dec_iters = time_op(params, size, decode_op, res.m_dec_mibs, res.m_dec_mibs_stddev, res.m_dec_cpb, res.m_dec_allocs);
+
+			if (g_perf_counters.is_available())
+			{
+				count_op(res.m_iters, encode_op, res.m_perf[cPhaseEncode]);
+				count_op(dec_iters, decode_op, res.m_perf[cPhaseDecode]);
+				res.m_perf_units[cPhaseEncode] = (uint64_t)size * res.m_iters;
+				res.m_perf_units[cPhaseDecode] = (uint64_t)size * dec_iters;
+			}
+		}
+
+		res.m_comp_size = comp_size;
+
+		if (pText_file)
+			print_text_result(pText_file, res);
+
+		results.push_back(res);
+	}
+}
+
+// Parses a size with an optional k/m/g suffix (powers of 2)
+static bool parse_size(const char* pStr, size_t& size)
+{
+	char* pEnd = NULL;
+	const double val = strtod(pStr, &pEnd);
+	if ((pEnd == pStr) || (val < 1.0f))
+		return false;
+
+	double scale = 1.0f;
+	switch (tolower(*pEnd))
+	{
+	case 'k': scale = 1024.0f; pEnd++; break;
+	case 'm': scale = 1024.0f * 1024.0f; pEnd++; break;
+	case 'g': scale = 1024.0f * 1024.0f * 1024.0f; pEnd++; break;
+	default: break;
+	}
+
+	if (*pEnd)
+		return false;
+
+	size = (size_t)(val * scale);
+	return true;
+}
+
+static void print_usage()
+{
+	printf("Usage: sserangebench [options] [files]\n");
+	printf("Benchmarks range (SIMD and scalar decoding) and rANS coding on synthetic corpora (uniform, geometric, Zipf, single symbol and random bytes) at sizes from\n");
+	printf("--min-size to --max-size (x4 steps), then on each file (book1 by default if it's in the current directory).\n\n");
+	printf("Options:\n");
+	printf(" --format text|csv|json  Output format (default: text)\n");
+	printf(" --out file              Write the results to file, with a text table on stdout\n");
+	printf(" --min-size n            Smallest synthetic size (default: 64), k/m/g suffixes are accepted\n");
+	printf(" --max-size n            Largest synthetic size (default: 16m, up to 1g)\n");
+	printf(" --runs n                Runs per measurement (default: 5)\n");
+	printf(" --min-time s            Min seconds per run (default: .01)\n");
+	printf(" --warmup s              Seconds of warmup decoding (default: .25)\n");
+	printf(" --cpu n                 Pin to CPU n, or -1 to not pin (default: first allowed CPU)\n");
+	printf(" --codec name            range, scalar (range coded, scalar decoder), rans or all (default: all)\n");
+	printf(" --lanes 4|8|16          Range coder lane count (default: chosen from the size)\n");
+	printf(" --no-synthetic          Only benchmark the files\n");
+}
+
+static bool parse_args(int argc, char** argv, bench_params& params)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		const char* pArg = argv[i];
+
+		if ((!strcmp(pArg, "-h")) || (!strcmp(pArg, "--help")))
+		{
+			print_usage();
+			exit(EXIT_SUCCESS);
+		}
+		else if (!strcmp(pArg, "--no-synthetic"))
+		{
+			params.m_synthetic = false;
+			continue;
+		}
+		else if (pArg[0] != '-')
+		{
+			params.m_files.push_back(pArg);
+			continue;
+		}
+
+		if (i + 1 >= argc)
+		{
+			fprintf(stderr, "Missing value for option %s\n", pArg);
+			return false;
+		}
+
+		const char* pVal = argv[++i];
+		bool valid = true;
+
+		if (!strcmp(pArg, "--format"))
+		{
+			if (!strcmp(pVal, "text"))
+				params.m_format = cFormatText;
+			else if (!strcmp(pVal, "csv"))
+				params.m_format = cFormatCSV;
+			else if (!strcmp(pVal, "json"))
+				params.m_format = cFormatJSON;
+			else
+				valid = false;
+		}
+		else if (!strcmp(pArg, "--out"))
+			params.m_out_filename = pVal;
+		else if (!strcmp(pArg, "--min-size"))
+			valid = parse_size(pVal, params.m_min_size);
+		else if (!strcmp(pArg, "--max-size"))
+			valid = parse_size(pVal, params.m_max_size);
+		else if (!strcmp(pArg, "--runs"))
+			valid = (params.m_runs = atoi(pVal)) >= 1;
+		else if (!strcmp(pArg, "--min-time"))
+			valid = (params.m_min_run_time = (float)atof(pVal)) >= 0.0f;
+		else if (!strcmp(pArg, "--warmup"))
+			valid = (params.m_warmup_time = (float)atof(pVal)) >= 0.0f;
+		else if (!strcmp(pArg, "--cpu"))
+			valid = (params.m_cpu = atoi(pVal)) >= -1;
+		else if (!strcmp(pArg, "--codec"))
+		{
+			params.m_codec_mask = 0;
+			for (uint32_t codec = 0; codec < cTotalCodecs; codec++)
+				if ((!strcmp(pVal, g_codec_names[codec])) || (!strcmp(pVal, "all")))
+					params.m_codec_mask |= 1 << codec;
+
+			valid = params.m_codec_mask != 0;
+		}
+		else if (!strcmp(pArg, "--lanes"))
+			valid = vrange_is_valid_num_lanes(params.m_num_lanes = atoi(pVal));
+		else
+		{
+			fprintf(stderr, "Unknown option %s\n", pArg);
+			return false;
+		}
+
+		if (!valid)
+		{
+			fprintf(stderr, "Invalid value for option %s: %s\n", pArg, pVal);
+			return false;
+		}
+	}
+
+	if ((params.m_min_size > params.m_max_size) || (params.m_max_size > ((size_t)1 << 30)))
+	{
+		fprintf(stderr, "Sizes must be between 1 and 1g, with --min-size <= --max-size\n");
+		return false;
+	}
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	bench_params params;
+	if (!parse_args(argc, argv, params))
+	{
+		print_usage();
+		return EXIT_FAILURE;
+	}
+
+	if (params.m_files.empty())
+	{
+		FILE* pFile = fopen("book1", "rb");
+		if (pFile)
+		{
+			fclose(pFile);
+			params.m_files.push_back("book1");
+		}
+	}
+
+	// The text table goes to stdout unless the machine readable output does
+	FILE* pOut_file = NULL;
+	if (params.m_format != cFormatText)
+	{
+		if (params.m_out_filename.size())
+		{
+			pOut_file = fopen(params.m_out_filename.c_str(), "w");
+			if (!pOut_file)
+				panic("Failed opening output file %s\n", params.m_out_filename.c_str());
+		}
+		else
+			pOut_file = stdout;
+	}
+
+	FILE* pText_file = (pOut_file == stdout) ? stderr : stdout;
+
+	const int pinned_cpu = pin_thread(params.m_cpu);
+	if (pinned_cpu >= 0)
+		fprintf(pText_file, "Pinned to CPU %i\n", pinned_cpu);
+	else if (params.m_cpu != -1)
+		fprintf(pText_file, "Warning: Failed pinning the benchmark thread to a CPU\n");
+
+	if ((SSER_USE_PERF_COUNTERS) && (!g_perf_counters.init()))
+		fprintf(pText_file, "Warning: Hardware performance counters aren't available (check /proc/sys/kernel/perf_event_paranoid)\n");
+
+	warmup(params);
+
+	print_text_header(pText_file);
+
+	std::vector<bench_result> results;
+
+	if (params.m_synthetic)
+	{
+		uint8_vec data;
+
+		for (uint32_t c = 0; c < sizeof(g_synth_corpora) / sizeof(g_synth_corpora[0]); c++)
+		{
+			// Smaller sizes are prefixes of the largest one, which have the same distribution
+			generate_corpus(g_synth_corpora[c], params.m_max_size, data);
+
+			for (size_t size = params.m_min_size; size <= params.m_max_size; size *= 4)
+			{
+				bench_data(params, get_corpus_name(g_synth_corpora[c]), &data[0], size, pText_file, results);
+
+				if (size > (params.m_max_size / 4))
+					break;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < params.m_files.size(); i++)
+	{
+		uint8_vec data;
+		if (!read_file_to_vec(params.m_files[i].c_str(), data))
+			panic("Failed reading file %s\n", params.m_files[i].c_str());
+
+		if (data.empty())
+		{
+			fprintf(pText_file, "Skipping empty file %s\n", params.m_files[i].c_str());
+			continue;
+		}
+
+		bench_data(params, params.m_files[i], &data[0], data.size(), pText_file, results);
+	}
+
+	if (pOut_file)
+	{
+		if (params.m_format == cFormatCSV)
+			write_csv(pOut_file, results);
+		else
+			write_json(pOut_file, params, pinned_cpu, results);
+
+		if ((pOut_file != stdout) && (fclose(pOut_file) == EOF))
+			panic("Failed writing output file %s\n", params.m_out_filename.c_str());
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,113 @@
+// sserangealloc.cpp
+// Heap allocation counting for the test and benchmark apps, Richard Geldreich, Jr., public domain (see full text at unlicense.org)
+// The replacements live in their own translation unit, so the compiler can't inline the replaced delete into std::vector and pair it with
+// the library's new (which is what made -Wmismatched-new-delete flag them when they were in test.cpp).
+#include "sserangealloc.h"
+#include <stdlib.h>
+#include <new>
+#include <atomic>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// Atomic because the test app's pipelined modes allocate from several threads
+static std::atomic<uint64_t> g_total_heap_allocs(0);
+
+static void* counted_alloc(size_t size)
+{
+	g_total_heap_allocs++;
+	return malloc(size ? size : 1);
+}
+
+namespace sserangecoder
+{
+	uint64_t vrange_get_total_heap_allocs()
+	{
+		return g_total_heap_allocs;
+	}
+}
+
+void* operator new(size_t size)
+{
+	void* p = counted_alloc(size);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size)
+{
+	void* p = counted_alloc(size);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return counted_alloc(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return counted_alloc(size); }
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { free(p); }
+
+#ifdef __cpp_sized_deallocation
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+#endif
+
+#ifdef __cpp_aligned_new
+static void* counted_aligned_alloc(size_t size, std::align_val_t align)
+{
+	g_total_heap_allocs++;
+
+	size_t alignment = (size_t)align;
+	if (alignment < sizeof(void*))
+		alignment = sizeof(void*);
+
+#ifdef _WIN32
+	return _aligned_malloc(size ? size : 1, alignment);
+#else
+	void* p = NULL;
+	if (posix_memalign(&p, alignment, size ? size : 1) != 0)
+		return NULL;
+	return p;
+#endif
+}
+
+static void aligned_free(void* p)
+{
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+void* operator new(size_t size, std::align_val_t align)
+{
+	void* p = counted_aligned_alloc(size, align);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size, std::align_val_t align)
+{
+	void* p = counted_aligned_alloc(size, align);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new(size_t size, std::align_val_t align, const std::nothrow_t&) noexcept { return counted_aligned_alloc(size, align); }
+void* operator new[](size_t size, std::align_val_t align, const std::nothrow_t&) noexcept { return counted_aligned_alloc(size, align); }
+
+void operator delete(void* p, std::align_val_t) noexcept { aligned_free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { aligned_free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { aligned_free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { aligned_free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { aligned_free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { aligned_free(p); }
+#endif
@@ -0,0 +1,11 @@
+// sserangealloc.h
+// Heap allocation counting for the test and benchmark apps, Richard Geldreich, Jr., public domain (see full text at unlicense.org)
+#pragma once
+#include <stdint.h>
+
+namespace sserangecoder
+{
+	// Returns the number of calls to the global operator new since startup, counting every form: scalar, array, nothrow and (when the compiler
+	// supports them) aligned. Linking sserangealloc.cpp replaces the global operators new and delete with malloc() based versions that count.
+	uint64_t vrange_get_total_heap_allocs();
+}
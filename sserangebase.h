@@ -0,0 +1,46 @@
+// sserangebase.h
+// Types, constants and helpers shared by the SSE 4.1 and scalar range coders (no SIMD headers), Richard Geldreich, Jr., public domain (see full text at unlicense.org)
+#pragma once
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <vector>
+#include <assert.h>
+#include <memory.h>
+
+// Includes inline: GCC only honors always_inline on inline functions (otherwise it warns the function might not be inlinable), and static inline
+// functions which aren't used in a translation unit don't warn with -Wall
+#ifndef _MSC_VER
+#define sser_forceinline inline __attribute__((always_inline))
+#else
+#define sser_forceinline __forceinline
+#endif
+
+namespace sserangecoder
+{
+	typedef std::vector<uint8_t> uint8_vec;
+	typedef std::vector<uint32_t> uint32_vec;
+
+	template <typename S> inline S clamp(S value, S low, S high) { return (value < low) ? low : ((value > high) ? high : value); }
+	template <typename T> inline void clear_obj(T& obj) { memset(&obj, 0, sizeof(obj)); }
+	
+	const uint32_t cRangeCodecMinSyms = 2, cRangeCodecMaxSyms = 256;
+	const uint32_t cRangeCodecMinLen = 0x00010000U, cRangeCodecMaxLen = 0x00FFFFFFU;
+	const uint32_t cRangeCodecProbBits = 12;
+	const uint32_t cRangeCodecProbScale = 1 << cRangeCodecProbBits;
+
+	const uint32_t LANES = 16;
+	const uint32_t LANE_MASK = LANES - 1;
+
+	// vrange_encode() streams can also use 4 or 8 lanes, which cuts the per-stream overhead (3 bytes per lane) on small inputs at some cost in decoding speed.
+	const uint32_t cRangeCodecMinLanes = 4;
+
+	inline bool vrange_is_valid_num_lanes(uint32_t num_lanes) { return (num_lanes == 4) || (num_lanes == 8) || (num_lanes == 16); }
+
+	// Per stream overhead of vrange_encode(): 3 initial bytes per lane plus 2 bytes of padding
+	inline uint32_t vrange_get_stream_overhead(uint32_t num_lanes) { return num_lanes * 3 + 2; }
+
+	// Returns the lane count vrange_encode() should use for data_size input bytes: 4 lanes below 512 bytes, 8 below 2KB, otherwise 16.
+	uint32_t vrange_choose_num_lanes(size_t data_size);
+}
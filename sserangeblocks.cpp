@@ -0,0 +1,521 @@
+// sserangeblocks.cpp
+// Blocked stream format with cost-based automatic block splitting, Richard Geldreich, Jr., public domain (see full text at unlicense.org)
+#include "sserangeblocks.h"
+#include <math.h>
+#include <algorithm>
+
+namespace sserangecoder
+{
+	// Per stream overhead of a 16 lane vrange_encode() stream, used by the splitter (block sizes are unknown there)
+	const uint32_t cLaneOverheadSize = LANES * 3 + 2;
+
+	static inline uint32_t get_lanes_code(uint32_t num_lanes)
+	{
+		return (num_lanes == 4) ? 2 : ((num_lanes == 8) ? 1 : 0);
+	}
+
+	static inline void write_le32(uint8_t* pDst, uint32_t v)
+	{
+		for (uint32_t i = 0; i < 4; i++)
+			pDst[i] = (uint8_t)(v >> (i * 8));
+	}
+
+	static inline uint32_t read_le32(const uint8_t* pSrc)
+	{
+		return pSrc[0] | (pSrc[1] << 8) | (pSrc[2] << 16) | ((uint32_t)pSrc[3] << 24);
+	}
+
+	double vrange_estimate_block_bits(const uint32_t* pHist)
+	{
+		uint64_t total = 0;
+		for (uint32_t i = 0; i < 256; i++)
+			total += pHist[i];
+
+		if (!total)
+			return cRangeBlockHeaderSize * 8.0f;
+
+		// Order-0 entropy: total*log2(total) - sum(n*log2(n))
+		double bits = (double)total * log2((double)total);
+
+		// Guess the model size from which symbols will need 2 byte scaled frequencies
+		const uint64_t two_byte_thresh = total * 128;
+		uint32_t model_size = 32;
+
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			const uint32_t n = pHist[i];
+			if (!n)
+				continue;
+
+			bits -= (double)n * log2((double)n);
+			model_size += (((uint64_t)n * cRangeCodecProbScale) >= two_byte_thresh) ? 2 : 1;
+		}
+
+		const double coded_bits = bits + (model_size + cLaneOverheadSize) * 8.0f;
+		const double raw_bits = total * 8.0f;
+
+		return std::min(coded_bits, raw_bits) + cRangeBlockHeaderSize * 8.0f;
+	}
+
+	void vrange_split_blocks(const uint8_t* pData, size_t data_size, vrange_block_desc_vec& blocks, const vrange_block_params& params)
+	{
+		blocks.resize(0);
+
+		if (!data_size)
+			return;
+
+		const uint32_t max_block_size = clamp<uint32_t>(params.m_max_block_size, 1, cRangeBlockMaxSize);
+		const uint32_t window_size = clamp<uint32_t>(params.m_window_size, 256, max_block_size);
+
+		if ((params.m_fixed_block_size) || (data_size <= window_size))
+		{
+			const uint32_t block_size = params.m_fixed_block_size ? std::min(params.m_fixed_block_size, max_block_size) : max_block_size;
+
+			for (size_t ofs = 0; ofs < data_size; ofs += block_size)
+			{
+				vrange_block_desc desc;
+				desc.m_ofs = ofs;
+				desc.m_size = (uint32_t)std::min<size_t>(block_size, data_size - ofs);
+				blocks.push_back(desc);
+			}
+			return;
+		}
+
+		uint32_t cur_hist[256], win_hist[256], merged_hist[256];
+		clear_obj(cur_hist);
+
+		vrange_block_desc cur_block;
+		cur_block.m_ofs = 0;
+		cur_block.m_size = (uint32_t)std::min<size_t>(window_size, data_size);
+
+		vrange_histogram(pData, cur_block.m_size, cur_hist);
+		double cur_bits = vrange_estimate_block_bits(cur_hist);
+
+		for (size_t ofs = cur_block.m_size; ofs < data_size; ofs += window_size)
+		{
+			const uint32_t n = (uint32_t)std::min<size_t>(window_size, data_size - ofs);
+
+			clear_obj(win_hist);
+			vrange_histogram(pData + ofs, n, win_hist);
+
+			bool split = (cur_block.m_size + n) > max_block_size;
+
+			const double win_bits = vrange_estimate_block_bits(win_hist);
+			double merged_bits = 0.0f;
+
+			if (!split)
+			{
+				for (uint32_t i = 0; i < 256; i++)
+					merged_hist[i] = cur_hist[i] + win_hist[i];
+
+				merged_bits = vrange_estimate_block_bits(merged_hist);
+
+				// Start a new block if coding the window separately (paying for another header and model) is cheaper
+				split = (cur_bits + win_bits) < merged_bits;
+			}
+
+			if (split)
+			{
+				blocks.push_back(cur_block);
+
+				cur_block.m_ofs = ofs;
+				cur_block.m_size = n;
+				memcpy(cur_hist, win_hist, sizeof(cur_hist));
+				cur_bits = win_bits;
+			}
+			else
+			{
+				cur_block.m_size += n;
+				memcpy(cur_hist, merged_hist, sizeof(cur_hist));
+				cur_bits = merged_bits;
+			}
+		}
+
+		blocks.push_back(cur_block);
+	}
+
+	uint32_t vrange_get_model_size(const uint32_vec& scaled_cum_prob)
+	{
+		assert(scaled_cum_prob.size() == 257);
+
+		uint32_t total_size = 32;
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			const uint32_t f = scaled_cum_prob[i + 1] - scaled_cum_prob[i];
+			if (f)
+				total_size += (f < 128) ? 1 : 2;
+		}
+
+		return total_size;
+	}
+
+	void vrange_write_model(const uint32_vec& scaled_cum_prob, uint8_vec& buf)
+	{
+		assert(scaled_cum_prob.size() == 257);
+
+		const size_t mask_ofs = buf.size();
+		buf.resize(mask_ofs + 32);
+		memset(&buf[mask_ofs], 0, 32);
+
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			const uint32_t f = scaled_cum_prob[i + 1] - scaled_cum_prob[i];
+			if (!f)
+				continue;
+
+			assert(f < cRangeCodecProbScale);
+
+			buf[mask_ofs + (i >> 3)] |= (uint8_t)(1 << (i & 7));
+
+			if (f < 128)
+				buf.push_back((uint8_t)f);
+			else
+			{
+				buf.push_back((uint8_t)(0x80 | (f & 0x7F)));
+				buf.push_back((uint8_t)(f >> 7));
+			}
+		}
+	}
+
+	bool vrange_read_model(const uint8_t*& pSrc, const uint8_t* pSrc_end, uint32_vec& scaled_cum_prob)
+	{
+		if ((pSrc_end - pSrc) < 32)
+			return false;
+
+		const uint8_t* pMask = pSrc;
+		const uint8_t* pCur = pSrc + 32;
+
+		scaled_cum_prob.resize(257);
+
+		uint32_t total = 0;
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			scaled_cum_prob[i] = total;
+
+			if ((pMask[i >> 3] & (1 << (i & 7))) == 0)
+				continue;
+
+			if (pCur >= pSrc_end)
+				return false;
+
+			uint32_t f = *pCur++;
+			if (f & 0x80)
+			{
+				if (pCur >= pSrc_end)
+					return false;
+
+				f = (f & 0x7F) | (*pCur++ << 7);
+			}
+
+			if ((!f) || (f >= cRangeCodecProbScale))
+				return false;
+
+			total += f;
+			if (total > cRangeCodecProbScale)
+				return false;
+		}
+
+		if (total != cRangeCodecProbScale)
+			return false;
+
+		scaled_cum_prob[256] = total;
+
+		pSrc = pCur;
+		return true;
+	}
+
+	// Returns the cost in bits of coding the symbols in pHist using the model's scaled frequencies, or -1 if a used symbol isn't in the model.
+	static double get_model_cost_bits(const uint32_t* pHist, const uint32_vec& scaled_cum_prob, uint32_vec& sym_costs)
+	{
+		vrange_get_sym_costs(256, scaled_cum_prob, sym_costs);
+
+		const uint64_t cost = vrange_get_hist_cost(pHist, &sym_costs[0]);
+		if (cost == UINT64_MAX)
+			return -1.0f;
+
+		return (double)cost / (double)(1 << cRangeCodecCostFracBits);
+	}
+
+	bool vrange_block_encoder::encode_block(const uint8_t* pData, uint32_t data_size, uint8_vec& comp_data, bool allow_model_reuse)
+	{
+		if (data_size > cRangeBlockMaxSize)
+			return false;
+
+		const size_t header_ofs = comp_data.size();
+		comp_data.resize(header_ofs + cRangeBlockHeaderSize);
+
+		uint64_t cur_ticks = m_pStats ? __rdtsc() : 0;
+
+		uint32_t hist[256];
+		clear_obj(hist);
+		vrange_histogram(pData, data_size, hist);
+
+		if (m_pStats)
+		{
+			const uint64_t t = __rdtsc();
+			m_pStats->m_histogram_ticks += t - cur_ticks;
+			cur_ticks = t;
+		}
+
+		uint32_t block_type = cRangeBlockRaw;
+
+		if (data_size)
+		{
+			m_sym_freq.resize(256);
+			memcpy(&m_sym_freq[0], hist, sizeof(hist));
+
+			if (!vrange_create_cum_probs(m_scaled_cum_prob, m_sym_freq))
+				return false;
+
+			const uint32_t model_size = vrange_get_model_size(m_scaled_cum_prob);
+			const double new_model_bits = get_model_cost_bits(hist, m_scaled_cum_prob, m_sym_costs) + model_size * 8.0f;
+
+			double prev_model_bits = -1.0f;
+			if ((allow_model_reuse) && (m_has_prev_model))
+				prev_model_bits = get_model_cost_bits(hist, m_prev_scaled_cum_prob, m_sym_costs);
+
+			const bool use_prev_model = (prev_model_bits >= 0.0f) && (prev_model_bits <= new_model_bits);
+
+			// Small blocks use fewer lanes to reduce the per-stream overhead (rANS streams always use 16)
+			const uint32_t num_lanes = m_use_rans ? LANES : vrange_choose_num_lanes(data_size);
+
+			// Huffman coding is chosen when its exact size is within the speed bias of the estimated range coded size
+			bool use_huffman = false;
+			uint32_t code_lens_size = 0;
+
+			if ((m_huffman_speed_bias >= 0.0f) && (vrange_huff_create_code_lens(hist, m_code_lens)))
+			{
+				code_lens_size = vrange_huff_get_code_lens_size(m_code_lens);
+
+				const double huff_bits = (double)vrange_huff_get_hist_bits(hist, m_code_lens) + (code_lens_size + cHuffOverheadSize) * 8.0f;
+				const double range_bits = (use_prev_model ? prev_model_bits : new_model_bits) + vrange_get_stream_overhead(num_lanes) * 8.0f;
+
+				use_huffman = huff_bits <= range_bits * (1.0f + m_huffman_speed_bias);
+			}
+
+			// Model creation includes picking the block type (cost estimates and Huffman code lengths)
+			if (m_pStats)
+				m_pStats->m_model_ticks += __rdtsc() - cur_ticks;
+
+			if (use_huffman)
+				vrange_huff_encode(pData, data_size, m_enc_buf, m_code_lens);
+			else if (m_use_rans)
+				vrange_rans_encode(pData, data_size, m_enc_buf, use_prev_model ? m_prev_scaled_cum_prob : m_scaled_cum_prob);
+			else
+			{
+				const uint8_t* pComp;
+				size_t comp_size;
+				if (!m_range_enc_ctx.encode(pData, data_size, use_prev_model ? &m_prev_scaled_cum_prob[0] : &m_scaled_cum_prob[0], pComp, comp_size, num_lanes, m_pStats))
+					return false;
+
+				const uint64_t output_start_ticks = m_pStats ? __rdtsc() : 0;
+
+				m_enc_buf.assign(pComp, pComp + comp_size);
+
+				if (m_pStats)
+					m_pStats->m_output_ticks += __rdtsc() - output_start_ticks;
+			}
+
+			// Fall back to a raw block if the coded block (plus any model) would be larger than the input
+			const size_t coded_size = m_enc_buf.size() + (use_huffman ? code_lens_size : (use_prev_model ? 0 : model_size));
+
+			if (coded_size < data_size)
+			{
+				if (use_huffman)
+				{
+					block_type = cRangeBlockHuffman;
+
+					vrange_huff_write_code_lens(m_code_lens, comp_data);
+				}
+				else if (use_prev_model)
+					block_type = m_use_rans ? cRangeBlockRansPrevModel : cRangeBlockPrevModel;
+				else
+				{
+					block_type = m_use_rans ? cRangeBlockRansNewModel : cRangeBlockNewModel;
+
+					vrange_write_model(m_scaled_cum_prob, comp_data);
+					m_prev_scaled_cum_prob.swap(m_scaled_cum_prob);
+					m_has_prev_model = true;
+				}
+
+				if ((block_type == cRangeBlockNewModel) || (block_type == cRangeBlockPrevModel))
+					block_type |= get_lanes_code(num_lanes) << cRangeBlockLanesShift;
+			}
+		}
+
+		const uint32_t payload_size = (block_type == cRangeBlockRaw) ? data_size : (uint32_t)m_enc_buf.size();
+		const size_t payload_ofs = comp_data.size();
+
+		comp_data.resize(payload_ofs + payload_size);
+		if (payload_size)
+			memcpy(&comp_data[payload_ofs], (block_type == cRangeBlockRaw) ? pData : &m_enc_buf[0], payload_size);
+
+		comp_data[header_ofs] = (uint8_t)block_type;
+		write_le32(&comp_data[header_ofs + 1], data_size);
+		write_le32(&comp_data[header_ofs + 5], payload_size);
+
+		return true;
+	}
+
+	bool vrange_block_decoder::peek_block_size(const uint8_t* pSrc, const uint8_t* pSrc_end, uint32_t& orig_size)
+	{
+		if ((pSrc_end - pSrc) < (ptrdiff_t)cRangeBlockHeaderSize)
+			return false;
+
+		const uint32_t block_type = pSrc[0] & cRangeBlockTypeMask;
+		const uint32_t lanes_code = pSrc[0] >> cRangeBlockLanesShift;
+
+		if (block_type >= cRangeBlockTotalTypes)
+			return false;
+
+		// Only range coded blocks have a lane count, and code 3 is unused
+		if ((lanes_code) && ((lanes_code > 2) || ((block_type != cRangeBlockNewModel) && (block_type != cRangeBlockPrevModel))))
+			return false;
+
+		orig_size = read_le32(pSrc + 1);
+		return orig_size <= cRangeBlockMaxSize;
+	}
+
+	bool vrange_block_decoder::decode_block(const uint8_t*& pSrc, const uint8_t* pSrc_end, uint8_t* pDst, size_t dst_avail, uint32_t& decoded_size)
+	{
+		decoded_size = 0;
+
+		uint32_t orig_size;
+		if (!peek_block_size(pSrc, pSrc_end, orig_size))
+			return false;
+
+		if (orig_size > dst_avail)
+			return false;
+
+		const uint32_t block_type = pSrc[0] & cRangeBlockTypeMask;
+		const uint32_t num_lanes = LANES >> (pSrc[0] >> cRangeBlockLanesShift);
+		const uint32_t payload_size = read_le32(pSrc + 5);
+
+		const uint8_t* pCur = pSrc + cRangeBlockHeaderSize;
+
+		if (block_type == cRangeBlockRaw)
+		{
+			if ((payload_size != orig_size) || ((size_t)(pSrc_end - pCur) < payload_size))
+				return false;
+
+			if (orig_size)
+				memcpy(pDst, pCur, orig_size);
+		}
+		else if (block_type == cRangeBlockHuffman)
+		{
+			if (!vrange_huff_read_code_lens(pCur, pSrc_end, m_code_lens))
+				return false;
+
+			if ((!orig_size) || ((size_t)(pSrc_end - pCur) < payload_size))
+				return false;
+
+			const uint64_t start_ticks = m_pStats ? __rdtsc() : 0;
+
+			vrange_huff_init_table(m_code_lens, m_huff_dec_table);
+
+			if (m_pStats)
+				m_pStats->m_table_ticks += __rdtsc() - start_ticks;
+
+			if (!vrange_huff_decode(pCur, payload_size, pDst, orig_size, &m_huff_dec_table[0]))
+				return false;
+		}
+		else
+		{
+			const bool is_rans = (block_type == cRangeBlockRansNewModel) || (block_type == cRangeBlockRansPrevModel);
+
+			if ((block_type == cRangeBlockNewModel) || (block_type == cRangeBlockRansNewModel))
+			{
+				m_has_model = false;
+
+				if (!vrange_read_model(pCur, pSrc_end, m_scaled_cum_prob))
+					return false;
+
+				const uint64_t start_ticks = m_pStats ? __rdtsc() : 0;
+
+				// The full table is built on first use, small blocks with a small alphabet may not need it at all
+				vrange_init_small_table(256, &m_scaled_cum_prob[0], m_small_table);
+				m_has_dec_table = false;
+				m_has_model = true;
+
+				if (m_pStats)
+					m_pStats->m_table_ticks += __rdtsc() - start_ticks;
+			}
+			else if (!m_has_model)
+				return false;
+
+			if ((!orig_size) || (payload_size < (is_rans ? LANES * sizeof(uint32_t) : vrange_get_stream_overhead(num_lanes))) || ((size_t)(pSrc_end - pCur) < payload_size))
+				return false;
+
+			const bool use_small_table = (!is_rans) && (vrange_prefer_small_table(m_small_table, orig_size));
+
+			if ((!use_small_table) && (!m_has_dec_table))
+			{
+				const uint64_t start_ticks = m_pStats ? __rdtsc() : 0;
+
+				vrange_init_table(256, m_scaled_cum_prob, m_dec_table);
+				m_has_dec_table = true;
+
+				if (m_pStats)
+					m_pStats->m_table_ticks += __rdtsc() - start_ticks;
+			}
+
+			if (is_rans)
+			{
+				if (!vrange_rans_decode(pCur, payload_size, pDst, orig_size, &m_dec_table[0]))
+					return false;
+			}
+			else if (use_small_table)
+			{
+				if (!vrange_decode_small(pCur, payload_size, pDst, orig_size, m_small_table, num_lanes, m_pStats))
+					return false;
+			}
+			else if (!vrange_decode(pCur, payload_size, pDst, orig_size, &m_dec_table[0], num_lanes, m_pStats))
+				return false;
+		}
+
+		pSrc = pCur + payload_size;
+		decoded_size = orig_size;
+		return true;
+	}
+
+	bool vrange_encode_blocks(const uint8_t* pData, size_t data_size, uint8_vec& comp_data, const vrange_block_params& params, vrange_encode_stats* pStats)
+	{
+		vrange_block_desc_vec blocks;
+		vrange_split_blocks(pData, data_size, blocks, params);
+
+		vrange_block_encoder enc;
+		enc.set_huffman_speed_bias(params.m_huffman_speed_bias);
+		enc.set_use_rans(params.m_use_rans);
+		enc.set_stats(pStats);
+
+		for (size_t i = 0; i < blocks.size(); i++)
+		{
+			if (!enc.encode_block(pData + blocks[i].m_ofs, blocks[i].m_size, comp_data, params.m_allow_model_reuse))
+				return false;
+		}
+
+		return true;
+	}
+
+	bool vrange_decode_blocks(const uint8_t* pComp, size_t comp_size, uint8_t* pDst, size_t dst_size, vrange_decode_stats* pStats)
+	{
+		const uint8_t* pSrc = pComp;
+		const uint8_t* pSrc_end = pComp + comp_size;
+
+		vrange_block_decoder dec;
+		dec.set_stats(pStats);
+
+		size_t dst_ofs = 0;
+		while (pSrc < pSrc_end)
+		{
+			uint32_t decoded_size;
+			if (!dec.decode_block(pSrc, pSrc_end, pDst + dst_ofs, dst_size - dst_ofs, decoded_size))
+				return false;
+
+			dst_ofs += decoded_size;
+		}
+
+		return dst_ofs == dst_size;
+	}
+
+} // namespace sserangecoder
@@ -0,0 +1,155 @@
+// sserangeblocks.h
+// Blocked stream format with cost-based automatic block splitting, Richard Geldreich, Jr., public domain (see full text at unlicense.org)
+#pragma once
+#include "sserangecoder.h"
+#include "sserangehuff.h"
+
+namespace sserangecoder
+{
+	// Each block starts with a 9 byte header: block type (1 byte), original size (4 bytes LE), payload size (4 bytes LE).
+	// cRangeBlockNewModel blocks are followed by the serialized model, then the vrange_encode() payload.
+	// cRangeBlockHuffman blocks are followed by the serialized code lengths, then the vrange_huff_encode() payload.
+	// The rANS block types are identical to the range coded types, except the payload comes from vrange_rans_encode().
+	// Range coded blocks store their lane count (see vrange_choose_num_lanes()) in the top 2 bits of the type byte, see cRangeBlockLanesShift.
+	enum
+	{
+		cRangeBlockRaw = 0,			// payload is the uncompressed data
+		cRangeBlockNewModel = 1,	// model follows the header
+		cRangeBlockPrevModel = 2,	// reuses the model of the previous range coded block in the stream
+		cRangeBlockHuffman = 3,		// Huffman coded, code lengths follow the header
+		cRangeBlockRansNewModel = 4,	// rANS coded, model follows the header
+		cRangeBlockRansPrevModel = 5,	// rANS coded, reuses the model of the previous range or rANS coded block
+
+		cRangeBlockTotalTypes
+	};
+
+	// Type byte bits [7:6]: 0 = 16 lanes, 1 = 8 lanes, 2 = 4 lanes. Always 0 for the other block types, so older streams decode unchanged.
+	const uint32_t cRangeBlockLanesShift = 6;
+	const uint32_t cRangeBlockTypeMask = (1U << cRangeBlockLanesShift) - 1;
+
+	const uint32_t cRangeBlockHeaderSize = 1 + sizeof(uint32_t) * 2;
+	const uint32_t cRangeBlockMaxSize = 64 * 1024 * 1024;
+	const float cRangeBlockDefaultHuffmanBias = .01f;
+
+	struct vrange_block_params
+	{
+		vrange_block_params() { clear(); }
+
+		void clear()
+		{
+			m_window_size = 8192;
+			m_max_block_size = 1024 * 1024;
+			m_fixed_block_size = 0;
+			m_allow_model_reuse = true;
+			m_huffman_speed_bias = cRangeBlockDefaultHuffmanBias;
+			m_use_rans = false;
+		}
+
+		// Histogram window size used by the splitter. Block boundaries always fall on a multiple of this size.
+		uint32_t m_window_size;
+
+		// Blocks are never larger than this (must be <= cRangeBlockMaxSize)
+		uint32_t m_max_block_size;
+
+		// If non-zero the cost-based splitter is disabled and the input is cut into blocks of this size
+		uint32_t m_fixed_block_size;
+
+		// If true, blocks may reuse the previous block's model instead of storing their own
+		bool m_allow_model_reuse;
+
+		// Blocks are Huffman coded when their estimated size is at most (1 + m_huffman_speed_bias) times the range coded size.
+		// Huffman blocks decode faster, so a small positive bias trades a little ratio for speed. Negative values disable Huffman blocks.
+		float m_huffman_speed_bias;
+
+		// If true, blocks which aren't raw or Huffman coded use the interleaved rANS coder instead of the range coder.
+		// Both use the same models and decoding tables, so either can be picked per stream depending on which decodes faster on the target CPU.
+		bool m_use_rans;
+	};
+
+	struct vrange_block_desc
+	{
+		size_t m_ofs;
+		uint32_t m_size;
+	};
+	typedef std::vector<vrange_block_desc> vrange_block_desc_vec;
+
+	// Returns the estimated coded size (in bits) of a block with the specified histogram, including the block and model headers.
+	double vrange_estimate_block_bits(const uint32_t* pHist);
+
+	// Splits pData into blocks with the lowest estimated total coded size.
+	void vrange_split_blocks(const uint8_t* pData, size_t data_size, vrange_block_desc_vec& blocks, const vrange_block_params& params);
+
+	// Model serialization: a 256-bit used symbol mask followed by each used symbol's scaled frequency in 1 or 2 bytes.
+	uint32_t vrange_get_model_size(const uint32_vec& scaled_cum_prob);
+	void vrange_write_model(const uint32_vec& scaled_cum_prob, uint8_vec& buf);
+	bool vrange_read_model(const uint8_t*& pSrc, const uint8_t* pSrc_end, uint32_vec& scaled_cum_prob);
+
+	// Encodes blocks one at a time, remembering the last model so later blocks can reuse it.
+	class vrange_block_encoder
+	{
+	public:
+		vrange_block_encoder() { reset(); m_huffman_speed_bias = cRangeBlockDefaultHuffmanBias; m_use_rans = false; m_pStats = NULL; }
+
+		// Forgets the previous block's model, so the next block is independently decodable.
+		void reset() { m_has_prev_model = false; }
+
+		// See vrange_block_params::m_huffman_speed_bias
+		void set_huffman_speed_bias(float bias) { m_huffman_speed_bias = bias; }
+
+		// See vrange_block_params::m_use_rans
+		void set_use_rans(bool use_rans) { m_use_rans = use_rans; }
+
+		// Optional stats accumulated by every following block: histogram and model creation, and the range coder's phases (see vrange_encode_stats)
+		void set_stats(vrange_encode_stats* pStats) { m_pStats = pStats; }
+
+		// Appends a single encoded block to comp_data.
+		bool encode_block(const uint8_t* pData, uint32_t data_size, uint8_vec& comp_data, bool allow_model_reuse);
+
+	private:
+		bool m_has_prev_model;
+		float m_huffman_speed_bias;
+		bool m_use_rans;
+		vrange_encode_stats* m_pStats;
+		uint32_vec m_prev_scaled_cum_prob;
+		uint32_vec m_sym_freq, m_scaled_cum_prob, m_sym_costs;
+		uint8_t m_code_lens[256];
+		uint8_vec m_enc_buf;
+		vrange_encoder_context m_range_enc_ctx;
+	};
+
+	// Decodes blocks created by vrange_block_encoder.
+	class vrange_block_decoder
+	{
+	public:
+		vrange_block_decoder() { reset(); m_pStats = NULL; }
+
+		void reset() { m_has_model = false; m_has_dec_table = false; }
+
+		// Optional stats accumulated by every following block: table creation and the range decoder's phases (see vrange_decode_stats)
+		void set_stats(vrange_decode_stats* pStats) { m_pStats = pStats; }
+
+		// Returns the original size of the block at pSrc, or false if the header is truncated or invalid.
+		static bool peek_block_size(const uint8_t* pSrc, const uint8_t* pSrc_end, uint32_t& orig_size);
+
+		// Decodes the block at pSrc to pDst, which must have room for at least dst_avail bytes. pSrc is advanced past the block.
+		bool decode_block(const uint8_t*& pSrc, const uint8_t* pSrc_end, uint8_t* pDst, size_t dst_avail, uint32_t& decoded_size);
+
+	private:
+		bool m_has_model;
+		vrange_decode_stats* m_pStats;
+		bool m_has_dec_table;
+		uint32_vec m_scaled_cum_prob;
+		uint32_vec m_dec_table;
+		vrange_small_table m_small_table;
+		uint8_t m_code_lens[256];
+		uint16_vec m_huff_dec_table;
+	};
+
+	// Splits pData with vrange_split_blocks() and appends the encoded blocks to comp_data.
+	// pStats is optional, see vrange_block_encoder::set_stats().
+	bool vrange_encode_blocks(const uint8_t* pData, size_t data_size, uint8_vec& comp_data, const vrange_block_params& params, vrange_encode_stats* pStats = NULL);
+
+	// Decodes a sequence of blocks created by vrange_encode_blocks(). Fails unless exactly dst_size bytes are decoded. pStats is optional, see vrange_block_decoder::set_stats().
+	bool vrange_decode_blocks(const uint8_t* pComp, size_t comp_size, uint8_t* pDst, size_t dst_size, vrange_decode_stats* pStats = NULL);
+
+} // namespace sserangecoder
@@ -0,0 +1,554 @@
+// sserangebwt.cpp
+// BWT + MTF + zero run transform in front of the interleaved range coder, Richard Geldreich, Jr., public domain (see full text at unlicense.org)
+#include "sserangebwt.h"
+#include <algorithm>
+
+namespace sserangecoder
+{
+	// Zero run coding: runs of MTF index 0 are written in bijective base 2 using cZeroRunA/cZeroRunB, MTF indices 1-253 are written as index+1,
+	// and indices 254-255 are written as cZeroRunEscape followed by the index.
+	const uint32_t cZeroRunA = 0, cZeroRunB = 1, cZeroRunEscape = 255;
+
+	// Each transformed block starts with: original size (4 bytes), # of streams (1 byte), primary index (4 bytes),
+	// the stream rows (4 bytes each, # of streams - 1), zero run coded size (4 bytes), range coded size (4 bytes).
+	const uint32_t cBWTBlockHeaderSize = 4 + 1 + 4 + 4 + 4;
+
+	// ---- SA-IS suffix array construction (Nong, Zhang & Chan, "Two Efficient Algorithms for Linear Time Suffix Array Construction")
+
+	static inline bool sais_is_lms(const uint8_t* t, int32_t i)
+	{
+		return (i > 0) && (t[i]) && (!t[i - 1]);
+	}
+
+	static void sais_get_buckets(const int32_t* s, int32_t* bkt, int32_t n, int32_t K, bool end)
+	{
+		memset(bkt, 0, K * sizeof(int32_t));
+
+		for (int32_t i = 0; i < n; i++)
+			bkt[s[i]]++;
+
+		int32_t sum = 0;
+		for (int32_t i = 0; i < K; i++)
+		{
+			sum += bkt[i];
+			bkt[i] = end ? sum : (sum - bkt[i]);
+		}
+	}
+
+	static void sais_induce_l(const uint8_t* t, int32_t* SA, const int32_t* s, int32_t* bkt, int32_t n, int32_t K)
+	{
+		sais_get_buckets(s, bkt, n, K, false);
+
+		for (int32_t i = 0; i < n; i++)
+		{
+			const int32_t j = SA[i] - 1;
+			if ((j >= 0) && (!t[j]))
+				SA[bkt[s[j]]++] = j;
+		}
+	}
+
+	static void sais_induce_s(const uint8_t* t, int32_t* SA, const int32_t* s, int32_t* bkt, int32_t n, int32_t K)
+	{
+		sais_get_buckets(s, bkt, n, K, true);
+
+		for (int32_t i = n - 1; i >= 0; i--)
+		{
+			const int32_t j = SA[i] - 1;
+			if ((j >= 0) && (t[j]))
+				SA[--bkt[s[j]]] = j;
+		}
+	}
+
+	// s must end with a unique sentinel which is smaller than every other symbol. Symbols are in [0,K).
+	static void sais_main(const int32_t* s, int32_t* SA, int32_t n, int32_t K)
+	{
+		// Classify each suffix as S-type (1) or L-type (0)
+		uint8_vec t(n);
+		t[n - 1] = 1;
+		for (int32_t i = n - 2; i >= 0; i--)
+			t[i] = ((s[i] < s[i + 1]) || ((s[i] == s[i + 1]) && (t[i + 1]))) ? 1 : 0;
+
+		std::vector<int32_t> bkt(K);
+
+		// Stage 1: sort the LMS substrings by inducing from their bucket ends
+		sais_get_buckets(s, &bkt[0], n, K, true);
+
+		for (int32_t i = 0; i < n; i++)
+			SA[i] = -1;
+
+		for (int32_t i = 1; i < n; i++)
+			if (sais_is_lms(&t[0], i))
+				SA[--bkt[s[i]]] = i;
+
+		sais_induce_l(&t[0], SA, s, &bkt[0], n, K);
+		sais_induce_s(&t[0], SA, s, &bkt[0], n, K);
+
+		// Compact the sorted LMS substrings into the first n1 entries
+		int32_t n1 = 0;
+		for (int32_t i = 0; i < n; i++)
+			if (sais_is_lms(&t[0], SA[i]))
+				SA[n1++] = SA[i];
+
+		for (int32_t i = n1; i < n; i++)
+			SA[i] = -1;
+
+		// Name the LMS substrings
+		int32_t name = 0, prev = -1;
+		for (int32_t i = 0; i < n1; i++)
+		{
+			const int32_t pos = SA[i];
+
+			bool diff = false;
+			for (int32_t d = 0; d < n; d++)
+			{
+				if ((prev == -1) || (s[pos + d] != s[prev + d]) || (t[pos + d] != t[prev + d]))
+				{
+					diff = true;
+					break;
+				}
+				else if ((d > 0) && ((sais_is_lms(&t[0], pos + d)) || (sais_is_lms(&t[0], prev + d))))
+					break;
+			}
+
+			if (diff)
+			{
+				name++;
+				prev = pos;
+			}
+
+			SA[n1 + (pos >> 1)] = name - 1;
+		}
+
+		for (int32_t i = n - 1, j = n - 1; i >= n1; i--)
+			if (SA[i] >= 0)
+				SA[j--] = SA[i];
+
+		// Stage 2: sort the reduced string, recursing if the names aren't unique yet
+		int32_t* SA1 = SA;
+		int32_t* s1 = SA + n - n1;
+
+		if (name < n1)
+			sais_main(s1, SA1, n1, name);
+		else
+		{
+			for (int32_t i = 0; i < n1; i++)
+				SA1[s1[i]] = i;
+		}
+
+		// Stage 3: induce the final suffix array from the sorted LMS suffixes
+		sais_get_buckets(s, &bkt[0], n, K, true);
+
+		for (int32_t i = 1, j = 0; i < n; i++)
+			if (sais_is_lms(&t[0], i))
+				s1[j++] = i;
+
+		for (int32_t i = 0; i < n1; i++)
+			SA1[i] = s1[SA1[i]];
+
+		for (int32_t i = n1; i < n; i++)
+			SA[i] = -1;
+
+		for (int32_t i = n1 - 1; i >= 0; i--)
+		{
+			const int32_t j = SA[i];
+			SA[i] = -1;
+			SA[--bkt[s[j]]] = j;
+		}
+
+		sais_induce_l(&t[0], SA, s, &bkt[0], n, K);
+		sais_induce_s(&t[0], SA, s, &bkt[0], n, K);
+	}
+
+	bool vrange_bwt_suffix_array(const uint8_t* pData, uint32_t data_size, std::vector<int32_t>& SA)
+	{
+		if (data_size > cBWTMaxBlockSize)
+			return false;
+
+		// Shift the symbols up by 1 to make room for the sentinel
+		std::vector<int32_t> s(data_size + 1);
+		for (uint32_t i = 0; i < data_size; i++)
+			s[i] = pData[i] + 1;
+		s[data_size] = 0;
+
+		SA.resize(data_size + 1);
+		sais_main(&s[0], &SA[0], (int32_t)(data_size + 1), 257);
+
+		assert(SA[0] == (int32_t)data_size);
+		return true;
+	}
+
+	bool vrange_bwt_forward(const uint8_t* pData, uint32_t data_size, uint8_t* pDst, uint32_t& primary_index, uint32_t num_streams, uint32_t* pStream_rows)
+	{
+		if ((!data_size) || (!num_streams) || (num_streams > std::min(cBWTMaxStreams, data_size)))
+			return false;
+
+		std::vector<int32_t> SA;
+		if (!vrange_bwt_suffix_array(pData, data_size, SA))
+			return false;
+
+		const uint32_t stream_len = data_size / num_streams;
+
+		primary_index = 0;
+
+		uint8_t* pOut = pDst;
+		for (uint32_t i = 0; i <= data_size; i++)
+		{
+			const uint32_t suffix = (uint32_t)SA[i];
+
+			if (!suffix)
+			{
+				primary_index = i;
+				continue;
+			}
+
+			*pOut++ = pData[suffix - 1];
+
+			// Remember the rows of the suffixes which start right after the end of each stream (the last stream ends at the sentinel)
+			if ((suffix % stream_len) == 0)
+			{
+				const uint32_t stream_index = suffix / stream_len - 1;
+				if (stream_index < (num_streams - 1))
+					pStream_rows[stream_index] = i;
+			}
+		}
+
+		assert((uint32_t)(pOut - pDst) == data_size);
+		return true;
+	}
+
+	// Walks the LF mapping of NUM_STREAMS chains at once. Each table entry is (next row << 8) | symbol.
+	template<uint32_t NUM_STREAMS>
+	static void bwt_inverse_chains(const uint32_t* pTab, uint32_t* pRows, uint8_t** ppOut, uint32_t steps)
+	{
+		uint32_t rows[NUM_STREAMS];
+		uint8_t* pOut[NUM_STREAMS];
+
+		for (uint32_t k = 0; k < NUM_STREAMS; k++)
+		{
+			rows[k] = pRows[k];
+			pOut[k] = ppOut[k];
+		}
+
+		for (uint32_t i = 0; i < steps; i++)
+		{
+			for (uint32_t k = 0; k < NUM_STREAMS; k++)
+			{
+				const uint32_t v = pTab[rows[k]];
+				*--pOut[k] = (uint8_t)v;
+				rows[k] = v >> 8;
+			}
+		}
+
+		for (uint32_t k = 0; k < NUM_STREAMS; k++)
+		{
+			pRows[k] = rows[k];
+			ppOut[k] = pOut[k];
+		}
+	}
+
+	bool vrange_bwt_inverse(const uint8_t* pBWT, uint32_t data_size, uint8_t* pDst, uint32_t primary_index, uint32_t num_streams, const uint32_t* pStream_rows, uint32_vec& temp)
+	{
+		if ((!data_size) || (data_size > cBWTMaxBlockSize) || (!num_streams) || (num_streams > std::min(cBWTMaxStreams, data_size)))
+			return false;
+
+		const uint32_t num_rows = data_size + 1;
+		if (primary_index >= num_rows)
+			return false;
+
+		for (uint32_t k = 0; k < (num_streams - 1); k++)
+			if ((pStream_rows[k] >= num_rows) || (pStream_rows[k] == primary_index))
+				return false;
+
+		uint32_t next_row[256];
+		clear_obj(next_row);
+
+		for (uint32_t i = 0; i < data_size; i++)
+			next_row[pBWT[i]]++;
+
+		// Row 0 is the sentinel's suffix
+		uint32_t total = 1;
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			const uint32_t n = next_row[i];
+			next_row[i] = total;
+			total += n;
+		}
+
+		temp.resize(num_rows);
+		uint32_t* pTab = &temp[0];
+
+		// The primary row holds the sentinel, which is never stored or visited
+		for (uint32_t r = 0; r < primary_index; r++)
+		{
+			const uint32_t c = pBWT[r];
+			pTab[r] = (next_row[c]++ << 8) | c;
+		}
+
+		pTab[primary_index] = 0;
+
+		for (uint32_t r = primary_index + 1; r < num_rows; r++)
+		{
+			const uint32_t c = pBWT[r - 1];
+			pTab[r] = (next_row[c]++ << 8) | c;
+		}
+
+		// Decode each stream backwards from its end, the last stream is longer if data_size isn't a multiple of num_streams
+		const uint32_t stream_len = data_size / num_streams;
+
+		uint32_t rows[cBWTMaxStreams];
+		uint8_t* pOut[cBWTMaxStreams];
+
+		for (uint32_t k = 0; k < num_streams; k++)
+		{
+			const bool last_stream = (k == (num_streams - 1));
+			rows[k] = last_stream ? 0 : pStream_rows[k];
+			pOut[k] = pDst + (last_stream ? data_size : ((k + 1) * stream_len));
+		}
+
+		const uint32_t extra_len = data_size - stream_len * num_streams;
+		bwt_inverse_chains<1>(pTab, &rows[num_streams - 1], &pOut[num_streams - 1], extra_len);
+
+		if (num_streams == cBWTMaxStreams)
+			bwt_inverse_chains<cBWTMaxStreams>(pTab, rows, pOut, stream_len);
+		else
+		{
+			for (uint32_t k = 0; k < num_streams; k++)
+				bwt_inverse_chains<1>(pTab, &rows[k], &pOut[k], stream_len);
+		}
+
+		return true;
+	}
+
+	static void mtf_zero_run_encode(const uint8_t* pSrc, uint32_t src_size, uint8_vec& dst)
+	{
+		uint8_t order[256];
+		for (uint32_t i = 0; i < 256; i++)
+			order[i] = (uint8_t)i;
+
+		dst.resize(0);
+		dst.reserve(src_size + src_size / 8);
+
+		uint32_t run_len = 0;
+
+		for (uint32_t i = 0; i <= src_size; i++)
+		{
+			uint32_t index = 0;
+
+			if (i < src_size)
+			{
+				const uint8_t c = pSrc[i];
+				while (order[index] != c)
+					index++;
+
+				if (!index)
+				{
+					run_len++;
+					continue;
+				}
+
+				memmove(order + 1, order, index);
+				order[0] = c;
+			}
+
+			// Flush the pending zero run as bijective base 2 digits
+			while (run_len)
+			{
+				const uint32_t digit = (run_len - 1) & 1;
+				dst.push_back((uint8_t)(digit ? cZeroRunB : cZeroRunA));
+				run_len = (run_len - 1 - digit) >> 1;
+			}
+
+			if (i == src_size)
+				break;
+
+			if (index < 254)
+				dst.push_back((uint8_t)(index + 1));
+			else
+			{
+				dst.push_back((uint8_t)cZeroRunEscape);
+				dst.push_back((uint8_t)index);
+			}
+		}
+	}
+
+	static bool mtf_zero_run_decode(const uint8_t* pSrc, size_t src_size, uint8_t* pDst, uint32_t dst_size)
+	{
+		uint8_t order[256];
+		for (uint32_t i = 0; i < 256; i++)
+			order[i] = (uint8_t)i;
+
+		const __m128i iota = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+		const uint8_t* pSrc_end = pSrc + src_size;
+		uint8_t* pOut = pDst;
+		uint8_t* pOut_end = pDst + dst_size;
+
+		while (pSrc < pSrc_end)
+		{
+			uint32_t sym = *pSrc++;
+
+			if (sym <= cZeroRunB)
+			{
+				uint64_t run_len = 0, weight = 1;
+				for (; ; )
+				{
+					run_len += (sym + 1) * weight;
+					weight <<= 1;
+
+					if ((run_len > (uint64_t)(pOut_end - pOut)) || (pSrc == pSrc_end) || (*pSrc > cZeroRunB))
+						break;
+
+					sym = *pSrc++;
+				}
+
+				if (run_len > (uint64_t)(pOut_end - pOut))
+					return false;
+
+				memset(pOut, order[0], (size_t)run_len);
+				pOut += run_len;
+				continue;
+			}
+
+			uint32_t index = sym - 1;
+			if (sym == cZeroRunEscape)
+			{
+				if (pSrc == pSrc_end)
+					return false;
+				index = *pSrc++;
+			}
+
+			if (pOut == pOut_end)
+				return false;
+
+			const uint8_t c = order[index];
+
+			if (index < 16)
+			{
+				// Shift the first index bytes up by one with a byte shift + blend, instead of a memmove call
+				const __m128i v = _mm_loadu_si128((const __m128i*)order);
+				const __m128i shifted = _mm_or_si128(_mm_slli_si128(v, 1), _mm_cvtsi32_si128(c));
+				const __m128i mask = _mm_cmpgt_epi8(_mm_set1_epi8((char)(index + 1)), iota);
+				_mm_storeu_si128((__m128i*)order, _mm_blendv_epi8(v, shifted, mask));
+			}
+			else
+			{
+				memmove(order + 1, order, index);
+				order[0] = c;
+			}
+
+			*pOut++ = c;
+		}
+
+		return pOut == pOut_end;
+	}
+
+	static inline void write_le32(uint8_vec& buf, uint32_t v)
+	{
+		for (uint32_t i = 0; i < 4; i++)
+			buf.push_back((uint8_t)(v >> (i * 8)));
+	}
+
+	static inline uint32_t read_le32(const uint8_t*& pSrc)
+	{
+		const uint32_t v = pSrc[0] | (pSrc[1] << 8) | (pSrc[2] << 16) | ((uint32_t)pSrc[3] << 24);
+		pSrc += 4;
+		return v;
+	}
+
+	bool vrange_bwt_compress(const uint8_t* pData, size_t data_size, uint8_vec& comp_data, const vrange_bwt_params& params)
+	{
+		const uint32_t block_size = clamp<uint32_t>(params.m_block_size, 1, cBWTMaxBlockSize);
+
+		uint8_vec bwt_buf, rle_buf;
+
+		for (size_t ofs = 0; ofs < data_size; ofs += block_size)
+		{
+			const uint32_t n = (uint32_t)std::min<size_t>(block_size, data_size - ofs);
+			const uint32_t num_streams = std::min(cBWTMaxStreams, n);
+
+			uint32_t primary_index, stream_rows[cBWTMaxStreams];
+
+			bwt_buf.resize(n);
+			if (!vrange_bwt_forward(pData + ofs, n, &bwt_buf[0], primary_index, num_streams, stream_rows))
+				return false;
+
+			mtf_zero_run_encode(&bwt_buf[0], n, rle_buf);
+
+			write_le32(comp_data, n);
+			comp_data.push_back((uint8_t)num_streams);
+			write_le32(comp_data, primary_index);
+
+			for (uint32_t k = 0; k < (num_streams - 1); k++)
+				write_le32(comp_data, stream_rows[k]);
+
+			write_le32(comp_data, (uint32_t)rle_buf.size());
+
+			const size_t coded_size_ofs = comp_data.size();
+			write_le32(comp_data, 0);
+
+			if (!vrange_encode_blocks(&rle_buf[0], rle_buf.size(), comp_data, params.m_block_params))
+				return false;
+
+			const uint32_t coded_size = (uint32_t)(comp_data.size() - coded_size_ofs - 4);
+			for (uint32_t i = 0; i < 4; i++)
+				comp_data[coded_size_ofs + i] = (uint8_t)(coded_size >> (i * 8));
+		}
+
+		return true;
+	}
+
+	bool vrange_bwt_decompress(const uint8_t* pComp, size_t comp_size, uint8_t* pDst, size_t dst_size)
+	{
+		const uint8_t* pSrc = pComp;
+		const uint8_t* pSrc_end = pComp + comp_size;
+
+		uint8_vec bwt_buf, rle_buf;
+		uint32_vec temp;
+
+		size_t dst_ofs = 0;
+		while (dst_ofs < dst_size)
+		{
+			if ((size_t)(pSrc_end - pSrc) < cBWTBlockHeaderSize)
+				return false;
+
+			const uint32_t n = read_le32(pSrc);
+			const uint32_t num_streams = *pSrc++;
+			const uint32_t primary_index = read_le32(pSrc);
+
+			if ((!n) || (n > cBWTMaxBlockSize) || (n > (dst_size - dst_ofs)) || (!num_streams) || (num_streams > std::min(cBWTMaxStreams, n)))
+				return false;
+
+			if ((size_t)(pSrc_end - pSrc) < ((num_streams - 1) * 4 + 8))
+				return false;
+
+			uint32_t stream_rows[cBWTMaxStreams];
+			for (uint32_t k = 0; k < (num_streams - 1); k++)
+				stream_rows[k] = read_le32(pSrc);
+
+			const uint32_t rle_size = read_le32(pSrc);
+			const uint32_t coded_size = read_le32(pSrc);
+
+			// Every symbol takes at most 2 bytes (an escaped MTF index)
+			if ((!rle_size) || (rle_size > n * 2) || (coded_size > (size_t)(pSrc_end - pSrc)))
+				return false;
+
+			rle_buf.resize(rle_size);
+			if (!vrange_decode_blocks(pSrc, coded_size, &rle_buf[0], rle_size))
+				return false;
+
+			pSrc += coded_size;
+
+			bwt_buf.resize(n);
+			if (!mtf_zero_run_decode(&rle_buf[0], rle_size, &bwt_buf[0], n))
+				return false;
+
+			if (!vrange_bwt_inverse(&bwt_buf[0], n, pDst + dst_ofs, primary_index, num_streams, stream_rows, temp))
+				return false;
+
+			dst_ofs += n;
+		}
+
+		return pSrc == pSrc_end;
+	}
+
+} // namespace sserangecoder
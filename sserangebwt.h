@@ -0,0 +1,46 @@
+// sserangebwt.h
+// BWT + MTF + zero run transform in front of the interleaved range coder, Richard Geldreich, Jr., public domain (see full text at unlicense.org)
+#pragma once
+#include "sserangeblocks.h"
+
+namespace sserangecoder
+{
+	// Row indices are packed into 24 bits in the inverse BWT table
+	const uint32_t cBWTMaxBlockSize = (1U << 24) - 2;
+
+	// Each block is inverted as this many independent chains, interleaved to hide the latency of the random accesses
+	const uint32_t cBWTMaxStreams = 8;
+
+	struct vrange_bwt_params
+	{
+		vrange_bwt_params() { clear(); }
+
+		void clear()
+		{
+			m_block_size = 4 * 1024 * 1024;
+		}
+
+		// BWT block size (max cBWTMaxBlockSize). Larger blocks compress better, encoding needs ~9 bytes of memory per input byte.
+		uint32_t m_block_size;
+
+		// Block splitting params used to range code each transformed block
+		vrange_block_params m_block_params;
+	};
+
+	// Computes the suffix array of pData using SA-IS. The suffix array has data_size + 1 entries: SA[0] is the empty suffix (the implicit sentinel).
+	bool vrange_bwt_suffix_array(const uint8_t* pData, uint32_t data_size, std::vector<int32_t>& SA);
+
+	// Burrows-Wheeler transform. Writes data_size bytes to pDst and returns the row of the sentinel in primary_index.
+	// pStream_rows receives num_streams - 1 rows needed by the multi-stream inverse (the row of the suffix that ends each stream, except the last).
+	bool vrange_bwt_forward(const uint8_t* pData, uint32_t data_size, uint8_t* pDst, uint32_t& primary_index, uint32_t num_streams, uint32_t* pStream_rows);
+
+	// Inverts vrange_bwt_forward() using num_streams interleaved chains. temp is resized to data_size + 1 entries.
+	bool vrange_bwt_inverse(const uint8_t* pBWT, uint32_t data_size, uint8_t* pDst, uint32_t primary_index, uint32_t num_streams, const uint32_t* pStream_rows, uint32_vec& temp);
+
+	// Compresses pData with BWT + MTF + zero run coding, then range codes the result with per-block models. The output is appended to comp_data.
+	bool vrange_bwt_compress(const uint8_t* pData, size_t data_size, uint8_vec& comp_data, const vrange_bwt_params& params);
+
+	// Decompresses data created by vrange_bwt_compress(). Fails unless exactly dst_size bytes are decoded.
+	bool vrange_bwt_decompress(const uint8_t* pComp, size_t comp_size, uint8_t* pDst, size_t dst_size);
+
+} // namespace sserangecoder
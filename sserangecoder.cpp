@@ -1,6 +1,8 @@
 // sserangecoder.cpp
 // SSE 4.1 Interleaved Range Coding example with an 8-bit alphabet, Richard Geldreich, Jr., public domain (see full text at unlicense.org)
 #include "sserangecoder.h"
+#include <algorithm>
+#include <thread>
 
 #ifdef _MSC_VER
 #pragma warning(disable:4310) // warning C4310: cast truncates constant value
@@ -8,155 +10,250 @@
 
 namespace sserangecoder
 {
-	void vrange_init()
+	// The decoder lookup tables are built from constexpr functions of the table index (C++11 constexpr functions are limited to a single return statement,
+	// hence the recursion), then expanded to initializers for every index with the SSER_REP macros.
+	
+	// Bytes read by vrange_normalize() for lane j of lane mask i
+	static constexpr uint32_t lane_bytes(uint32_t i, uint32_t j)
 	{
-		g_byte_shuffle_mask = _mm_set_epi8((char)0x80, (char)0x80, (char)0x80, (char)0x80,
-			(char)0x80, (char)0x80, (char)0x80, (char)0x80,
-			(char)0x80, (char)0x80, (char)0x80, (char)0x80,
-			12, 8, 4, 0);
+		return ((i >> j) & 0x10) ? 2 : ((i >> j) & 1);
+	}
 
-		for (uint32_t i = 0; i < 256; i++)
-		{
-			uint32_t num_bytes = 0;
+	// Bytes read by vrange_normalize() for lanes [0, num_lanes) of lane mask i
+	static constexpr uint32_t lanes_bytes(uint32_t i, uint32_t num_lanes)
+	{
+		return num_lanes ? (lane_bytes(i, num_lanes - 1) + lanes_bytes(i, num_lanes - 1)) : 0;
+	}
 
-			for (uint32_t j = 0; j < 4; j++)
-			{
-				if ((i >> j) & 0x10)
-					num_bytes += 2;
-				else if ((i >> j) & 1)
-					num_bytes++;
-			}
+	// Shifts each lane left by the number of bytes it reads, shifting in 0's
+	static constexpr uint8_t shift_shuf_byte(uint32_t i, uint32_t k)
+	{
+		return (uint8_t)(((k & 3) < lane_bytes(i, k >> 2)) ? 0x80 : (k - lane_bytes(i, k >> 2)));
+	}
 
-			g_num_bytes[i] = num_bytes;
+	// Moves each lane's bytes from the source stream (big endian) into the low bytes of the lane
+	static constexpr uint8_t dist_shuf_byte(uint32_t i, uint32_t k)
+	{
+		return (uint8_t)(((k & 3) >= lane_bytes(i, k >> 2)) ? 0x80 : (lanes_bytes(i, k >> 2) + lane_bytes(i, k >> 2) - 1 - (k & 3)));
+	}
 
-			uint8_t x[16];
+	// 16-bit words read by vrans_normalize() for lanes [0, num_lanes) of lane mask i
+	static constexpr uint32_t rans_lanes_words(uint32_t i, uint32_t num_lanes)
+	{
+		return num_lanes ? (((i >> (num_lanes - 1)) & 1) + rans_lanes_words(i, num_lanes - 1)) : 0;
+	}
 
-			for (uint32_t j = 0; j < 4; j++)
-			{
-				if ((i >> j) & 0x10)
-				{
-					x[j * 4 + 0] = 0x80;
-					x[j * 4 + 1] = 0x80;
-					x[j * 4 + 2] = (uint8_t)(j * 4 + 0);
-					x[j * 4 + 3] = (uint8_t)(j * 4 + 1);
-				}
-				else if ((i >> j) & 1)
-				{
-					x[j * 4 + 0] = 0x80;
-					x[j * 4 + 1] = (uint8_t)(j * 4 + 0);
-					x[j * 4 + 2] = (uint8_t)(j * 4 + 1);
-					x[j * 4 + 3] = (uint8_t)(j * 4 + 2);
-				}
-				else
-				{
-					x[j * 4 + 0] = (uint8_t)(j * 4 + 0);
-					x[j * 4 + 1] = (uint8_t)(j * 4 + 1);
-					x[j * 4 + 2] = (uint8_t)(j * 4 + 2);
-					x[j * 4 + 3] = (uint8_t)(j * 4 + 3);
-				}
-			}
-			g_shift_shuf[i] = _mm_loadu_si128((__m128i *)&x);
+	// Moves each lane's 16-bit word (little endian) into the low half of the lane
+	static constexpr uint8_t rans_word_shuf_byte(uint32_t i, uint32_t k)
+	{
+		return (uint8_t)((((i >> (k >> 2)) & 1) && ((k & 3) < 2)) ? (rans_lanes_words(i, k >> 2) * 2 + (k & 3)) : 0x80);
+	}
 
-			uint32_t src_ofs = 0;
-			for (uint32_t j = 0; j < 4; j++)
-			{
-				if ((i >> j) & 0x10)
-				{
-					x[j * 4 + 0] = (uint8_t)(src_ofs + 1);
-					x[j * 4 + 1] = (uint8_t)(src_ofs);
-					x[j * 4 + 2] = 0x80;
-					x[j * 4 + 3] = 0x80;
-					src_ofs += 2;
-				}
-				else if ((i >> j) & 1)
-				{
-					x[j * 4 + 0] = (uint8_t)(src_ofs++);
-					x[j * 4 + 1] = 0x80;
-					x[j * 4 + 2] = 0x80;
-					x[j * 4 + 3] = 0x80;
-				}
-				else
-				{
-					x[j * 4 + 0] = 0x80;
-					x[j * 4 + 1] = 0x80;
-					x[j * 4 + 2] = 0x80;
-					x[j * 4 + 3] = 0x80;
-				}
-			}
+#define SSER_SHUF_ROW(f, i) { f(i, 0), f(i, 1), f(i, 2), f(i, 3), f(i, 4), f(i, 5), f(i, 6), f(i, 7), f(i, 8), f(i, 9), f(i, 10), f(i, 11), f(i, 12), f(i, 13), f(i, 14), f(i, 15) }
+#define SSER_REP4(m, i) m(i), m((i) + 1), m((i) + 2), m((i) + 3)
+#define SSER_REP16(m, i) SSER_REP4(m, i), SSER_REP4(m, (i) + 4), SSER_REP4(m, (i) + 8), SSER_REP4(m, (i) + 12)
+#define SSER_REP64(m, i) SSER_REP16(m, i), SSER_REP16(m, (i) + 16), SSER_REP16(m, (i) + 32), SSER_REP16(m, (i) + 48)
+#define SSER_REP256(m, i) SSER_REP64(m, i), SSER_REP64(m, (i) + 64), SSER_REP64(m, (i) + 128), SSER_REP64(m, (i) + 192)
+
+#define SSER_NUM_BYTES(i) (uint8_t)lanes_bytes(i, 4)
+#define SSER_SHIFT_SHUF(i) SSER_SHUF_ROW(shift_shuf_byte, i)
+#define SSER_DIST_SHUF(i) SSER_SHUF_ROW(dist_shuf_byte, i)
+#define SSER_RANS_NUM_BYTES(i) (uint8_t)(rans_lanes_words(i, 4) * 2)
+#define SSER_RANS_WORD_SHUF(i) SSER_SHUF_ROW(rans_word_shuf_byte, i)
+
+	alignas(16) const uint8_t g_num_bytes[256] = { SSER_REP256(SSER_NUM_BYTES, 0) };
+	alignas(16) const uint8_t g_shift_shuf[256][16] = { SSER_REP256(SSER_SHIFT_SHUF, 0) };
+	alignas(16) const uint8_t g_dist_shuf[256][16] = { SSER_REP256(SSER_DIST_SHUF, 0) };
+	alignas(16) const uint8_t g_byte_shuffle_mask[16] = { 0, 4, 8, 12, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 };
+	alignas(16) const uint8_t g_rans_num_bytes[16] = { SSER_REP16(SSER_RANS_NUM_BYTES, 0) };
+	alignas(16) const uint8_t g_rans_word_shuf[16][16] = { SSER_REP16(SSER_RANS_WORD_SHUF, 0) };
+
+#undef SSER_SHUF_ROW
+#undef SSER_REP4
+#undef SSER_REP16
+#undef SSER_REP64
+#undef SSER_REP256
+#undef SSER_NUM_BYTES
+#undef SSER_SHIFT_SHUF
+#undef SSER_DIST_SHUF
+#undef SSER_RANS_NUM_BYTES
+#undef SSER_RANS_WORD_SHUF
+
+	static_assert(lanes_bytes(0xFF, 4) == 8, "vrange_normalize() reads at most 8 bytes");
+	static_assert(dist_shuf_byte(0x11, 0) == 1, "2 byte lanes are big endian");
 
-			g_dist_shuf[i] = _mm_loadu_si128((__m128i *)&x);
-		}
+	void vrange_init()
+	{
 	}
 
-	void range_enc::flush()
+	// 4 sub-histograms to avoid store to load forwarding stalls on runs of the same byte
+	static void accumulate_sub_hists(const uint8_t* pData, size_t data_size, uint32_t hist[4][256])
 	{
-		uint32_t orig_base = m_arith_base;
-
-		if (m_arith_length > 2 * cRangeCodecMinLen)
-		{
-			m_arith_base = (m_arith_base + cRangeCodecMinLen) & cRangeCodecMaxLen;
-			m_arith_length = (cRangeCodecMinLen >> 1);
-		}
-		else
+		size_t i = 0;
+		for (; (i + 4) <= data_size; i += 4)
 		{
-			m_arith_base = (m_arith_base + (cRangeCodecMinLen >> 1)) & cRangeCodecMaxLen;
-			m_arith_length = (cRangeCodecMinLen >> 9);
+			uint32_t v;
+			memcpy(&v, pData + i, sizeof(v));
+
+			hist[0][v & 0xFF]++;
+			hist[1][(v >> 8) & 0xFF]++;
+			hist[2][(v >> 16) & 0xFF]++;
+			hist[3][v >> 24]++;
 		}
 
-		if (orig_base > m_arith_base)
-			propagate_carry();
+		for (; i < data_size; i++)
+			hist[0][pData[i]]++;
+	}
 
-		renorm_enc_interval();
+	void vrange_histogram(const uint8_t* pData, size_t data_size, uint32_t* pHist)
+	{
+		uint32_t hist[4][256];
+		clear_obj(hist);
 
-		while (m_buf.size() < 3)
-			m_buf.push_back(0);
+		accumulate_sub_hists(pData, data_size, hist);
 
-		for (uint32_t i = 0; i < 2; i++)
-			m_buf.push_back(0);
+		for (uint32_t j = 0; j < 256; j++)
+			pHist[j] += hist[0][j] + hist[1][j] + hist[2][j] + hist[3][j];
+	}
+
+	void vrange_histogram(const vrange_const_iovec* pSegs, uint32_t num_segs, uint32_t* pHist)
+	{
+		uint32_t hist[4][256];
+		clear_obj(hist);
+
+		for (uint32_t i = 0; i < num_segs; i++)
+			accumulate_sub_hists(pSegs[i].m_pData, pSegs[i].m_size, hist);
+
+		for (uint32_t j = 0; j < 256; j++)
+			pHist[j] += hist[0][j] + hist[1][j] + hist[2][j] + hist[3][j];
 	}
 
 	// Create lookup table for the vectorized range decoder
 	void vrange_init_table(uint32_t num_syms, const uint32_vec& scaled_cum_prob, uint32_vec& table)
 	{
-		assert(*(const uint32_t*)&g_byte_shuffle_mask != 0);
-
 		table.resize(cRangeCodecProbScale);
 		assert(scaled_cum_prob.size() == (num_syms + 1));
 
+		vrange_init_table(num_syms, &scaled_cum_prob[0], &table[0]);
+	}
+
+	void vrange_init_table(uint32_t num_syms, const uint32_t* pScaled_cum_prob, uint32_t* pTable)
+	{
 		for (uint32_t sym_index = 0; sym_index < num_syms; sym_index++)
 		{
-			const uint32_t n = scaled_cum_prob[sym_index + 1] - scaled_cum_prob[sym_index];
+			const uint32_t n = pScaled_cum_prob[sym_index + 1] - pScaled_cum_prob[sym_index];
 			if (!n)
 				continue;
 
-			assert(scaled_cum_prob[sym_index] < cRangeCodecProbScale);
-			assert((scaled_cum_prob[sym_index + 1] - scaled_cum_prob[sym_index]) < cRangeCodecProbScale);
+			assert(pScaled_cum_prob[sym_index] < cRangeCodecProbScale);
+			assert((pScaled_cum_prob[sym_index + 1] - pScaled_cum_prob[sym_index]) < cRangeCodecProbScale);
 
-			const uint32_t k = sym_index | (scaled_cum_prob[sym_index] << 8) | ((scaled_cum_prob[sym_index + 1] - scaled_cum_prob[sym_index]) << 20);
+			const uint32_t k = sym_index | (pScaled_cum_prob[sym_index] << 8) | ((pScaled_cum_prob[sym_index + 1] - pScaled_cum_prob[sym_index]) << 20);
 
-			uint32_t* pDst = &table[scaled_cum_prob[sym_index]];
+			uint32_t* pDst = &pTable[pScaled_cum_prob[sym_index]];
 			for (uint32_t j = 0; j < n; j++)
 				*pDst++ = k;
 		}
 	}
 
+	// Returns log2(x) in 8.24 fixed point. Only integer math is used, so the results (and the quantized frequencies derived from them) are bit exact on all platforms.
+	// This matters because the decoder must be able to recreate the encoder's quantized frequencies from the same input frequencies.
+	static uint32_t fixed_log2(uint32_t x)
+	{
+		assert(x);
+
+		uint32_t int_part = 0;
+		while ((x >> int_part) > 1)
+			int_part++;
+
+		// Normalize the mantissa to [1,2) in 2.30 fixed point, then extract fraction bits by repeated squaring
+		uint64_t m = ((uint64_t)x << 30) >> int_part;
+		uint32_t frac = 0;
+
+		for (uint32_t i = 0; i < 24; i++)
+		{
+			m = (m * m) >> 30;
+			frac <<= 1;
+
+			if (m >= (2ULL << 30))
+			{
+				m >>= 1;
+				frac |= 1;
+			}
+		}
+
+		return (int_part << 24) | frac;
+	}
+
+	// Table of fixed_log2(x) for x in [1, cRangeCodecProbScale], so scaling frequencies only costs table lookups
+	struct fixed_log2_table
+	{
+		fixed_log2_table()
+		{
+			m_tab[0] = 0;
+			for (uint32_t i = 1; i <= cRangeCodecProbScale; i++)
+				m_tab[i] = fixed_log2(i);
+		}
+
+		uint32_t m_tab[cRangeCodecProbScale + 1];
+	};
+
+	static const uint32_t* get_log2_table()
+	{
+		static const fixed_log2_table s_log2_tab;
+		return s_log2_tab.m_tab;
+	}
+
+	// Change in coded size (in 8.24 fixed point bits) when a symbol with count n has its scaled frequency changed from f to f+1
+	static inline uint64_t quant_delta_cost(const uint32_t* pLog2_tab, uint32_t n, uint32_t f)
+	{
+		assert((f >= 1) && (f < cRangeCodecProbScale));
+		return (uint64_t)n * (pLog2_tab[f + 1] - pLog2_tab[f]);
+	}
+
+	struct quant_heap_entry
+	{
+		uint64_t m_cost;
+		uint32_t m_sym;
+
+		// Ties are broken by symbol index so the results are deterministic
+		bool operator< (const quant_heap_entry& rhs) const { return (m_cost < rhs.m_cost) || ((m_cost == rhs.m_cost) && (m_sym > rhs.m_sym)); }
+	};
+
 	// freq may be modified if the number of used syms was 1
+	// The scaled frequencies minimize the coded size of the input frequencies (i.e. the KL divergence between the input and scaled distributions):
+	// starting from the proportionally scaled frequencies (clamped to a minimum of 1), units of probability are greedily added to or removed from 
+	// the symbols where that changes the coded size the least, then single units are moved between symbols until no move reduces the coded size.
 	bool vrange_create_cum_probs(uint32_vec& scaled_cum_prob, uint32_vec& freq)
 	{
-		assert(*(const uint32_t*)&g_byte_shuffle_mask != 0);
-
 		const uint32_t num_syms = (uint32_t)freq.size();
 		assert((num_syms >= cRangeCodecMinSyms) && (num_syms <= cRangeCodecMaxSyms));
 
 		if ((num_syms < cRangeCodecMinSyms) || (num_syms > cRangeCodecMaxSyms))
 			return false;
 
-		uint64_t total_freq = 0;
-		uint32_t total_used_syms = 0;
+		uint32_t temp_cum_prob[cRangeCodecMaxSyms + 1];
+		if (!vrange_create_cum_probs(temp_cum_prob, &freq[0], num_syms))
+			return false;
+
+		scaled_cum_prob.assign(temp_cum_prob, temp_cum_prob + num_syms + 1);
+		return true;
+	}
+
+	// Shared by both quantizers: sums the frequencies, giving an unused symbol a frequency of 1 if only one symbol is used
+	static bool prepare_sym_freqs(uint32_t* pFreq, uint32_t num_syms, uint64_t& total_freq, uint32_t& total_used_syms)
+	{
+		assert((num_syms >= cRangeCodecMinSyms) && (num_syms <= cRangeCodecMaxSyms));
+
+		if ((num_syms < cRangeCodecMinSyms) || (num_syms > cRangeCodecMaxSyms))
+			return false;
+
+		total_freq = 0;
+		total_used_syms = 0;
 		for (uint32_t i = 0; i < num_syms; i++)
 		{
-			total_freq += freq[i];
-			if (freq[i])
+			total_freq += pFreq[i];
+			if (pFreq[i])
 				total_used_syms++;
 		}
 
@@ -168,9 +265,9 @@ namespace sserangecoder
 		{
 			for (uint32_t i = 0; i < num_syms; i++)
 			{
-				if (!freq[i])
+				if (!pFreq[i])
 				{
-					freq[i]++;
+					pFreq[i]++;
 					total_freq++;
 					break;
 				}
@@ -180,8 +277,15 @@ namespace sserangecoder
 		}
 
 		assert((total_used_syms >= 2) && (total_freq >= 2));
+		return true;
+	}
 
-		scaled_cum_prob.resize(num_syms + 1);
+	bool vrange_create_cum_probs_legacy(uint32_t* pScaled_cum_prob, uint32_t* pFreq, uint32_t num_syms)
+	{
+		uint64_t total_freq;
+		uint32_t total_used_syms;
+		if (!prepare_sym_freqs(pFreq, num_syms, total_freq, total_used_syms))
+			return false;
 
 		uint32_t sym_index_to_boost = 0, boost_amount = 0;
 
@@ -193,9 +297,9 @@ namespace sserangecoder
 			uint32_t num_truncated_syms = 0;
 			for (uint32_t i = 0; i < num_syms; i++)
 			{
-				if (freq[i])
+				if (pFreq[i])
 				{
-					uint32_t l = (uint32_t)(((uint64_t)freq[i] * adjusted_prob_scale) / total_freq);
+					uint32_t l = (uint32_t)(((uint64_t)pFreq[i] * adjusted_prob_scale) / total_freq);
 					if (!l)
 						num_truncated_syms++;
 				}
@@ -221,18 +325,18 @@ namespace sserangecoder
 			uint32_t ci = 0;
 			for (uint32_t i = 0; i < num_syms; i++)
 			{
-				scaled_cum_prob[i] = ci;
+				pScaled_cum_prob[i] = ci;
 
-				if (!freq[i])
+				if (!pFreq[i])
 					continue;
 
-				if (freq[i] > most_prob_sym_freq)
+				if (pFreq[i] > most_prob_sym_freq)
 				{
-					most_prob_sym_freq = freq[i];
+					most_prob_sym_freq = pFreq[i];
 					most_prob_sym_index = i;
 				}
 
-				uint32_t l = (uint32_t)(((uint64_t)freq[i] * adjusted_prob_scale) / total_freq);
+				uint32_t l = (uint32_t)(((uint64_t)pFreq[i] * adjusted_prob_scale) / total_freq);
 				l = clamp<uint32_t>(l, 1, cRangeCodecProbScale - (total_used_syms - 1));
 
 				if ((pass) && (i == sym_index_to_boost))
@@ -245,7 +349,7 @@ namespace sserangecoder
 				if (ci > cRangeCodecProbScale)
 					return false;
 			}
-			scaled_cum_prob[num_syms] = cRangeCodecProbScale;
+			pScaled_cum_prob[num_syms] = cRangeCodecProbScale;
 						
 			if (ci == cRangeCodecProbScale)
 				break;
@@ -254,10 +358,7 @@ namespace sserangecoder
 			if (pass)
 				return false;
 
-			assert(!pass);
-
 			// On first pass and the total frequency isn't cRangeCodecProbScale, so boost the freq of the max used symbol
-
 			sym_index_to_boost = most_prob_sym_index;
 			boost_amount = cRangeCodecProbScale - ci;
 		}
@@ -265,157 +366,1681 @@ namespace sserangecoder
 		return true;
 	}
 
-	void vrange_encode(const uint8_vec& file_data, uint8_vec& enc_buf, const uint32_vec& scaled_cum_prob)
+	bool vrange_create_cum_probs(uint32_t* pScaled_cum_prob, uint32_t* pFreq, uint32_t num_syms)
 	{
-		assert(*(const uint32_t*)&g_byte_shuffle_mask != 0);
+		uint64_t total_freq;
+		uint32_t total_used_syms;
+		if (!prepare_sym_freqs(pFreq, num_syms, total_freq, total_used_syms))
+			return false;
 
-		const size_t file_size = file_data.size();
-		assert(file_size);
+		const uint32_t* pLog2_tab = get_log2_table();
 
-		range_enc encs[LANES];
-		uint8_vec bytes_written(file_size);
-		uint64_t total_enc_size = 0;
-				
-		for (uint32_t i = 0; i < LANES; i++)
-			encs[i].get_buf().reserve(1 + (file_size / LANES));
+		uint32_t scaled_freq[cRangeCodecMaxSyms];
+		uint32_t total_scaled_freq = 0;
 
-		for (size_t i = 0; i < file_size; i++)
+		for (uint32_t i = 0; i < num_syms; i++)
 		{
-			const uint32_t sym = file_data[i];
-			const uint32_t lane = i & LANE_MASK;
+			scaled_freq[i] = 0;
+			if (!pFreq[i])
+				continue;
+
+			uint32_t l = (uint32_t)(((uint64_t)pFreq[i] * cRangeCodecProbScale) / total_freq);
+			scaled_freq[i] = std::max<uint32_t>(l, 1);
+			total_scaled_freq += scaled_freq[i];
+		}
 
-			const size_t cur_enc_size = encs[lane].get_buf().size();
+		// The heap holds each used symbol's cost delta of the next step. For increments it's the gain (max-heap), 
+		// for decrements it's the negated loss, so the cheapest symbol is always at the front.
+		quant_heap_entry heap[cRangeCodecMaxSyms];
+		uint32_t heap_size = 0;
 
-			encs[lane].enc_val(scaled_cum_prob[sym], scaled_cum_prob[sym + 1]);
+		const bool inc = total_scaled_freq < cRangeCodecProbScale;
 
-			const uint32_t enc_bytes = (uint32_t)(encs[lane].get_buf().size() - cur_enc_size);
+		for (uint32_t i = 0; i < num_syms; i++)
+		{
+			if ((!pFreq[i]) || ((!inc) && (scaled_freq[i] == 1)))
+				continue;
 
-			bytes_written[i] = (uint8_t)(enc_bytes);
-			total_enc_size += enc_bytes;
+			heap[heap_size].m_cost = inc ? quant_delta_cost(pLog2_tab, pFreq[i], scaled_freq[i]) : (UINT64_MAX - quant_delta_cost(pLog2_tab, pFreq[i], scaled_freq[i] - 1));
+			heap[heap_size].m_sym = i;
+			heap_size++;
 		}
 
-		for (uint32_t lane = 0; lane < LANES; lane++)
-			encs[lane].flush();
+		std::make_heap(heap, heap + heap_size);
 
-		uint32_t cur_ofs[16];
-		clear_obj(cur_ofs);
+		while (total_scaled_freq != cRangeCodecProbScale)
+		{
+			// shouldn't happen
+			if (!heap_size)
+				return false;
 
-		const uint64_t final_enc_buf_size = LANES * 3 + total_enc_size + 2;
+			std::pop_heap(heap, heap + heap_size);
+			quant_heap_entry& e = heap[heap_size - 1];
 
-		enc_buf.resize((size_t)final_enc_buf_size);
+			const uint32_t sym = e.m_sym;
 
-		uint8_t* pDst_enc_buf = &enc_buf[0];
+			if (inc)
+			{
+				scaled_freq[sym]++;
+				total_scaled_freq++;
 
-		for (uint32_t lane = 0; lane < LANES; lane++)
-		{
-			for (uint32_t j = 0; j < 3; j++)
+				e.m_cost = quant_delta_cost(pLog2_tab, pFreq[sym], scaled_freq[sym]);
+			}
+			else
 			{
-				*pDst_enc_buf++ = encs[lane].get_buf()[cur_ofs[lane]];
-				cur_ofs[lane]++;
+				scaled_freq[sym]--;
+				total_scaled_freq--;
+
+				if (scaled_freq[sym] == 1)
+				{
+					heap_size--;
+					continue;
+				}
+
+				e.m_cost = UINT64_MAX - quant_delta_cost(pLog2_tab, pFreq[sym], scaled_freq[sym] - 1);
 			}
+
+			std::push_heap(heap, heap + heap_size);
 		}
 
-		for (size_t i = 0; i < file_size; i++)
+		// Move single units from the symbol that loses the least to the symbol that gains the most, until that no longer helps.
+		// The cost is separable and concave, so no improving move means the allocation is optimal.
+		for (uint32_t iter = 0; iter < cRangeCodecProbScale; iter++)
 		{
-			const uint32_t num_bytes = bytes_written[i];
+			uint64_t best_gain = 0, best_loss = UINT64_MAX;
+			uint32_t best_gain_sym = 0, best_loss_sym = 0;
 
-			if (num_bytes)
+			for (uint32_t i = 0; i < num_syms; i++)
 			{
-				const uint32_t lane = i & LANE_MASK;
-				const uint8_vec& src_bytes = encs[lane].get_buf();
+				if (!pFreq[i])
+					continue;
 
-				memcpy(pDst_enc_buf, &src_bytes[cur_ofs[lane]], num_bytes);
-				pDst_enc_buf += num_bytes;
+				const uint64_t gain = quant_delta_cost(pLog2_tab, pFreq[i], scaled_freq[i]);
+				if (gain > best_gain)
+				{
+					best_gain = gain;
+					best_gain_sym = i;
+				}
 
-				cur_ofs[lane] += num_bytes;
+				if (scaled_freq[i] > 1)
+				{
+					const uint64_t loss = quant_delta_cost(pLog2_tab, pFreq[i], scaled_freq[i] - 1);
+					if (loss < best_loss)
+					{
+						best_loss = loss;
+						best_loss_sym = i;
+					}
+				}
 			}
+
+			if ((best_loss == UINT64_MAX) || (best_gain_sym == best_loss_sym) || (best_gain <= best_loss))
+				break;
+
+			scaled_freq[best_gain_sym]++;
+			scaled_freq[best_loss_sym]--;
 		}
 
-		for (uint32_t i = 0; i < 2; i++)
-			*pDst_enc_buf++ = 0;
+		uint32_t ci = 0;
+		for (uint32_t i = 0; i < num_syms; i++)
+		{
+			pScaled_cum_prob[i] = ci;
+
+			assert(scaled_freq[i] < cRangeCodecProbScale);
+			ci += scaled_freq[i];
+		}
+		pScaled_cum_prob[num_syms] = cRangeCodecProbScale;
 
-		assert(pDst_enc_buf - &enc_buf[0] == enc_buf.size());
+		assert(ci == cRangeCodecProbScale);
+
+		// shouldn't happen
+		if (ci != cRangeCodecProbScale)
+			return false;
+
+		return true;
 	}
 
-	static sser_forceinline uint32_t read_be24(const uint8_t*& pSrc)
+	bool vrange_is_valid_model(const uint32_t* pScaled_cum_prob, uint32_t num_syms)
 	{
-		const uint32_t res = (pSrc[0] << 16) | (pSrc[1] << 8) | pSrc[2];
-		pSrc += 3;
-		return res;
+		if ((num_syms < cRangeCodecMinSyms) || (num_syms > cRangeCodecMaxSyms))
+			return false;
+
+		if ((pScaled_cum_prob[0] != 0) || (pScaled_cum_prob[num_syms] != cRangeCodecProbScale))
+			return false;
+
+		for (uint32_t i = 0; i < num_syms; i++)
+		{
+			if ((pScaled_cum_prob[i] > pScaled_cum_prob[i + 1]) || ((pScaled_cum_prob[i + 1] - pScaled_cum_prob[i]) >= cRangeCodecProbScale))
+				return false;
+		}
+
+		return true;
 	}
 
-	bool vrange_decode(const uint8_t *pSrc_start, size_t comp_size, uint8_t *pDst_start, size_t orig_size, const uint32_t *pDec_table)
+	void vrange_get_sym_costs(uint32_t num_syms, const uint32_vec& scaled_cum_prob, uint32_vec& sym_costs)
 	{
-		assert(*(const uint32_t*)&g_byte_shuffle_mask != 0);
-
-		const uint8_t* pSrc = pSrc_start;
+		assert((num_syms <= cRangeCodecMaxSyms) && (scaled_cum_prob.size() == (num_syms + 1)));
 
-		__m128i arith_value0, arith_value1, arith_value2, arith_value3;
-		__m128i arith_length0 = _mm_set1_epi32(cRangeCodecMaxLen), arith_length1 = _mm_set1_epi32(cRangeCodecMaxLen), 
-			arith_length2 = _mm_set1_epi32(cRangeCodecMaxLen), arith_length3 = _mm_set1_epi32(cRangeCodecMaxLen);
+		const uint32_t* pLog2_tab = get_log2_table();
 
-		__m128i* arith_lens[4] = { &arith_length0, &arith_length1, &arith_length2, &arith_length3 };
-		__m128i* arith_vals[4] = { &arith_value0, &arith_value1, &arith_value2, &arith_value3 };
+		sym_costs.resize(cRangeCodecMaxSyms);
 
-		for (uint32_t vec_index = 0; vec_index < 4; vec_index++)
+		for (uint32_t i = 0; i < cRangeCodecMaxSyms; i++)
 		{
-			__m128i x = _mm_cvtsi32_si128(read_be24(pSrc));
-			x = _mm_insert_epi32(x, read_be24(pSrc), 1);
-			x = _mm_insert_epi32(x, read_be24(pSrc), 2);
-			x = _mm_insert_epi32(x, read_be24(pSrc), 3);
-			*arith_vals[vec_index] = x;
+			const uint32_t f = (i < num_syms) ? (scaled_cum_prob[i + 1] - scaled_cum_prob[i]) : 0;
+
+			if ((!f) || (f > cRangeCodecProbScale))
+				sym_costs[i] = cRangeCodecInvalidSymCost;
+			else
+			{
+				// log2(cRangeCodecProbScale / f), rounded to cRangeCodecCostFracBits
+				const uint32_t cost = (cRangeCodecProbBits << 24) - pLog2_tab[f];
+				sym_costs[i] = ((cost + (1 << (24 - cRangeCodecCostFracBits - 1))) >> (24 - cRangeCodecCostFracBits));
+			}
 		}
-						
-		const uint8_t* pSrc_end = pSrc + comp_size;
-		size_t dst_ofs = 0;
-		
-		uint32_t* pDst32 = (uint32_t*)pDst_start;
+	}
 
-		// Vectorized decode
-		for (dst_ofs = 0; ((dst_ofs + LANES) <= orig_size) && (pSrc + 8*4) <= pSrc_end; dst_ofs += LANES)
+	uint64_t vrange_get_hist_cost(const uint32_t* pHist, const uint32_t* pSym_costs)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i invalid_cost = _mm_set1_epi32((int)cRangeCodecInvalidSymCost);
+
+		__m128i total0 = zero, total1 = zero, invalid = zero;
+
+		for (uint32_t i = 0; i < cRangeCodecMaxSyms; i += 4)
 		{
-			pDst32[0] = vrange_decode(arith_value0, arith_length0, pDec_table);
-			pDst32[1] = vrange_decode(arith_value1, arith_length1, pDec_table);
-			pDst32[2] = vrange_decode(arith_value2, arith_length2, pDec_table);
-			pDst32[3] = vrange_decode(arith_value3, arith_length3, pDec_table);
+			const __m128i h = _mm_loadu_si128((const __m128i*)(pHist + i));
+			const __m128i c = _mm_loadu_si128((const __m128i*)(pSym_costs + i));
 
-			pDst32 += 4;
+			// Flag used symbols the model can't code
+			invalid = _mm_or_si128(invalid, _mm_andnot_si128(_mm_cmpeq_epi32(h, zero), _mm_cmpeq_epi32(c, invalid_cost)));
 
-			vrange_normalize(arith_value0, arith_length0, pSrc);
-			vrange_normalize(arith_value1, arith_length1, pSrc);
-			vrange_normalize(arith_value2, arith_length2, pSrc);
-			vrange_normalize(arith_value3, arith_length3, pSrc);
+			// 32x32->64 multiplies of the even and odd lanes
+			total0 = _mm_add_epi64(total0, _mm_mul_epu32(h, c));
+			total1 = _mm_add_epi64(total1, _mm_mul_epu32(_mm_srli_epi64(h, 32), _mm_srli_epi64(c, 32)));
 		}
-				
-		// Finish the end with scalar code
-		range_dec scalar_dec;
-		while (dst_ofs < orig_size)
+
+		if (_mm_movemask_epi8(invalid))
+			return UINT64_MAX;
+
+		uint64_t totals[2];
+		_mm_storeu_si128((__m128i*)totals, _mm_add_epi64(total0, total1));
+
+		return totals[0] + totals[1];
+	}
+
+	size_t vrange_estimate_encoded_size(const uint8_t* pData, size_t data_size, const uint32_t* pSym_costs, uint32_t num_lanes)
+	{
+		uint32_t hist[256];
+		clear_obj(hist);
+		vrange_histogram(pData, data_size, hist);
+
+		uint64_t total_cost = vrange_get_hist_cost(hist, pSym_costs);
+		if (total_cost == UINT64_MAX)
+			return SIZE_MAX;
+
+		// Each coded symbol also loses the remainder of length / cRangeCodecProbScale, around .008 bits on average. 
+		// Highly probable symbols shrink the interval so slowly that it's refilled less often, so their loss is capped at a few times their own cost.
+		const uint32_t cPrecisionLossCost = 500, cPrecisionLossMaxScale = 4;
+		for (uint32_t i = 0; i < 256; i++)
+			if (hist[i])
+				total_cost += (uint64_t)hist[i] * std::min<uint32_t>(cPrecisionLossCost, pSym_costs[i] * cPrecisionLossMaxScale);
+
+		// Each lane ends with on average around half a byte of coded information that is never written out (the final byte fetched by the decoder is padding)
+		const uint64_t unwritten_cost = std::min<uint64_t>(total_cost, (uint64_t)(num_lanes * 4) << cRangeCodecCostFracBits);
+
+		const uint64_t total_bytes = (total_cost - unwritten_cost + (8U << cRangeCodecCostFracBits) - 1) >> (cRangeCodecCostFracBits + 3);
+		return (size_t)total_bytes + vrange_get_stream_overhead(num_lanes);
+	}
+
+	uint32_t vrange_choose_num_lanes(size_t data_size)
+	{
+		// Fewer lanes decode more slowly, but below these sizes the 3 bytes saved per lane are worth more
+		if (data_size < 512)
+			return 4;
+		else if (data_size < 2048)
+			return 8;
+
+		return LANES;
+	}
+
+	void vrange_encode(const uint8_vec& file_data, uint8_vec& enc_buf, const uint32_vec& scaled_cum_prob, uint32_t num_lanes)
+	{
+		vrange_encode(file_data.data(), file_data.size(), enc_buf, scaled_cum_prob, num_lanes);
+	}
+
+	// Upper bound of the bytes written while encoding num_syms symbols with one scalar encoder. The length is at least 2^16 before each symbol, so
+	// coding one shrinks it by at most 2^-12 * (16/15): 12.0931 bits or 1.5117 bytes per symbol. n + n/2 + n/64 + 2 covers that, including the rounding.
+	static size_t get_max_coded_bytes(size_t num_syms)
+	{
+		return num_syms + (num_syms >> 1) + (num_syms >> 6) + 2;
+	}
+
+	size_t vrange_compress_bound(size_t data_size)
+	{
+		if (data_size > ((SIZE_MAX - vrange_get_stream_overhead(LANES) - 2) / 2))
+			return 0;
+
+		// The 3 initial bytes per lane and 2 bytes of padding, plus the coded bytes (summed over the lanes, which can only lose rounding slack)
+		return vrange_get_stream_overhead(LANES) + get_max_coded_bytes(data_size);
+	}
+
+	// Used by the vrange_encode() functions, which used to create a temporary context (and allocate its scratch memory) on every call
+	static vrange_encoder_context& get_thread_encoder_context()
+	{
+		static thread_local vrange_encoder_context s_ctx;
+		return s_ctx;
+	}
+
+	size_t vrange_encode(const uint8_t* pData, size_t data_size, uint8_t* pDst, size_t dst_capacity, const uint32_t* pScaled_cum_prob, uint32_t num_lanes, vrange_encode_stats* pStats)
+	{
+		size_t comp_size;
+		if (!get_thread_encoder_context().encode(pData, data_size, pScaled_cum_prob, pDst, dst_capacity, comp_size, num_lanes, pStats))
+			return 0;
+
+		return comp_size;
+	}
+
+	void vrange_encode(const uint8_t* pData, size_t data_size, uint8_vec& enc_buf, const uint32_vec& scaled_cum_prob, uint32_t num_lanes, vrange_encode_stats* pStats)
+	{
+		assert(data_size);
+
+		// Encode straight into enc_buf, so the context doesn't need an output buffer
+		enc_buf.resize(vrange_compress_bound(data_size));
+
+		size_t comp_size = 0;
+		if ((enc_buf.empty()) || (!get_thread_encoder_context().encode(pData, data_size, &scaled_cum_prob[0], &enc_buf[0], enc_buf.size(), comp_size, num_lanes, pStats)))
 		{
-			// This check can never be true on valid inputs - the end is always padded.
-			if ((pSrc + 2) > pSrc_end)
-				return false;
+			enc_buf.resize(0);
+			return;
+		}
 
-			const uint32_t vec_index = (dst_ofs & LANE_MASK) >> 2;
-			const uint32_t vec_lane = dst_ofs & 3;
+		const uint64_t start_ticks = pStats ? __rdtsc() : 0;
 
-			scalar_dec.m_arith_length = ((const uint32_t *)arith_lens[vec_index])[vec_lane];
-			scalar_dec.m_arith_value = ((const uint32_t *)arith_vals[vec_index])[vec_lane];
-						
-			uint32_t sym = scalar_dec.dec_sym(pDec_table, pSrc);
+		enc_buf.resize(comp_size);
+
+		if (pStats)
+			pStats->m_output_ticks += __rdtsc() - start_ticks;
+	}
+
+	// Returns false for symbols the model gives no probability (or the whole range) instead of encoding them: with a zero frequency the interval
+	// would be empty, and the encoder would renormalize forever. One compare, since it runs for every symbol.
+	static inline bool is_codable_sym(uint32_t low_prob, uint32_t high_prob)
+	{
+		return (high_prob - low_prob - 1) < (cRangeCodecProbScale - 1);
+	}
+
+	// Output of range_lane_enc: a fixed size buffer instead of a vector
+	struct range_lane_buf
+	{
+		uint8_t* m_pStart;
+		uint8_t* m_pCur;
 
-			pDst_start[dst_ofs++] = (uint8_t)sym;
+		inline void push_back(uint8_t c) { *m_pCur++ = c; }
+		inline size_t size() const { return m_pCur - m_pStart; }
+		inline uint8_t& operator[] (size_t index) { return m_pStart[index]; }
+	};
 
-			((uint32_t *)arith_lens[vec_index])[vec_lane] = scalar_dec.m_arith_length;
-			((uint32_t *)arith_vals[vec_index])[vec_lane] = scalar_dec.m_arith_value;
+	// Scalar range encoder writing to a fixed size buffer. The vectorized encoder uses one per lane, the output is identical to range_enc's.
+	class range_lane_enc : public range_enc_base<range_lane_buf>
+	{
+	public:
+		void init(uint8_t* pBuf)
+		{
+			init_state();
+			m_buf.m_pStart = pBuf;
+			m_buf.m_pCur = pBuf;
 		}
 
-		size_t bytes_read = pSrc - pSrc_start;
-		if (bytes_read > comp_size)
-			return false;
+		size_t get_size() const { return m_buf.size(); }
+		const uint8_t* get_buf() const { return m_buf.m_pStart; }
 
-		return true;
+		// Worst case bytes written, plus up to 7 by flush()
+		static size_t get_max_size(size_t num_syms) { return get_max_coded_bytes(num_syms) + 7; }
+	};
+
+	// Scratch memory layout for inputs of up to max_data_size bytes: the per-symbol byte counts, then each lane's buffer, then the output (if reserved)
+	static size_t get_lane_buf_size(size_t max_data_size, uint32_t num_lanes)
+	{
+		return (range_lane_enc::get_max_size((max_data_size + num_lanes - 1) / num_lanes) + 15) & ~15;
 	}
 
-} // namespace sserangecoder
+	// The lane buffers are sized for whichever lane count needs the most memory
+	static size_t get_lane_bufs_size(size_t max_data_size)
+	{
+		size_t total = 0;
+		for (uint32_t num_lanes = cRangeCodecMinLanes; num_lanes <= LANES; num_lanes *= 2)
+			total = std::max(total, get_lane_buf_size(max_data_size, num_lanes) * num_lanes);
+		return total;
+	}
+
+	static size_t get_bytes_written_size(size_t max_data_size)
+	{
+		return (max_data_size + 15) & ~15;
+	}
+
+	static size_t get_scratch_size(size_t max_data_size, bool output_buf)
+	{
+		return get_bytes_written_size(max_data_size) + get_lane_bufs_size(max_data_size) + (output_buf ? vrange_compress_bound(max_data_size) : 0);
+	}
 
+	static void* default_alloc(size_t size, void* pUser)
+	{
+		(void)pUser;
+		return malloc(size);
+	}
+
+	static void default_free(void* p, void* pUser)
+	{
+		(void)pUser;
+		free(p);
+	}
+
+	vrange_encoder_context::vrange_encoder_context(const vrange_allocator* pAllocator) :
+		m_pScratch(NULL),
+		m_max_data_size(0),
+		m_total_allocs(0),
+		m_has_output_buf(false),
+		m_num_syms(0)
+	{
+		if (pAllocator)
+			m_allocator = *pAllocator;
+		else
+		{
+			m_allocator.m_pAlloc = default_alloc;
+			m_allocator.m_pFree = default_free;
+			m_allocator.m_pUser = NULL;
+		}
+	}
+
+	vrange_encoder_context::~vrange_encoder_context()
+	{
+		clear();
+	}
 
+	void vrange_encoder_context::clear()
+	{
+		if (m_pScratch)
+		{
+			m_allocator.m_pFree(m_pScratch, m_allocator.m_pUser);
+			m_pScratch = NULL;
+		}
+
+		m_max_data_size = 0;
+		m_has_output_buf = false;
+	}
+
+	bool vrange_encoder_context::reserve(size_t max_data_size)
+	{
+		return reserve(max_data_size, true);
+	}
+
+	bool vrange_encoder_context::reserve(size_t max_data_size, bool output_buf)
+	{
+		if ((m_pScratch) && (max_data_size <= m_max_data_size) && ((!output_buf) || (m_has_output_buf)))
+			return true;
+
+		// Overflow check for the scratch size computation
+		if (max_data_size > (SIZE_MAX / 8))
+			return false;
+
+		// Growing keeps the output buffer if there was one, adding it keeps the larger size
+		if (m_pScratch)
+		{
+			max_data_size = std::max(max_data_size, m_max_data_size);
+			output_buf = output_buf || m_has_output_buf;
+		}
+
+		clear();
+
+		m_pScratch = (uint8_t*)m_allocator.m_pAlloc(get_scratch_size(max_data_size, output_buf), m_allocator.m_pUser);
+		if (!m_pScratch)
+			return false;
+
+		m_max_data_size = max_data_size;
+		m_has_output_buf = output_buf;
+		m_total_allocs++;
+
+		return true;
+	}
+
+	bool vrange_encoder_context::create_model(const uint32_t* pSym_freq, uint32_t num_syms)
+	{
+		m_num_syms = 0;
+
+		if ((num_syms < cRangeCodecMinSyms) || (num_syms > cRangeCodecMaxSyms))
+			return false;
+
+		uint32_t freq[cRangeCodecMaxSyms];
+		memcpy(freq, pSym_freq, num_syms * sizeof(uint32_t));
+
+		if (!vrange_create_cum_probs(m_scaled_cum_prob, freq, num_syms))
+			return false;
+
+		m_num_syms = num_syms;
+		return true;
+	}
+
+	bool vrange_encoder_context::encode(const uint8_t* pData, size_t data_size, const uint32_t* pScaled_cum_prob, const uint8_t*& pComp, size_t& comp_size, uint32_t num_lanes, vrange_encode_stats* pStats)
+	{
+		pComp = NULL;
+		comp_size = 0;
+
+		if (!reserve(data_size, true))
+			return false;
+
+		uint8_t* pOut = m_pScratch + get_bytes_written_size(m_max_data_size) + get_lane_bufs_size(m_max_data_size);
+
+		if (!encode(pData, data_size, pScaled_cum_prob, pOut, vrange_compress_bound(data_size), comp_size, num_lanes, pStats))
+			return false;
+
+		pComp = pOut;
+		return true;
+	}
+
+	bool vrange_encoder_context::encode(const uint8_t* pData, size_t data_size, const uint32_t* pScaled_cum_prob, uint8_t* pDst, size_t dst_capacity, size_t& comp_size, uint32_t num_lanes, vrange_encode_stats* pStats)
+	{
+		const vrange_const_iovec seg = { pData, data_size };
+		return encode_iov(&seg, 1, pScaled_cum_prob, pDst, dst_capacity, comp_size, num_lanes, pStats);
+	}
+
+	bool vrange_encoder_context::encode_iov(const vrange_const_iovec* pSrc_segs, uint32_t num_src_segs, const uint32_t* pScaled_cum_prob, uint8_t* pDst, size_t dst_capacity, size_t& comp_size, uint32_t num_lanes, vrange_encode_stats* pStats)
+	{
+		comp_size = 0;
+
+		size_t data_size = 0;
+		for (uint32_t i = 0; i < num_src_segs; i++)
+			data_size += pSrc_segs[i].m_size;
+
+		if (!vrange_is_valid_num_lanes(num_lanes))
+			return false;
+
+		if (!reserve(data_size, false))
+			return false;
+
+		const size_t lane_buf_size = get_lane_buf_size(m_max_data_size, num_lanes);
+		const uint32_t lane_mask = num_lanes - 1;
+
+		uint8_t* pBytes_written = m_pScratch;
+		uint8_t* pLane_bufs = m_pScratch + get_bytes_written_size(m_max_data_size);
+
+		const uint64_t start_ticks = pStats ? __rdtsc() : 0;
+
+		range_lane_enc encs[LANES];
+		for (uint32_t lane = 0; lane < num_lanes; lane++)
+			encs[lane].init(pLane_bufs + lane_buf_size * lane);
+
+		size_t total_enc_size = 0;
+
+		// i is the offset in the concatenated input, so the lanes continue across fragments
+		size_t i = 0;
+
+		for (uint32_t seg_index = 0; seg_index < num_src_segs; seg_index++)
+		{
+			const uint8_t* pData = pSrc_segs[seg_index].m_pData;
+			const uint8_t* pData_end = pData + pSrc_segs[seg_index].m_size;
+
+			for ( ; pData != pData_end; ++pData, ++i)
+			{
+				const uint32_t sym = *pData;
+				const uint32_t lane = i & lane_mask;
+
+				const uint32_t low_prob = pScaled_cum_prob[sym], high_prob = pScaled_cum_prob[sym + 1];
+				if (!is_codable_sym(low_prob, high_prob))
+					return false;
+
+				const size_t cur_enc_size = encs[lane].get_size();
+
+				encs[lane].enc_val(low_prob, high_prob);
+
+				const uint32_t enc_bytes = (uint32_t)(encs[lane].get_size() - cur_enc_size);
+
+				pBytes_written[i] = (uint8_t)(enc_bytes);
+				total_enc_size += enc_bytes;
+			}
+		}
+
+		if (pStats)
+		{
+			for (uint32_t lane = 0; lane < num_lanes; lane++)
+				pStats->m_lane_renorm_bytes[lane] += encs[lane].get_size();
+		}
+
+		for (uint32_t lane = 0; lane < num_lanes; lane++)
+			encs[lane].flush();
+
+		const uint64_t swizzle_start_ticks = pStats ? __rdtsc() : 0;
+		if (pStats)
+			pStats->m_lane_encode_ticks += swizzle_start_ticks - start_ticks;
+
+		const size_t final_size = vrange_get_stream_overhead(num_lanes) + total_enc_size;
+		if (final_size > dst_capacity)
+			return false;
+
+		// Swizzle the lanes' bytes into the order the decoder reads them
+		uint8_t* pDst_enc_buf = pDst;
+
+		size_t cur_ofs[LANES];
+		for (uint32_t lane = 0; lane < num_lanes; lane++)
+		{
+			const uint8_t* pLane_buf = encs[lane].get_buf();
+
+			for (uint32_t j = 0; j < 3; j++)
+				*pDst_enc_buf++ = pLane_buf[j];
+
+			cur_ofs[lane] = 3;
+		}
+
+		for (size_t i = 0; i < data_size; i++)
+		{
+			const uint32_t num_bytes = pBytes_written[i];
+
+			if (num_bytes)
+			{
+				const uint32_t lane = i & lane_mask;
+
+				memcpy(pDst_enc_buf, encs[lane].get_buf() + cur_ofs[lane], num_bytes);
+				pDst_enc_buf += num_bytes;
+
+				cur_ofs[lane] += num_bytes;
+			}
+		}
+
+		for (uint32_t i = 0; i < 2; i++)
+			*pDst_enc_buf++ = 0;
+
+		assert((size_t)(pDst_enc_buf - pDst) == final_size);
+
+		if (pStats)
+		{
+			pStats->m_swizzle_ticks += __rdtsc() - swizzle_start_ticks;
+			pStats->m_total_calls++;
+			pStats->m_total_syms += data_size;
+			pStats->m_total_comp_bytes += final_size;
+		}
+
+		comp_size = final_size;
+		return true;
+	}
+
+	// Calls func(thread_index) on num_threads threads, one of them the calling thread
+	template<typename F>
+	static void run_on_threads(uint32_t num_threads, F func)
+	{
+		std::thread threads[cRangeEncodeMaxThreads];
+
+		for (uint32_t t = 1; t < num_threads; t++)
+			threads[t] = std::thread(func, t);
+
+		func(0);
+
+		for (uint32_t t = 1; t < num_threads; t++)
+			threads[t].join();
+	}
+
+	bool vrange_encoder_context::encode_mt(const uint8_t* pData, size_t data_size, const uint32_t* pScaled_cum_prob, uint8_t* pDst, size_t dst_capacity, size_t& comp_size, uint32_t num_threads, uint32_t num_lanes, vrange_encode_stats* pStats)
+	{
+		num_threads = std::min<uint32_t>(std::min(num_threads, cRangeEncodeMaxThreads), (uint32_t)std::min<size_t>(cRangeEncodeMaxThreads, data_size / cRangeEncodeMinBytesPerThread));
+
+		// Threads sharing a core only add the cost of starting them (hardware_concurrency() returns 0 if it's unknown)
+		const uint32_t num_cores = std::thread::hardware_concurrency();
+		if (num_cores)
+			num_threads = std::min(num_threads, num_cores);
+
+		if (num_threads <= 1)
+			return encode(pData, data_size, pScaled_cum_prob, pDst, dst_capacity, comp_size, num_lanes, pStats);
+
+		comp_size = 0;
+
+		if (!vrange_is_valid_num_lanes(num_lanes))
+			return false;
+
+		if (!reserve(data_size, false))
+			return false;
+
+		const size_t lane_buf_size = get_lane_buf_size(m_max_data_size, num_lanes);
+		const uint32_t lane_mask = num_lanes - 1;
+		const uint32_t lane_shift = (num_lanes == 4) ? 2 : ((num_lanes == 8) ? 3 : 4);
+
+		// The byte counts are stored lane by lane (so each thread writes its own part of the array), lane_syms per lane
+		const size_t lane_syms = (data_size + lane_mask) >> lane_shift;
+
+		uint8_t* pBytes_written = m_pScratch;
+		uint8_t* pLane_bufs = m_pScratch + get_bytes_written_size(m_max_data_size);
+
+		// The swizzle is split into num_threads ranges of symbols, starting at multiples of num_lanes. Every range is at least
+		// cRangeEncodeMinBytesPerThread - num_lanes symbols long, so they're never empty.
+		size_t range_starts[cRangeEncodeMaxThreads + 1];
+		for (uint32_t t = 0; t < num_threads; t++)
+			range_starts[t] = ((data_size * t) / num_threads) & ~(size_t)lane_mask;
+		range_starts[num_threads] = data_size;
+
+		// Each lane's size just before encoding its first symbol in each range
+		size_t range_lane_sizes[cRangeEncodeMaxThreads][LANES];
+
+		const uint64_t start_ticks = pStats ? __rdtsc() : 0;
+
+		range_lane_enc encs[LANES];
+		for (uint32_t lane = 0; lane < num_lanes; lane++)
+			encs[lane].init(pLane_bufs + lane_buf_size * lane);
+
+		const uint32_t num_enc_threads = std::min(num_threads, num_lanes);
+
+		bool thread_failed[cRangeEncodeMaxThreads];
+		for (uint32_t t = 0; t < num_enc_threads; t++)
+			thread_failed[t] = false;
+
+		run_on_threads(num_enc_threads, [&](uint32_t thread_index)
+		{
+			const uint32_t first_lane = (thread_index * num_lanes) / num_enc_threads;
+			const uint32_t last_lane = ((thread_index + 1) * num_lanes) / num_enc_threads;
+
+			// Thread local copies of the encoders, so the threads don't share their cache lines
+			range_lane_enc thread_encs[LANES];
+			for (uint32_t lane = first_lane; lane < last_lane; lane++)
+				thread_encs[lane] = encs[lane];
+
+			uint32_t range_index = 0;
+
+			for (size_t g = 0; g < lane_syms; g++)
+			{
+				const size_t base = g << lane_shift;
+
+				if (base == range_starts[range_index])
+				{
+					for (uint32_t lane = first_lane; lane < last_lane; lane++)
+						range_lane_sizes[range_index][lane] = thread_encs[lane].get_size();
+					range_index++;
+				}
+
+				for (uint32_t lane = first_lane; (lane < last_lane) && ((base + lane) < data_size); lane++)
+				{
+					const uint32_t sym = pData[base + lane];
+
+					const uint32_t low_prob = pScaled_cum_prob[sym], high_prob = pScaled_cum_prob[sym + 1];
+					if (!is_codable_sym(low_prob, high_prob))
+					{
+						thread_failed[thread_index] = true;
+						return;
+					}
+
+					const size_t cur_enc_size = thread_encs[lane].get_size();
+
+					thread_encs[lane].enc_val(low_prob, high_prob);
+
+					pBytes_written[lane * lane_syms + g] = (uint8_t)(thread_encs[lane].get_size() - cur_enc_size);
+				}
+			}
+
+			assert(range_index == num_threads);
+
+			for (uint32_t lane = first_lane; lane < last_lane; lane++)
+				encs[lane] = thread_encs[lane];
+		});
+
+		for (uint32_t t = 0; t < num_enc_threads; t++)
+			if (thread_failed[t])
+				return false;
+
+		size_t total_enc_size = 0;
+		for (uint32_t lane = 0; lane < num_lanes; lane++)
+		{
+			total_enc_size += encs[lane].get_size();
+
+			if (pStats)
+				pStats->m_lane_renorm_bytes[lane] += encs[lane].get_size();
+		}
+
+		for (uint32_t lane = 0; lane < num_lanes; lane++)
+			encs[lane].flush();
+
+		const uint64_t swizzle_start_ticks = pStats ? __rdtsc() : 0;
+		if (pStats)
+			pStats->m_lane_encode_ticks += swizzle_start_ticks - start_ticks;
+
+		const size_t final_size = vrange_get_stream_overhead(num_lanes) + total_enc_size;
+		if (final_size > dst_capacity)
+			return false;
+
+		for (uint32_t lane = 0; lane < num_lanes; lane++)
+			memcpy(pDst + lane * 3, encs[lane].get_buf(), 3);
+
+		run_on_threads(num_threads, [&](uint32_t thread_index)
+		{
+			// Lane offsets are 3 (the initial bytes) plus the bytes the lane wrote before the range, and the output offset is the sum of them
+			size_t cur_ofs[LANES];
+			size_t dst_ofs = 0;
+			for (uint32_t lane = 0; lane < num_lanes; lane++)
+			{
+				cur_ofs[lane] = 3 + range_lane_sizes[thread_index][lane];
+				dst_ofs += cur_ofs[lane];
+			}
+
+			uint8_t* pDst_enc_buf = pDst + dst_ofs;
+
+			const size_t range_end = range_starts[thread_index + 1];
+
+			for (size_t i = range_starts[thread_index]; i < range_end; i++)
+			{
+				const uint32_t lane = i & lane_mask;
+				const uint32_t num_bytes = pBytes_written[lane * lane_syms + (i >> lane_shift)];
+
+				if (num_bytes)
+				{
+					memcpy(pDst_enc_buf, encs[lane].get_buf() + cur_ofs[lane], num_bytes);
+					pDst_enc_buf += num_bytes;
+
+					cur_ofs[lane] += num_bytes;
+				}
+			}
+		});
+
+		for (uint32_t i = 0; i < 2; i++)
+			pDst[final_size - 2 + i] = 0;
+
+		if (pStats)
+		{
+			pStats->m_swizzle_ticks += __rdtsc() - swizzle_start_ticks;
+			pStats->m_total_calls++;
+			pStats->m_total_syms += data_size;
+			pStats->m_total_comp_bytes += final_size;
+		}
+
+		comp_size = final_size;
+		return true;
+	}
+
+	bool vrange_decoder_context::create_model(const uint32_t* pSym_freq, uint32_t num_syms, bool legacy_quantizer)
+	{
+		m_num_syms = 0;
+
+		if ((num_syms < cRangeCodecMinSyms) || (num_syms > cRangeCodecMaxSyms))
+			return false;
+
+		uint32_t freq[cRangeCodecMaxSyms];
+		memcpy(freq, pSym_freq, num_syms * sizeof(uint32_t));
+
+		if (!(legacy_quantizer ? vrange_create_cum_probs_legacy(m_scaled_cum_prob, freq, num_syms) : vrange_create_cum_probs(m_scaled_cum_prob, freq, num_syms)))
+			return false;
+
+		vrange_init_table(num_syms, m_scaled_cum_prob, m_dec_table);
+
+		m_num_syms = num_syms;
+		return true;
+	}
+
+	bool vrange_decoder_context::set_model(const uint32_t* pScaled_cum_prob, uint32_t num_syms)
+	{
+		m_num_syms = 0;
+
+		if (!vrange_is_valid_model(pScaled_cum_prob, num_syms))
+			return false;
+
+		memcpy(m_scaled_cum_prob, pScaled_cum_prob, (num_syms + 1) * sizeof(uint32_t));
+		vrange_init_table(num_syms, m_scaled_cum_prob, m_dec_table);
+
+		m_num_syms = num_syms;
+		return true;
+	}
+
+	bool vrange_decoder_context::decode(const uint8_t* pSrc, size_t src_size, uint8_t* pDst, size_t dst_size, uint32_t num_lanes, vrange_decode_stats* pStats) const
+	{
+		if (!m_num_syms)
+			return false;
+
+		return vrange_decode(pSrc, src_size, pDst, dst_size, m_dec_table, num_lanes, pStats);
+	}
+
+	bool vrange_decoder_context::decode_rans(const uint8_t* pSrc, size_t src_size, uint8_t* pDst, size_t dst_size) const
+	{
+		if (!m_num_syms)
+			return false;
+
+		return vrange_rans_decode(pSrc, src_size, pDst, dst_size, m_dec_table);
+	}
+
+
+	// The decoder's position in its output segments
+	// Decoding kernel outputs provide begin_run() (the next run of outputs the vector loop can store whole groups to directly), advance(), write() for groups
+	// which don't fit in a run, and store_group() for NUM_VECS packed uint32_t's of 4 symbols each.
+	struct vrange_output_segs
+	{
+		typedef uint8_t value_type;
+
+		vrange_output_segs(const vrange_iovec* pSegs, uint32_t num_segs) : m_pSegs(pSegs), m_pSegs_end(pSegs + num_segs), m_pCur(NULL), m_cur_left(0) { }
+
+		uint8_t* begin_run(size_t& run_size)
+		{
+			next();
+			run_size = m_cur_left;
+			return m_pCur;
+		}
+
+		// Moves to the next non-empty segment if the current one is full
+		void next()
+		{
+			while ((!m_cur_left) && (m_pSegs != m_pSegs_end))
+			{
+				m_pCur = m_pSegs->m_pData;
+				m_cur_left = m_pSegs->m_size;
+				m_pSegs++;
+			}
+		}
+
+		void advance(size_t n)
+		{
+			assert(n <= m_cur_left);
+			m_pCur += n;
+			m_cur_left -= n;
+		}
+
+		// Copies n bytes, which may span several segments
+		void write(const void* pSrc, size_t n)
+		{
+			const uint8_t* pSrc8 = (const uint8_t*)pSrc;
+
+			while (n)
+			{
+				next();
+
+				const size_t k = std::min(n, m_cur_left);
+				memcpy(m_pCur, pSrc8, k);
+				advance(k);
+
+				pSrc8 += k;
+				n -= k;
+			}
+		}
+
+		template <uint32_t NUM_VECS>
+		static sser_forceinline void store_group(uint8_t* pDst, const uint32_t* pSyms)
+		{
+			for (uint32_t vec_index = 0; vec_index < NUM_VECS; vec_index++)
+				memcpy(pDst + vec_index * 4, &pSyms[vec_index], sizeof(uint32_t));
+		}
+
+		const vrange_iovec* m_pSegs;
+		const vrange_iovec* m_pSegs_end;
+		uint8_t* m_pCur;
+		size_t m_cur_left;
+	};
+
+	// Expands each symbol to its value from a vrange_value_table into one buffer of T's. SMALL uses byte shuffles for dictionaries of up to 16 values.
+	template <typename T, bool SMALL>
+	struct vrange_value_output
+	{
+		typedef T value_type;
+
+		vrange_value_output(T* pDst, size_t size, const vrange_value_table& values) : m_pCur(pDst), m_cur_left(size), m_values(values) { }
+
+		T* begin_run(size_t& run_size)
+		{
+			run_size = m_cur_left;
+			return m_pCur;
+		}
+
+		void advance(size_t n)
+		{
+			assert(n <= m_cur_left);
+			m_pCur += n;
+			m_cur_left -= n;
+		}
+
+		void write(const void* pSyms, size_t n)
+		{
+			const uint8_t* pSyms8 = (const uint8_t*)pSyms;
+
+			assert(n <= m_cur_left);
+			for (size_t i = 0; i < n; i++)
+				m_pCur[i] = (T)m_values.m_values[pSyms8[i]];
+
+			advance(n);
+		}
+
+		template <uint32_t NUM_VECS>
+		sser_forceinline void store_group(T* pDst, const uint32_t* pSyms) const
+		{
+			if (!SMALL)
+			{
+				for (uint32_t vec_index = 0; vec_index < NUM_VECS; vec_index++)
+				{
+					const uint32_t syms = pSyms[vec_index];
+					pDst[vec_index * 4 + 0] = (T)m_values.m_values[syms & 0xFF];
+					pDst[vec_index * 4 + 1] = (T)m_values.m_values[(syms >> 8) & 0xFF];
+					pDst[vec_index * 4 + 2] = (T)m_values.m_values[(syms >> 16) & 0xFF];
+					pDst[vec_index * 4 + 3] = (T)m_values.m_values[syms >> 24];
+				}
+				return;
+			}
+
+			__m128i s = _mm_cvtsi32_si128(pSyms[0]);
+			if (NUM_VECS > 1)
+				s = _mm_insert_epi32(s, pSyms[NUM_VECS > 1 ? 1 : 0], 1);
+			if (NUM_VECS > 2)
+			{
+				s = _mm_insert_epi32(s, pSyms[NUM_VECS > 2 ? 2 : 0], 2);
+				s = _mm_insert_epi32(s, pSyms[NUM_VECS > 2 ? 3 : 0], 3);
+			}
+
+			// Symbols >= 16 get bit 7 set, so the shuffles return 0 for them
+			s = _mm_adds_epu8(s, _mm_set1_epi8(0x70));
+
+			const __m128i b0 = _mm_shuffle_epi8(_mm_load_si128((const __m128i*)m_values.m_planes[0]), s);
+			const __m128i b1 = _mm_shuffle_epi8(_mm_load_si128((const __m128i*)m_values.m_planes[1]), s);
+
+			if (sizeof(T) == sizeof(uint16_t))
+			{
+				const __m128i lo = _mm_unpacklo_epi8(b0, b1);
+
+				if (NUM_VECS == 1)
+					_mm_storel_epi64((__m128i*)pDst, lo);
+				else
+					_mm_storeu_si128((__m128i*)pDst, lo);
+
+				if (NUM_VECS > 2)
+					_mm_storeu_si128((__m128i*)pDst + 1, _mm_unpackhi_epi8(b0, b1));
+			}
+			else
+			{
+				const __m128i b2 = _mm_shuffle_epi8(_mm_load_si128((const __m128i*)m_values.m_planes[2]), s);
+				const __m128i b3 = _mm_shuffle_epi8(_mm_load_si128((const __m128i*)m_values.m_planes[3]), s);
+
+				const __m128i w01 = _mm_unpacklo_epi8(b0, b1), w23 = _mm_unpacklo_epi8(b2, b3);
+
+				_mm_storeu_si128((__m128i*)pDst, _mm_unpacklo_epi16(w01, w23));
+				if (NUM_VECS > 1)
+					_mm_storeu_si128((__m128i*)pDst + 1, _mm_unpackhi_epi16(w01, w23));
+
+				if (NUM_VECS > 2)
+				{
+					const __m128i hw01 = _mm_unpackhi_epi8(b0, b1), hw23 = _mm_unpackhi_epi8(b2, b3);
+
+					_mm_storeu_si128((__m128i*)pDst + 2, _mm_unpacklo_epi16(hw01, hw23));
+					_mm_storeu_si128((__m128i*)pDst + 3, _mm_unpackhi_epi16(hw01, hw23));
+				}
+			}
+		}
+
+		T* m_pCur;
+		size_t m_cur_left;
+		const vrange_value_table& m_values;
+	};
+
+	// Merges the decoded high parts of split values with their raw low bits (see vrange_split_values()) into one buffer of uint16_t's.
+	struct vrange_split_output
+	{
+		typedef uint16_t value_type;
+
+		vrange_split_output(uint16_t* pDst, size_t size, const uint8_t* pRaw, size_t raw_size, uint32_t num_raw_bits) :
+			m_pDst_start(pDst), m_pCur(pDst), m_cur_left(size), m_pRaw(pRaw), m_pRaw_end(pRaw + raw_size), m_num_raw_bits(num_raw_bits), m_block_size(num_raw_bits * 2)
+		{
+			assert((num_raw_bits >= 1) && (num_raw_bits <= cRangeMaxRawBits));
+
+			// Each half block of 8 values is num_raw_bits bytes, and every value lies within 2 bytes. The shuffle moves each value's 2 bytes into a 16-bit lane,
+			// the multiply shifts its bits to the top of the lane, then a shift by 16 - num_raw_bits right aligns it and clears the other values' bits.
+			uint8_t shuf[16];
+			uint16_t mul[8];
+			for (uint32_t j = 0; j < 8; j++)
+			{
+				const uint32_t bit_ofs = j * num_raw_bits;
+				shuf[j * 2] = (uint8_t)(bit_ofs >> 3);
+				shuf[j * 2 + 1] = (uint8_t)(((bit_ofs >> 3) + 1 < 8) ? ((bit_ofs >> 3) + 1) : 0x80);
+				mul[j] = (uint16_t)(1U << (16 - num_raw_bits - (bit_ofs & 7)));
+			}
+
+			m_shuf = _mm_loadu_si128((const __m128i*)shuf);
+			m_mul = _mm_loadu_si128((const __m128i*)mul);
+			m_raw_shift = _mm_cvtsi32_si128(16 - num_raw_bits);
+			m_high_shift = _mm_cvtsi32_si128(num_raw_bits);
+		}
+
+		uint16_t* begin_run(size_t& run_size)
+		{
+			run_size = m_cur_left;
+			return m_pCur;
+		}
+
+		void advance(size_t n)
+		{
+			assert(n <= m_cur_left);
+			m_pCur += n;
+			m_cur_left -= n;
+		}
+
+		uint32_t get_raw(size_t ofs) const
+		{
+			const uint32_t bit_ofs = (uint32_t)(ofs & 15) * m_num_raw_bits;
+			const uint8_t* p = m_pRaw + (ofs >> 4) * m_block_size + (bit_ofs >> 3);
+
+			uint32_t v = p[0];
+			if (((bit_ofs & 7) + m_num_raw_bits) > 8)
+				v |= p[1] << 8;
+
+			return (v >> (bit_ofs & 7)) & ((1U << m_num_raw_bits) - 1);
+		}
+
+		void write(const void* pSyms, size_t n)
+		{
+			const uint8_t* pSyms8 = (const uint8_t*)pSyms;
+			const size_t ofs = m_pCur - m_pDst_start;
+
+			assert(n <= m_cur_left);
+			for (size_t i = 0; i < n; i++)
+				m_pCur[i] = (uint16_t)((pSyms8[i] << m_num_raw_bits) | get_raw(ofs + i));
+
+			advance(n);
+		}
+
+		// Unpacks the 8 raw values of a half block
+		sser_forceinline __m128i unpack_half(const uint8_t* pHalf) const
+		{
+			__m128i x = _mm_shuffle_epi8(_mm_loadl_epi64((const __m128i*)pHalf), m_shuf);
+			return _mm_srl_epi16(_mm_mullo_epi16(x, m_mul), m_raw_shift);
+		}
+
+		sser_forceinline __m128i merge(__m128i syms, __m128i raw) const
+		{
+			return _mm_or_si128(_mm_sll_epi16(_mm_cvtepu8_epi16(syms), m_high_shift), raw);
+		}
+
+		template <uint32_t NUM_VECS>
+		sser_forceinline void store_group(uint16_t* pDst, const uint32_t* pSyms) const
+		{
+			const size_t ofs = pDst - m_pDst_start;
+			const uint8_t* pBlock = m_pRaw + (ofs >> 4) * m_block_size;
+
+			// The 8 byte loads may read past the last block
+			if ((pBlock + m_block_size + 8) > m_pRaw_end)
+			{
+				for (uint32_t i = 0; i < NUM_VECS * 4; i++)
+					pDst[i] = (uint16_t)((((const uint8_t*)pSyms)[i] << m_num_raw_bits) | get_raw(ofs + i));
+				return;
+			}
+
+			if (NUM_VECS == 4)
+			{
+				const __m128i syms = _mm_loadu_si128((const __m128i*)pSyms);
+				_mm_storeu_si128((__m128i*)pDst, merge(syms, unpack_half(pBlock)));
+				_mm_storeu_si128((__m128i*)pDst + 1, merge(_mm_srli_si128(syms, 8), unpack_half(pBlock + m_num_raw_bits)));
+			}
+			else if (NUM_VECS == 2)
+			{
+				const __m128i syms = _mm_loadl_epi64((const __m128i*)pSyms);
+				_mm_storeu_si128((__m128i*)pDst, merge(syms, unpack_half(pBlock + ((ofs & 8) ? m_num_raw_bits : 0))));
+			}
+			else
+			{
+				__m128i raw = unpack_half(pBlock + ((ofs & 8) ? m_num_raw_bits : 0));
+				if (ofs & 4)
+					raw = _mm_srli_si128(raw, 8);
+
+				_mm_storel_epi64((__m128i*)pDst, merge(_mm_cvtsi32_si128(pSyms[0]), raw));
+			}
+		}
+
+		uint16_t* m_pDst_start;
+		uint16_t* m_pCur;
+		size_t m_cur_left;
+		const uint8_t* m_pRaw;
+		const uint8_t* m_pRaw_end;
+		uint32_t m_num_raw_bits, m_block_size;
+		__m128i m_shuf, m_mul, m_raw_shift, m_high_shift;
+	};
+
+	// Symbol decoders for the decoding kernel: decode_group() decodes a symbol from each of NUM_VECS * 4 lanes without normalizing, returning the symbols packed 4 per uint32_t.
+	struct vrange_table_decoder
+	{
+		explicit vrange_table_decoder(const uint32_t* pTable) : m_pTable(pTable) { }
+
+		template <uint32_t NUM_VECS>
+		sser_forceinline void decode_group(__m128i* pArith_value, __m128i* pArith_length, uint32_t* pSyms) const
+		{
+			for (uint32_t vec_index = 0; vec_index < NUM_VECS; vec_index++)
+				pSyms[vec_index] = vrange_decode(pArith_value[vec_index], pArith_length[vec_index], m_pTable);
+		}
+
+		const uint32_t* m_pTable;
+	};
+
+	// Small alphabets: all the lanes' quotients are packed to 16 bits and compared against each used symbol's start, which counts the used symbols <= each
+	// quotient (its rank). The symbol, low and range are byte shuffles of the rank, so no loads depend on the lanes' state.
+	struct vrange_small_decoder
+	{
+		explicit vrange_small_decoder(const vrange_small_table& table) : m_table(table) { }
+
+		template <uint32_t NUM_VECS>
+		sser_forceinline void decode_group(__m128i* pArith_value, __m128i* pArith_length, uint32_t* pSyms) const
+		{
+			__m128i r[NUM_VECS], q[NUM_VECS];
+			for (uint32_t vec_index = 0; vec_index < NUM_VECS; vec_index++)
+			{
+				r[vec_index] = _mm_srli_epi32(pArith_length[vec_index], cRangeCodecProbBits);
+
+				// Same divide as vrange_decode(), masked for safety from corrupted data
+				q[vec_index] = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(pArith_value[vec_index]), _mm_cvtepi32_ps(r[vec_index])));
+				q[vec_index] = _mm_and_si128(q[vec_index], _mm_set1_epi32(cRangeCodecProbScale - 1));
+			}
+
+			// Lanes [0, 8) and [8, 16) as 16-bit quotients
+			const __m128i q0 = _mm_packus_epi32(q[0], q[(NUM_VECS > 1) ? 1 : 0]);
+			const __m128i q1 = (NUM_VECS > 2) ? _mm_packus_epi32(q[(NUM_VECS > 2) ? 2 : 0], q[(NUM_VECS > 2) ? 3 : 0]) : q0;
+
+			__m128i rank16[2] = { _mm_setzero_si128(), _mm_setzero_si128() };
+			for (uint32_t i = 1; i < m_table.m_num_syms; i++)
+			{
+				const __m128i bound = _mm_load_si128((const __m128i*)m_table.m_bounds[i - 1]);
+
+				rank16[0] = _mm_sub_epi16(rank16[0], _mm_cmpgt_epi16(q0, bound));
+				if (NUM_VECS > 2)
+					rank16[1] = _mm_sub_epi16(rank16[1], _mm_cmpgt_epi16(q1, bound));
+			}
+
+			const __m128i lo_plane = _mm_load_si128((const __m128i*)m_table.m_low[0]), hi_plane = _mm_load_si128((const __m128i*)m_table.m_low[1]);
+			const __m128i range_lo_plane = _mm_load_si128((const __m128i*)m_table.m_range[0]), range_hi_plane = _mm_load_si128((const __m128i*)m_table.m_range[1]);
+
+			for (uint32_t vec_index = 0; vec_index < NUM_VECS; vec_index++)
+			{
+				const __m128i rank = (vec_index & 1) ? _mm_unpackhi_epi16(rank16[vec_index >> 1], _mm_setzero_si128()) : _mm_unpacklo_epi16(rank16[vec_index >> 1], _mm_setzero_si128());
+
+				// Byte 0 of each lane selects the low byte, byte 1 the high byte, the rest are zeroed
+				const __m128i idx_lo = _mm_or_si128(rank, _mm_set1_epi32(0x80808000));
+				const __m128i idx_hi = _mm_or_si128(_mm_slli_epi32(rank, 8), _mm_set1_epi32(0x80800080));
+
+				const __m128i low_prob = _mm_or_si128(_mm_shuffle_epi8(lo_plane, idx_lo), _mm_shuffle_epi8(hi_plane, idx_hi));
+				const __m128i prob_range = _mm_or_si128(_mm_shuffle_epi8(range_lo_plane, idx_lo), _mm_shuffle_epi8(range_hi_plane, idx_hi));
+
+				pArith_value[vec_index] = _mm_sub_epi32(pArith_value[vec_index], _mm_mullo_epi32(low_prob, r[vec_index]));
+				pArith_length[vec_index] = _mm_mullo_epi32(prob_range, r[vec_index]);
+
+				const __m128i ranks = _mm_shuffle_epi8(rank, _mm_load_si128((const __m128i*)g_byte_shuffle_mask));
+				pSyms[vec_index] = _mm_cvtsi128_si32(_mm_shuffle_epi8(_mm_load_si128((const __m128i*)m_table.m_syms), ranks));
+			}
+		}
+
+		const vrange_small_table& m_table;
+	};
+
+	// Decoding kernel for NUM_VECS * 4 lanes. The state arrays are indexed with constants after unrolling, so they stay in registers.
+	// orig_size must be the total size of the output.
+	template <uint32_t NUM_VECS, typename OUTPUT, typename DECODER>
+	static bool vrange_decode_lanes(const uint8_t* pSrc_start, size_t comp_size, OUTPUT& out, size_t orig_size, const DECODER& dec, vrange_decode_stats* pStats)
+	{
+		const uint32_t num_lanes = NUM_VECS * 4;
+
+		// One iteration reads at most 8 bytes past each vector's starting position
+		const uint32_t max_iter_bytes = NUM_VECS * 8;
+
+		if (comp_size < num_lanes * 3)
+			return false;
+
+		const uint64_t start_ticks = pStats ? __rdtsc() : 0;
+
+		const uint8_t* pSrc = pSrc_start;
+		const uint8_t* pSrc_end = pSrc_start + comp_size;
+
+		__m128i arith_value[NUM_VECS], arith_length[NUM_VECS];
+
+		for (uint32_t vec_index = 0; vec_index < NUM_VECS; vec_index++)
+		{
+			__m128i x = _mm_cvtsi32_si128(read_be24(pSrc));
+			x = _mm_insert_epi32(x, read_be24(pSrc), 1);
+			x = _mm_insert_epi32(x, read_be24(pSrc), 2);
+			x = _mm_insert_epi32(x, read_be24(pSrc), 3);
+			arith_value[vec_index] = x;
+			arith_length[vec_index] = _mm_set1_epi32(cRangeCodecMaxLen);
+		}
+						
+		size_t dst_ofs = 0;
+		
+		vrange_decode_tail tail;
+
+		// Where the tail (decoding from the padded copy, or the final partial iteration) began, for the stats
+		uint64_t tail_start_ticks = 0;
+		size_t tail_start_ofs = orig_size;
+
+		// Vectorized decode
+		for ( ; ; )
+		{
+			// Store directly into the current segment while whole groups fit
+			size_t run_size;
+			typename OUTPUT::value_type* pRun = out.begin_run(run_size);
+
+			const size_t run_start = dst_ofs;
+			const size_t run_end = dst_ofs + (run_size - (run_size % num_lanes));
+
+			for ( ; ((dst_ofs + num_lanes) <= run_end) && (pSrc + max_iter_bytes) <= pSrc_end; dst_ofs += num_lanes)
+			{
+				uint32_t syms[NUM_VECS];
+				dec.template decode_group<NUM_VECS>(arith_value, arith_length, syms);
+
+				out.template store_group<NUM_VECS>(pRun, syms);
+				pRun += num_lanes;
+
+				for (uint32_t vec_index = 0; vec_index < NUM_VECS; vec_index++)
+					vrange_normalize(arith_value[vec_index], arith_length[vec_index], pSrc);
+			}
+
+			out.advance(dst_ofs - run_start);
+
+			const bool done = (dst_ofs + num_lanes) > orig_size;
+			const bool needs_tail = (pSrc + max_iter_bytes) > pSrc_end;
+
+			if ((pStats) && (!tail.m_active) && ((done) || (needs_tail)))
+			{
+				tail_start_ticks = __rdtsc();
+				tail_start_ofs = dst_ofs;
+			}
+
+			if (done)
+				break;
+
+			if (needs_tail)
+			{
+				if (!tail.begin(pSrc, pSrc_end, pSrc_start))
+					return false;
+				continue;
+			}
+
+			// The next group straddles a segment boundary
+			uint32_t group_syms[NUM_VECS];
+			dec.template decode_group<NUM_VECS>(arith_value, arith_length, group_syms);
+
+			for (uint32_t vec_index = 0; vec_index < NUM_VECS; vec_index++)
+				vrange_normalize(arith_value[vec_index], arith_length[vec_index], pSrc);
+
+			out.write(group_syms, num_lanes);
+			dst_ofs += num_lanes;
+		}
+
+		// Final partial iteration: decoding a symbol only needs the state normalized by the previous iteration, so no input is read. 
+		// The unused lanes decode garbage into a bounce buffer that's never copied out.
+		const size_t num_left = orig_size - dst_ofs;
+		if (num_left)
+		{
+			uint32_t last_syms[NUM_VECS] = { 0 };
+			dec.template decode_group<NUM_VECS>(arith_value, arith_length, last_syms);
+
+			// num_left is always < num_lanes, the clamp tells the compiler so
+			out.write(last_syms, std::min<size_t>(num_left, num_lanes));
+		}
+
+		size_t bytes_read = tail.get_bytes_read(pSrc, pSrc_start);
+		if (bytes_read > comp_size)
+			return false;
+
+		if (pStats)
+		{
+			pStats->m_vector_ticks += tail_start_ticks - start_ticks;
+			pStats->m_tail_ticks += __rdtsc() - tail_start_ticks;
+			pStats->m_total_calls++;
+			pStats->m_total_syms += orig_size;
+			pStats->m_tail_syms += orig_size - tail_start_ofs;
+			pStats->m_total_bytes_read += bytes_read;
+		}
+
+		return true;
+	}
+
+	template <typename OUTPUT, typename DECODER>
+	static bool vrange_decode_output(const uint8_t* pSrc_start, size_t comp_size, OUTPUT& out, size_t orig_size, const DECODER& dec, uint32_t num_lanes, vrange_decode_stats* pStats)
+	{
+		switch (num_lanes)
+		{
+		case 4: return vrange_decode_lanes<1>(pSrc_start, comp_size, out, orig_size, dec, pStats);
+		case 8: return vrange_decode_lanes<2>(pSrc_start, comp_size, out, orig_size, dec, pStats);
+		case 16: return vrange_decode_lanes<4>(pSrc_start, comp_size, out, orig_size, dec, pStats);
+		default: break;
+		}
+
+		return false;
+	}
+
+	bool vrange_decode_iov(const uint8_t* pSrc_start, size_t comp_size, const vrange_iovec* pDst_segs, uint32_t num_dst_segs, const uint32_t* pDec_table, uint32_t num_lanes, vrange_decode_stats* pStats)
+	{
+		size_t orig_size = 0;
+		for (uint32_t i = 0; i < num_dst_segs; i++)
+			orig_size += pDst_segs[i].m_size;
+
+		vrange_output_segs out(pDst_segs, num_dst_segs);
+		return vrange_decode_output(pSrc_start, comp_size, out, orig_size, vrange_table_decoder(pDec_table), num_lanes, pStats);
+	}
+
+	bool vrange_decode(const uint8_t *pSrc_start, size_t comp_size, uint8_t *pDst_start, size_t orig_size, const uint32_t *pDec_table, uint32_t num_lanes, vrange_decode_stats* pStats)
+	{
+		const vrange_iovec seg = { pDst_start, orig_size };
+		return vrange_decode_iov(pSrc_start, comp_size, &seg, 1, pDec_table, num_lanes, pStats);
+	}
+
+	bool vrange_init_small_table(uint32_t num_syms, const uint32_t* pScaled_cum_prob, vrange_small_table& table)
+	{
+		table.clear();
+
+		uint32_t num_used = 0;
+		for (uint32_t sym = 0; sym < num_syms; sym++)
+		{
+			const uint32_t low = pScaled_cum_prob[sym];
+			const uint32_t range = pScaled_cum_prob[sym + 1] - low;
+			if (!range)
+				continue;
+
+			if (num_used == cRangeSmallAlphabetMaxSyms)
+			{
+				table.clear();
+				return false;
+			}
+
+			// The first used symbol starts at 0, so it has no bound
+			if (num_used)
+			{
+				for (uint32_t i = 0; i < 8; i++)
+					table.m_bounds[num_used - 1][i] = (int16_t)(low - 1);
+			}
+
+			table.m_syms[num_used] = (uint8_t)sym;
+			table.m_low[0][num_used] = (uint8_t)low;
+			table.m_low[1][num_used] = (uint8_t)(low >> 8);
+			table.m_range[0][num_used] = (uint8_t)range;
+			table.m_range[1][num_used] = (uint8_t)(range >> 8);
+
+			num_used++;
+		}
+
+		if (!num_used)
+			return false;
+
+		table.m_num_syms = num_used;
+		return true;
+	}
+
+	bool vrange_decode_small(const uint8_t* pSrc_start, size_t comp_size, uint8_t* pDst_start, size_t orig_size, const vrange_small_table& table, uint32_t num_lanes, vrange_decode_stats* pStats)
+	{
+		if (!table.m_num_syms)
+			return false;
+
+		const vrange_iovec seg = { pDst_start, orig_size };
+		vrange_output_segs out(&seg, 1);
+		return vrange_decode_output(pSrc_start, comp_size, out, orig_size, vrange_small_decoder(table), num_lanes, pStats);
+	}
+
+	bool vrange_decode_ring(const uint8_t* pSrc_start, size_t comp_size, uint8_t* pRing, size_t ring_size, size_t ring_ofs, size_t orig_size, const uint32_t* pDec_table, uint32_t num_lanes, vrange_decode_stats* pStats)
+	{
+		if ((ring_ofs >= ring_size) || (orig_size > ring_size))
+			return false;
+
+		const size_t first_size = std::min(orig_size, ring_size - ring_ofs);
+
+		const vrange_iovec segs[2] = { { pRing + ring_ofs, first_size }, { pRing, orig_size - first_size } };
+		return vrange_decode_iov(pSrc_start, comp_size, segs, 2, pDec_table, num_lanes, pStats);
+	}
+
+	template <typename T>
+	static bool init_value_table(vrange_value_table& table, const T* pValues, uint32_t num_values)
+	{
+		table.clear();
+
+		if ((!num_values) || (num_values > 256))
+			return false;
+
+		for (uint32_t i = 0; i < num_values; i++)
+		{
+			table.m_values[i] = pValues[i];
+
+			if (i < 16)
+			{
+				for (uint32_t k = 0; k < 4; k++)
+					table.m_planes[k][i] = (uint8_t)((uint32_t)pValues[i] >> (k * 8));
+			}
+		}
+
+		table.m_num_values = num_values;
+		return true;
+	}
+
+	bool vrange_value_table::init(const uint16_t* pValues, uint32_t num_values)
+	{
+		return init_value_table(*this, pValues, num_values);
+	}
+
+	bool vrange_value_table::init(const uint32_t* pValues, uint32_t num_values)
+	{
+		return init_value_table(*this, pValues, num_values);
+	}
+
+	template <typename T>
+	static bool vrange_decode_values_output(const uint8_t* pSrc_start, size_t comp_size, T* pDst_start, size_t orig_size, const uint32_t* pDec_table, const vrange_value_table& values, uint32_t num_lanes, vrange_decode_stats* pStats)
+	{
+		if (!values.m_num_values)
+			return false;
+
+		if (values.m_num_values <= 16)
+		{
+			vrange_value_output<T, true> out(pDst_start, orig_size, values);
+			return vrange_decode_output(pSrc_start, comp_size, out, orig_size, vrange_table_decoder(pDec_table), num_lanes, pStats);
+		}
+
+		vrange_value_output<T, false> out(pDst_start, orig_size, values);
+		return vrange_decode_output(pSrc_start, comp_size, out, orig_size, vrange_table_decoder(pDec_table), num_lanes, pStats);
+	}
+
+	bool vrange_decode_values(const uint8_t* pSrc_start, size_t comp_size, uint16_t* pDst_start, size_t orig_size, const uint32_t* pDec_table, const vrange_value_table& values, uint32_t num_lanes, vrange_decode_stats* pStats)
+	{
+		return vrange_decode_values_output(pSrc_start, comp_size, pDst_start, orig_size, pDec_table, values, num_lanes, pStats);
+	}
+
+	bool vrange_decode_values(const uint8_t* pSrc_start, size_t comp_size, uint32_t* pDst_start, size_t orig_size, const uint32_t* pDec_table, const vrange_value_table& values, uint32_t num_lanes, vrange_decode_stats* pStats)
+	{
+		return vrange_decode_values_output(pSrc_start, comp_size, pDst_start, orig_size, pDec_table, values, num_lanes, pStats);
+	}
+
+	bool vrange_split_values(const uint16_t* pValues, size_t num_values, uint32_t num_raw_bits, uint8_t* pHigh, uint8_t* pRaw)
+	{
+		if ((num_raw_bits < 1) || (num_raw_bits > cRangeMaxRawBits))
+			return false;
+
+		const size_t raw_size = vrange_get_raw_bits_size(num_values, num_raw_bits);
+		memset(pRaw, 0, raw_size);
+
+		const uint32_t block_size = num_raw_bits * 2;
+		const uint32_t raw_mask = (1U << num_raw_bits) - 1;
+
+		for (size_t i = 0; i < num_values; i++)
+		{
+			const uint32_t v = pValues[i];
+			if ((v >> num_raw_bits) > 255)
+				return false;
+
+			pHigh[i] = (uint8_t)(v >> num_raw_bits);
+
+			const uint32_t bit_ofs = (uint32_t)(i & 15) * num_raw_bits;
+			uint8_t* p = pRaw + (i >> 4) * block_size + (bit_ofs >> 3);
+
+			const uint32_t bits = (v & raw_mask) << (bit_ofs & 7);
+			p[0] |= (uint8_t)bits;
+			if (bits > 0xFF)
+				p[1] |= (uint8_t)(bits >> 8);
+		}
+
+		return true;
+	}
+
+	uint32_t vrange_choose_num_raw_bits(const uint16_t* pValues, size_t num_values)
+	{
+		uint32_t max_value = 0;
+		for (size_t i = 0; i < num_values; i++)
+			max_value = std::max<uint32_t>(max_value, pValues[i]);
+
+		uint32_t min_raw_bits = 1;
+		while ((max_value >> min_raw_bits) > 255)
+			min_raw_bits++;
+
+		if (min_raw_bits > cRangeMaxRawBits)
+			return 0;
+
+		uint32_t best_raw_bits = 0;
+		uint64_t best_cost = UINT64_MAX;
+
+		uint32_vec hist(256), scaled_cum_prob, sym_costs;
+
+		for (uint32_t num_raw_bits = min_raw_bits; num_raw_bits <= cRangeMaxRawBits; num_raw_bits++)
+		{
+			std::fill(hist.begin(), hist.end(), 0);
+			for (size_t i = 0; i < num_values; i++)
+				hist[pValues[i] >> num_raw_bits]++;
+
+			uint32_vec freq(hist);
+			if (!vrange_create_cum_probs(scaled_cum_prob, freq))
+				continue;
+
+			vrange_get_sym_costs(256, scaled_cum_prob, sym_costs);
+
+			const uint64_t high_cost = vrange_get_hist_cost(&hist[0], &sym_costs[0]);
+			if (high_cost == UINT64_MAX)
+				continue;
+
+			const uint64_t cost = high_cost + ((uint64_t)vrange_get_raw_bits_size(num_values, num_raw_bits) << (3 + cRangeCodecCostFracBits));
+			if (cost < best_cost)
+			{
+				best_cost = cost;
+				best_raw_bits = num_raw_bits;
+			}
+		}
+
+		return best_raw_bits;
+	}
+
+	bool vrange_decode_split(const uint8_t* pSrc_start, size_t comp_size, const uint8_t* pRaw, size_t raw_size, uint16_t* pDst, size_t num_values, uint32_t num_raw_bits, 
+		const uint32_t* pDec_table, uint32_t num_lanes, vrange_decode_stats* pStats)
+	{
+		if ((num_raw_bits < 1) || (num_raw_bits > cRangeMaxRawBits) || (raw_size != vrange_get_raw_bits_size(num_values, num_raw_bits)))
+			return false;
+
+		vrange_split_output out(pDst, num_values, pRaw, raw_size, num_raw_bits);
+		return vrange_decode_output(pSrc_start, comp_size, out, num_values, vrange_table_decoder(pDec_table), num_lanes, pStats);
+	}
+
+
+	void vrange_rans_encode(const uint8_t* pData, size_t data_size, uint8_vec& enc_buf, const uint32_vec& scaled_cum_prob)
+	{
+		uint32_t states[LANES];
+		for (uint32_t lane = 0; lane < LANES; lane++)
+			states[lane] = cRansL;
+
+		// rANS encodes in reverse, so the words are written from the end of the buffer backwards. Each symbol emits at most 1 word.
+		const size_t max_size = LANES * sizeof(uint32_t) + data_size * sizeof(uint16_t);
+		enc_buf.resize(max_size);
+
+		uint8_t* pDst = &enc_buf[0] + max_size;
+
+		for (size_t i = data_size; i-- > 0; )
+		{
+			const uint32_t sym = pData[i];
+			const uint32_t lane = i & LANE_MASK;
+
+			const uint32_t start = scaled_cum_prob[sym];
+			const uint32_t freq = scaled_cum_prob[sym + 1] - start;
+			assert(freq && (freq < cRangeCodecProbScale));
+
+			uint32_t x = states[lane];
+
+			// x_max = ((cRansL >> cRangeCodecProbBits) << 16) * freq
+			if (x >= (freq << (32 - cRangeCodecProbBits)))
+			{
+				pDst -= 2;
+				pDst[0] = (uint8_t)x;
+				pDst[1] = (uint8_t)(x >> 8);
+				x >>= 16;
+			}
+
+			states[lane] = ((x / freq) << cRangeCodecProbBits) + (x % freq) + start;
+		}
+
+		for (uint32_t lane = LANES; lane-- > 0; )
+		{
+			pDst -= 4;
+			for (uint32_t j = 0; j < 4; j++)
+				pDst[j] = (uint8_t)(states[lane] >> (j * 8));
+		}
+
+		const size_t enc_size = (&enc_buf[0] + max_size) - pDst;
+		memmove(&enc_buf[0], pDst, enc_size);
+		enc_buf.resize(enc_size);
+	}
+
+	bool vrange_rans_decode(const uint8_t* pSrc_start, size_t comp_size, uint8_t* pDst_start, size_t orig_size, const uint32_t* pDec_table)
+	{
+		if (comp_size < LANES * sizeof(uint32_t))
+			return false;
+
+		const uint8_t* pSrc = pSrc_start;
+		const uint8_t* pSrc_end = pSrc_start + comp_size;
+
+		__m128i x0 = _mm_loadu_si128((const __m128i*)pSrc);
+		__m128i x1 = _mm_loadu_si128((const __m128i*)(pSrc + 16));
+		__m128i x2 = _mm_loadu_si128((const __m128i*)(pSrc + 32));
+		__m128i x3 = _mm_loadu_si128((const __m128i*)(pSrc + 48));
+		pSrc += LANES * sizeof(uint32_t);
+
+		size_t dst_ofs = 0;
+		uint32_t* pDst32 = (uint32_t*)pDst_start;
+
+		vrange_decode_tail tail;
+
+		// Vectorized decode
+		for ( ; ; )
+		{
+			for ( ; ((dst_ofs + LANES) <= orig_size) && (pSrc + 8 * 4) <= pSrc_end; dst_ofs += LANES)
+			{
+				pDst32[0] = vrans_decode(x0, pDec_table);
+				pDst32[1] = vrans_decode(x1, pDec_table);
+				pDst32[2] = vrans_decode(x2, pDec_table);
+				pDst32[3] = vrans_decode(x3, pDec_table);
+
+				pDst32 += 4;
+
+				vrans_normalize(x0, pSrc);
+				vrans_normalize(x1, pSrc);
+				vrans_normalize(x2, pSrc);
+				vrans_normalize(x3, pSrc);
+			}
+
+			if ((dst_ofs == orig_size) || (((dst_ofs + LANES) > orig_size) && ((pSrc + 8 * 4) <= pSrc_end)))
+				break;
+
+			if (!tail.begin(pSrc, pSrc_end, pSrc_start))
+				return false;
+		}
+
+		// Final partial iteration. Unlike the range coder, every lane must end fully renormalized, so the used lanes are decoded and normalized while
+		// the unused lanes keep their states. Those states are already normalized, so they don't consume any input.
+		const size_t num_left = orig_size - dst_ofs;
+		if (num_left)
+		{
+			const __m128i num_left_vec = _mm_set1_epi32((int)num_left);
+			const __m128i lane_index0 = _mm_setr_epi32(0, 1, 2, 3), four = _mm_set1_epi32(4);
+			const __m128i lane_index1 = _mm_add_epi32(lane_index0, four), lane_index2 = _mm_add_epi32(lane_index1, four), lane_index3 = _mm_add_epi32(lane_index2, four);
+
+			uint32_t last_syms[4];
+			__m128i prev_x;
+
+			prev_x = x0; last_syms[0] = vrans_decode(x0, pDec_table); x0 = _mm_blendv_epi8(prev_x, x0, _mm_cmpgt_epi32(num_left_vec, lane_index0));
+			prev_x = x1; last_syms[1] = vrans_decode(x1, pDec_table); x1 = _mm_blendv_epi8(prev_x, x1, _mm_cmpgt_epi32(num_left_vec, lane_index1));
+			prev_x = x2; last_syms[2] = vrans_decode(x2, pDec_table); x2 = _mm_blendv_epi8(prev_x, x2, _mm_cmpgt_epi32(num_left_vec, lane_index2));
+			prev_x = x3; last_syms[3] = vrans_decode(x3, pDec_table); x3 = _mm_blendv_epi8(prev_x, x3, _mm_cmpgt_epi32(num_left_vec, lane_index3));
+
+			vrans_normalize(x0, pSrc);
+			vrans_normalize(x1, pSrc);
+			vrans_normalize(x2, pSrc);
+			vrans_normalize(x3, pSrc);
+
+			memcpy(pDst_start + dst_ofs, last_syms, num_left);
+		}
+
+		// The encoder starts every lane at cRansL, so a valid stream decodes back to it
+		const __m128i l = _mm_set1_epi32(cRansL);
+		const __m128i all_equal = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi32(x0, l), _mm_cmpeq_epi32(x1, l)), _mm_and_si128(_mm_cmpeq_epi32(x2, l), _mm_cmpeq_epi32(x3, l)));
+		if (_mm_movemask_epi8(all_equal) != 0xFFFF)
+			return false;
+
+		return tail.get_bytes_read(pSrc, pSrc_start) == comp_size;
+	}
+
+} // namespace sserangecoder
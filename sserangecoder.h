@@ -1,13 +1,7 @@
 // sserangecoder.h
 // SSE 4.1 Interleaved Range Coding example with an 8-bit alphabet, Richard Geldreich, Jr., public domain (see full text at unlicense.org)
 #pragma once
-#include <stdlib.h>
-#include <stdio.h>
-#include <ctype.h>
-#include <stdint.h>
-#include <vector>
-#include <assert.h>
-#include <memory.h>
+#include "sserangebase.h"
 
 #ifdef _MSC_VER
 #include <intrin.h>
@@ -17,50 +11,31 @@
 
 #include <smmintrin.h>
 
-#ifndef _MSC_VER
-#define sser_forceinline __attribute__((always_inline))
-#else
-#define sser_forceinline __forceinline
-#endif
+#include "sserangescalar.h"
 
 namespace sserangecoder
 {
-	typedef std::vector<uint8_t> uint8_vec;
-	typedef std::vector<uint32_t> uint32_vec;
-
-	template <typename S> inline S clamp(S value, S low, S high) { return (value < low) ? low : ((value > high) ? high : value); }
-	template <typename T> inline void clear_obj(T& obj) { memset(&obj, 0, sizeof(obj)); }
-	
-	const uint32_t cRangeCodecMinSyms = 2, cRangeCodecMaxSyms = 256;
-	const uint32_t cRangeCodecMinLen = 0x00010000U, cRangeCodecMaxLen = 0x00FFFFFFU;
-	const uint32_t cRangeCodecProbBits = 12;
-	const uint32_t cRangeCodecProbScale = 1 << cRangeCodecProbBits;
+	// Lookup tables used by the vectorized decoders. They're generated at compile time and stored once (16-byte aligned, read-only) in sserangecoder.cpp.
+	// vrange_normalize() tables, indexed by a lane mask: bit j set = lane j needs 1 byte, bit j+4 set = lane j needs 2 bytes
+	extern const uint8_t g_num_bytes[256];
+	extern const uint8_t g_shift_shuf[256][16];
+	extern const uint8_t g_dist_shuf[256][16];
 
-	const uint32_t LANES = 16;
-	const uint32_t LANE_MASK = LANES - 1;
+	// Gathers the low byte of each dword
+	extern const uint8_t g_byte_shuffle_mask[16];
 
-	static uint32_t g_num_bytes[256];
-	static __m128i g_shift_shuf[256];
-	static __m128i g_dist_shuf[256];
-	static __m128i g_byte_shuffle_mask;
+	// vrans_normalize() tables, indexed by a lane mask: bit j set = lane j needs a 16-bit word
+	extern const uint8_t g_rans_word_shuf[16][16];
+	extern const uint8_t g_rans_num_bytes[16];
 
-	// Important: vrange_init() MUST be called sometime before utilizing the encoder or decoder.
+	// No longer required: the lookup tables are generated at compile time. Kept so existing callers still compile.
 	void vrange_init();
-	
-	// Scalar range encoder
-	class range_enc
+
+	// Scalar range encoder core. BUF receives the coded bytes: it needs push_back(), size() and operator[] (for carry propagation), like uint8_vec.
+	template <typename BUF>
+	class range_enc_base
 	{
 	public:
-		range_enc()	{ init(); }
-
-		void init()
-		{
-			m_arith_base = 0;
-			m_arith_length = cRangeCodecMaxLen;
-			m_buf.resize(0);
-			m_buf.reserve(4096);
-		}
-
 		inline void enc_val(uint32_t low_prob, uint32_t high_prob)
 		{
 			assert((low_prob < high_prob) && (high_prob <= cRangeCodecProbScale));
@@ -81,14 +56,42 @@ namespace sserangecoder
 				renorm_enc_interval();
 		}
 
-		void flush();
-		
-		const uint8_vec& get_buf() const { return m_buf; }
-		uint8_vec& get_buf() { return m_buf; }
+		void flush()
+		{
+			uint32_t orig_base = m_arith_base;
 
-	private:
+			if (m_arith_length > 2 * cRangeCodecMinLen)
+			{
+				m_arith_base = (m_arith_base + cRangeCodecMinLen) & cRangeCodecMaxLen;
+				m_arith_length = (cRangeCodecMinLen >> 1);
+			}
+			else
+			{
+				m_arith_base = (m_arith_base + (cRangeCodecMinLen >> 1)) & cRangeCodecMaxLen;
+				m_arith_length = (cRangeCodecMinLen >> 9);
+			}
+
+			if (orig_base > m_arith_base)
+				propagate_carry();
+
+			renorm_enc_interval();
+
+			while (m_buf.size() < 3)
+				m_buf.push_back(0);
+
+			for (uint32_t i = 0; i < 2; i++)
+				m_buf.push_back(0);
+		}
+
+	protected:
 		uint32_t m_arith_base, m_arith_length;
-		uint8_vec m_buf;
+		BUF m_buf;
+
+		void init_state()
+		{
+			m_arith_base = 0;
+			m_arith_length = cRangeCodecMaxLen;
+		}
 
 		inline void propagate_carry()
 		{
@@ -131,6 +134,23 @@ namespace sserangecoder
 		}
 	};
 
+	// Scalar range encoder
+	class range_enc : public range_enc_base<uint8_vec>
+	{
+	public:
+		range_enc()	{ init(); }
+
+		void init()
+		{
+			init_state();
+			m_buf.resize(0);
+			m_buf.reserve(4096);
+		}
+
+		const uint8_vec& get_buf() const { return m_buf; }
+		uint8_vec& get_buf() { return m_buf; }
+	};
+
 	// Scalar range decoder
 	class range_dec
 	{
@@ -159,6 +179,8 @@ namespace sserangecoder
 			pBuf += 3;
 		}
 
+		// Keeps the divide and the renormalization loop: with a single dependency chain they're faster than vrange_decode_scalar()'s reciprocal and
+		// vrange_normalize_scalar()'s branch free loads.
 		inline uint32_t dec_sym(const uint32_t* pTable, const uint8_t*& pCur_buf)
 		{
 			const uint32_t r = (m_arith_length >> cRangeCodecProbBits);
@@ -194,11 +216,45 @@ namespace sserangecoder
 		uint32_t m_arith_length, m_arith_value;
 	};
 
+	// Output segment for vrange_decode_iov() (the same layout as POSIX struct iovec)
+	struct vrange_iovec
+	{
+		uint8_t* m_pData;
+		size_t m_size;
+	};
+
+	// Input fragment for the scatter-gather encoding functions
+	struct vrange_const_iovec
+	{
+		const uint8_t* m_pData;
+		size_t m_size;
+	};
+
+	// Accumulates the byte histogram of pData into pHist[256] (pHist is not cleared first)
+	void vrange_histogram(const uint8_t* pData, size_t data_size, uint32_t* pHist);
+
+	// Same, for the concatenation of a list of fragments
+	void vrange_histogram(const vrange_const_iovec* pSegs, uint32_t num_segs, uint32_t* pHist);
+
 	// Create lookup table for the vectorized range decoder
 	void vrange_init_table(uint32_t num_syms, const uint32_vec& scaled_cum_prob, uint32_vec& table);
+
+	// pScaled_cum_prob has num_syms + 1 entries, pTable receives cRangeCodecProbScale entries
+	void vrange_init_table(uint32_t num_syms, const uint32_t* pScaled_cum_prob, uint32_t* pTable);
 	
 	// freq may be modified if the number of used syms was 1
 	bool vrange_create_cum_probs(uint32_vec& scaled_cum_prob, uint32_vec& freq);
+
+	// pFreq has num_syms entries, pScaled_cum_prob receives num_syms + 1 entries
+	bool vrange_create_cum_probs(uint32_t* pScaled_cum_prob, uint32_t* pFreq, uint32_t num_syms);
+
+	// The quantizer vrange_create_cum_probs() used before it minimized the coded size: proportional scaling, with the remainder given to the most probable symbol.
+	// Both give different models for the same frequencies, so decoders which rebuild the model from stored frequencies need this one for older data.
+	bool vrange_create_cum_probs_legacy(uint32_t* pScaled_cum_prob, uint32_t* pFreq, uint32_t num_syms);
+
+	// Returns true if pScaled_cum_prob (num_syms + 1 entries) is a valid model: it starts at 0, ends at cRangeCodecProbScale, never decreases, and no
+	// symbol has the whole range. Symbols may have a zero frequency, the encoders fail if they occur.
+	bool vrange_is_valid_model(const uint32_t* pScaled_cum_prob, uint32_t num_syms);
 	
 	// Decode 4 symbols from 4 range encoded streams using the specified lookup table
 	static sser_forceinline uint32_t vrange_decode(__m128i& arith_value, __m128i& arith_length, const uint32_t* pTable)
@@ -229,7 +285,7 @@ namespace sserangecoder
 		e = _mm_insert_epi32(e, encoded_val3, 2);
 		e = _mm_insert_epi32(e, encoded_val4, 3);
 
-		__m128i bytes = _mm_shuffle_epi8(e, g_byte_shuffle_mask);
+		__m128i bytes = _mm_shuffle_epi8(e, _mm_load_si128((const __m128i*)g_byte_shuffle_mask));
 		uint32_t syms = _mm_cvtsi128_si32(bytes);
 
 		__m128i low_prob = _mm_and_si128(_mm_srli_epi32(e, 8), _mm_set1_epi32(cRangeCodecProbScale - 1));
@@ -253,8 +309,8 @@ namespace sserangecoder
 
 		__m128i src_bytes = _mm_loadl_epi64((const __m128i*)pSrc);
 
-		__m128i shift = g_shift_shuf[msk_bits];
-		__m128i dist = g_dist_shuf[msk_bits];
+		__m128i shift = _mm_load_si128((const __m128i*)g_shift_shuf[msk_bits]);
+		__m128i dist = _mm_load_si128((const __m128i*)g_dist_shuf[msk_bits]);
 
 		arith_value = _mm_or_si128(_mm_shuffle_epi8(arith_value, shift), _mm_shuffle_epi8(src_bytes, dist));
 		arith_length = _mm_shuffle_epi8(arith_length, shift);
@@ -262,10 +318,366 @@ namespace sserangecoder
 		pSrc += g_num_bytes[msk_bits];
 	}
 
-	// Encodes file_data to 16 interleaved range coded streams
-	void vrange_encode(const uint8_vec& file_data, uint8_vec& enc_buf, const uint32_vec& scaled_cum_prob);
+	// rANS states are kept in [cRansL, cRansL << 16) and renormalized by reading/writing 16-bit words
+	const uint32_t cRansL = 1U << 16;
+
+	// Decode 4 symbols from 4 rANS streams using the same lookup table as vrange_decode()
+	static sser_forceinline uint32_t vrans_decode(__m128i& x, const uint32_t* pTable)
+	{
+		__m128i slot = _mm_and_si128(x, _mm_set1_epi32(cRangeCodecProbScale - 1));
+
+		uint32_t encoded_val1 = pTable[_mm_cvtsi128_si32(slot)];
+		uint32_t encoded_val2 = pTable[_mm_extract_epi32(slot, 1)];
+		uint32_t encoded_val3 = pTable[_mm_extract_epi32(slot, 2)];
+		uint32_t encoded_val4 = pTable[_mm_extract_epi32(slot, 3)];
+
+		__m128i e = _mm_cvtsi32_si128(encoded_val1);
+		e = _mm_insert_epi32(e, encoded_val2, 1);
+		e = _mm_insert_epi32(e, encoded_val3, 2);
+		e = _mm_insert_epi32(e, encoded_val4, 3);
+
+		__m128i bytes = _mm_shuffle_epi8(e, _mm_load_si128((const __m128i*)g_byte_shuffle_mask));
+		uint32_t syms = _mm_cvtsi128_si32(bytes);
+
+		__m128i start = _mm_and_si128(_mm_srli_epi32(e, 8), _mm_set1_epi32(cRangeCodecProbScale - 1));
+		__m128i freq = _mm_srli_epi32(e, 20);
+
+		// x = freq * (x >> 12) + slot - start
+		x = _mm_add_epi32(_mm_mullo_epi32(freq, _mm_srli_epi32(x, cRangeCodecProbBits)), _mm_sub_epi32(slot, start));
+
+		return syms;
+	}
+
+	// Normalize 4 rANS decoders, fetching a 16-bit word for each lane whose state fell below cRansL (up to 8 total bytes) from pSrc
+	static sser_forceinline void vrans_normalize(__m128i& x, const uint8_t*& pSrc)
+	{
+		// Unsigned x < cRansL
+		__m128i cmp_mask = _mm_cmpeq_epi32(_mm_min_epu32(x, _mm_set1_epi32(cRansL - 1)), x);
+		uint32_t msk_bits = _mm_movemask_ps(_mm_castsi128_ps(cmp_mask));
+
+		__m128i words = _mm_shuffle_epi8(_mm_loadl_epi64((const __m128i*)pSrc), _mm_load_si128((const __m128i*)g_rans_word_shuf[msk_bits]));
+
+		x = _mm_blendv_epi8(x, _mm_or_si128(_mm_slli_epi32(x, 16), words), cmp_mask);
+
+		pSrc += g_rans_num_bytes[msk_bits];
+	}
+
+	// Symbol costs are in bits, in fixed point with cRangeCodecCostFracBits fractional bits
+	const uint32_t cRangeCodecCostFracBits = 16;
+	const uint32_t cRangeCodecInvalidSymCost = UINT32_MAX;
+
+	// Computes the cost of coding each symbol using the specified scaled_cum_prob table. sym_costs always gets cRangeCodecMaxSyms entries, 
+	// symbols which can't be coded (a scaled frequency of 0, or beyond num_syms) get cRangeCodecInvalidSymCost.
+	void vrange_get_sym_costs(uint32_t num_syms, const uint32_vec& scaled_cum_prob, uint32_vec& sym_costs);
+
+	// Returns the total cost (in fixed point bits) of coding symbols with the specified 256 entry histogram, or UINT64_MAX if a used symbol can't be coded.
+	uint64_t vrange_get_hist_cost(const uint32_t* pHist, const uint32_t* pSym_costs);
+
+	// Optional statistics filled in by the encoders and decoders when passed a non-NULL pointer (with NULL nothing is measured). Times are __rdtsc() ticks,
+	// read once per phase rather than per symbol, so the stats are cheap enough to leave enabled in production. Everything accumulates, so one struct
+	// can collect a whole stream or many calls; clear() it before a call for per call values.
+	struct vrange_encode_stats
+	{
+		vrange_encode_stats() { clear(); }
+
+		void clear()
+		{
+			m_histogram_ticks = 0;
+			m_model_ticks = 0;
+			m_lane_encode_ticks = 0;
+			m_swizzle_ticks = 0;
+			m_output_ticks = 0;
+			m_total_calls = 0;
+			m_total_syms = 0;
+			m_total_comp_bytes = 0;
+
+			for (uint32_t i = 0; i < LANES; i++)
+				m_lane_renorm_bytes[i] = 0;
+		}
+
+		// Computing histograms and creating models (only done by the blocked encoder, vrange_encode() is given a model)
+		uint64_t m_histogram_ticks;
+		uint64_t m_model_ticks;
+
+		// Range coding each lane, then swizzling the lanes' bytes into decoding order
+		uint64_t m_lane_encode_ticks;
+		uint64_t m_swizzle_ticks;
+
+		// Copying the encoded data to a uint8_vec (only the vrange_encode() overloads returning a vector)
+		uint64_t m_output_ticks;
+
+		uint64_t m_total_calls;
+		uint64_t m_total_syms;
+		uint64_t m_total_comp_bytes;
+
+		// Bytes output by each lane's renormalizations while coding symbols (not including the final flush). With fewer than LANES lanes only the
+		// first num_lanes entries are used.
+		uint64_t m_lane_renorm_bytes[LANES];
+	};
+
+	struct vrange_decode_stats
+	{
+		vrange_decode_stats() { clear(); }
+
+		void clear()
+		{
+			m_table_ticks = 0;
+			m_vector_ticks = 0;
+			m_tail_ticks = 0;
+			m_total_calls = 0;
+			m_total_syms = 0;
+			m_tail_syms = 0;
+			m_total_bytes_read = 0;
+		}
+
+		// Building decoding tables (only done by the blocked decoder, vrange_decode() is given a table)
+		uint64_t m_table_ticks;
+
+		// The vector loop reading straight from the input
+		uint64_t m_vector_ticks;
+
+		// The tail: the last iterations, which read from a zero padded copy of the input's last bytes, and the final partial iteration.
+		// Every symbol is decoded by the vector code, there's no scalar tail loop.
+		uint64_t m_tail_ticks;
+
+		uint64_t m_total_calls;
+		uint64_t m_total_syms;
+		uint64_t m_tail_syms;
+		uint64_t m_total_bytes_read;
+
+		double get_tail_fraction() const { return m_total_syms ? (double)m_tail_syms / (double)m_total_syms : 0.0f; }
+	};
+
+	// Returns the estimated size of vrange_encode()'s output (including the per-lane overhead) without encoding anything, or SIZE_MAX if a used symbol can't be coded.
+	size_t vrange_estimate_encoded_size(const uint8_t* pData, size_t data_size, const uint32_t* pSym_costs, uint32_t num_lanes = LANES);
+
+	// Encodes file_data to num_lanes (4, 8 or 16) interleaved range coded streams. The lane count isn't stored, the decoder must be given the same value.
+	// enc_buf is left empty if the data contains a symbol the model can't code (a zero frequency). Reuses a thread local vrange_encoder_context.
+	void vrange_encode(const uint8_vec& file_data, uint8_vec& enc_buf, const uint32_vec& scaled_cum_prob, uint32_t num_lanes = LANES);
+	void vrange_encode(const uint8_t* pData, size_t data_size, uint8_vec& enc_buf, const uint32_vec& scaled_cum_prob, uint32_t num_lanes = LANES, vrange_encode_stats* pStats = NULL);
+
+	// Worst case size of vrange_encode()'s output for data_size input bytes with any lane count: LANES * 3 initial bytes, 2 bytes of padding, and at most 
+	// 12.1 bits per symbol (a symbol's 12 bits at the lowest probability, plus up to log2(16/15) bits lost to truncating a length of at least 2^16).
+	// Returns 0 if the bound doesn't fit in a size_t.
+	size_t vrange_compress_bound(size_t data_size);
+
+	// Encodes directly into pDst, which has room for dst_capacity bytes (vrange_compress_bound(data_size) is always enough).
+	// Returns the encoded size, or 0 if the output doesn't fit or a symbol can't be coded. Reuses a thread local vrange_encoder_context.
+	size_t vrange_encode(const uint8_t* pData, size_t data_size, uint8_t* pDst, size_t dst_capacity, const uint32_t* pScaled_cum_prob, uint32_t num_lanes = LANES, vrange_encode_stats* pStats = NULL);
 		
-	// Decodes interleaved data created by vrange_encode()
-	bool vrange_decode(const uint8_t* pSrc_start, size_t comp_size, uint8_t* pDst_start, size_t orig_size, const uint32_t* pDec_table);
+	// Decodes interleaved data created by vrange_encode() with the same num_lanes. Every symbol is decoded by the SSE code, including the last partial group of lanes.
+	// Never reads outside of [pSrc_start, pSrc_start + comp_size), even on corrupted input.
+	bool vrange_decode(const uint8_t* pSrc_start, size_t comp_size, uint8_t* pDst_start, size_t orig_size, const uint32_t* pDec_table, uint32_t num_lanes = LANES, vrange_decode_stats* pStats = NULL);
+
+	// vrange_decode() into a list of output segments (the original size is the sum of their sizes, empty segments are skipped). Groups of lanes which fit
+	// in a segment are stored directly, only the groups straddling a segment boundary are decoded to a bounce buffer first.
+	bool vrange_decode_iov(const uint8_t* pSrc_start, size_t comp_size, const vrange_iovec* pDst_segs, uint32_t num_dst_segs, const uint32_t* pDec_table, uint32_t num_lanes = LANES, vrange_decode_stats* pStats = NULL);
+
+	// Dictionary for vrange_decode_values(): symbol i decodes to value i, and symbols >= num_values (only possible with a mismatched model) decode to 0.
+	// Dictionaries of up to 16 values are expanded with byte shuffles, larger ones with a load per symbol.
+	struct vrange_value_table
+	{
+		vrange_value_table() { clear(); }
+
+		void clear()
+		{
+			clear_obj(m_planes);
+			clear_obj(m_values);
+			m_num_values = 0;
+		}
+
+		// num_values must be in [1, 256]
+		bool init(const uint16_t* pValues, uint32_t num_values);
+		bool init(const uint32_t* pValues, uint32_t num_values);
+
+		alignas(16) uint8_t m_planes[4][16];	// Byte k of values [0, 16)
+		uint32_t m_values[256];
+		uint32_t m_num_values;
+	};
+
+	// vrange_decode() which writes each symbol's value from the dictionary instead of the symbol, in the same pass (uint16_t output keeps the low 16 bits of each value).
+	// Each group of decoded lanes is expanded and stored directly, so there's no temporary symbol buffer.
+	bool vrange_decode_values(const uint8_t* pSrc_start, size_t comp_size, uint16_t* pDst_start, size_t orig_size, const uint32_t* pDec_table, const vrange_value_table& values, uint32_t num_lanes = LANES, vrange_decode_stats* pStats = NULL);
+	bool vrange_decode_values(const uint8_t* pSrc_start, size_t comp_size, uint32_t* pDst_start, size_t orig_size, const uint32_t* pDec_table, const vrange_value_table& values, uint32_t num_lanes = LANES, vrange_decode_stats* pStats = NULL);
+
+	// Split coding of numeric values whose low bits are close to random (e.g. sensor noise): the high part of each uint16_t value (value >> num_raw_bits, 
+	// which must be < 256) is range coded with vrange_encode(), and the low num_raw_bits bits (1-8) bypass the range coder. They're bit packed into a
+	// separate raw stream in blocks of 16 values, 2 * num_raw_bits bytes per block, LSB first (the last block is zero padded).
+	const uint32_t cRangeMaxRawBits = 8;
+
+	inline size_t vrange_get_raw_bits_size(size_t num_values, uint32_t num_raw_bits) { return ((num_values + 15) >> 4) * 2 * num_raw_bits; }
+
+	// Splits pValues into the high parts to code (num_values bytes to pHigh) and the raw stream (vrange_get_raw_bits_size() bytes to pRaw).
+	// Returns false if a value doesn't fit in 8 + num_raw_bits bits.
+	bool vrange_split_values(const uint16_t* pValues, size_t num_values, uint32_t num_raw_bits, uint8_t* pHigh, uint8_t* pRaw);
+
+	// Returns the num_raw_bits (1-8) which minimizes the estimated size of the coded high parts plus the raw stream (model not included), 
+	// or 0 if the values can't be split (they need more than 16 bits).
+	uint32_t vrange_choose_num_raw_bits(const uint16_t* pValues, size_t num_values);
+
+	// Decodes vrange_encode()'s output for the high parts and merges each group of lanes with its raw low bits in the same pass,
+	// writing (high << num_raw_bits) | low to pDst. The raw bits are unpacked with SSE too, except in the last block of 16 values.
+	bool vrange_decode_split(const uint8_t* pSrc_start, size_t comp_size, const uint8_t* pRaw, size_t raw_size, uint16_t* pDst, size_t num_values, uint32_t num_raw_bits, 
+		const uint32_t* pDec_table, uint32_t num_lanes = LANES, vrange_decode_stats* pStats = NULL);
+
+	// Decoding table for models using at most cRangeSmallAlphabetMaxSyms symbols (e.g. nibbles, enums or DNA). Each lane's symbol is found by comparing its quotient
+	// against the used symbols' starts, and its low and range with byte shuffles, so the table is ~330 bytes and takes no time to build, vs. 16KB for vrange_init_table().
+	const uint32_t cRangeSmallAlphabetMaxSyms = 16;
+
+	// Once the 16KB table is built and in the L1 cache the table kernel is faster, so the decoders only switch to the small table below these limits
+	// (measured on book1 reduced to 2-16 symbols: the compare chain costs ~5% at 2-4 symbols and ~25% at 16, building the 16KB table costs about as much as decoding 2KB).
+	const uint32_t cRangeSmallAlphabetAutoMaxSyms = 4;
+	const uint32_t cRangeSmallAlphabetAutoMaxSize = 2048;
+
+	struct vrange_small_table
+	{
+		vrange_small_table() { clear(); }
+
+		void clear()
+		{
+			clear_obj(m_bounds);
+			clear_obj(m_syms);
+			clear_obj(m_low);
+			clear_obj(m_range);
+			m_num_syms = 0;
+		}
+
+		// Start - 1 of used symbols [1, m_num_syms), broadcast to 8 16-bit lanes
+		alignas(16) int16_t m_bounds[cRangeSmallAlphabetMaxSyms - 1][8];
+
+		// By rank (the index of a used symbol): the symbol, then the low and high bytes of its low and range
+		alignas(16) uint8_t m_syms[16];
+		alignas(16) uint8_t m_low[2][16];
+		alignas(16) uint8_t m_range[2][16];
+
+		// 0 if the model uses too many symbols
+		uint32_t m_num_syms;
+	};
+
+	// Returns false if more than cRangeSmallAlphabetMaxSyms symbols have a non-zero frequency (pScaled_cum_prob has num_syms + 1 entries).
+	bool vrange_init_small_table(uint32_t num_syms, const uint32_t* pScaled_cum_prob, vrange_small_table& table);
+
+	// vrange_decode() with a vrange_small_table
+	bool vrange_decode_small(const uint8_t* pSrc_start, size_t comp_size, uint8_t* pDst_start, size_t orig_size, const vrange_small_table& table, uint32_t num_lanes = LANES, vrange_decode_stats* pStats = NULL);
+
+	// True if decoding orig_size bytes with the small table should be faster than building (or missing the cache on) the full table
+	inline bool vrange_prefer_small_table(const vrange_small_table& table, size_t orig_size)
+	{
+		return (table.m_num_syms) && (table.m_num_syms <= cRangeSmallAlphabetAutoMaxSyms) && (orig_size <= cRangeSmallAlphabetAutoMaxSize);
+	}
+
+	// vrange_decode() into a ring buffer of ring_size bytes, starting at ring_ofs and wrapping around to the start. orig_size must be <= ring_size.
+	bool vrange_decode_ring(const uint8_t* pSrc_start, size_t comp_size, uint8_t* pRing, size_t ring_size, size_t ring_ofs, size_t orig_size, const uint32_t* pDec_table, uint32_t num_lanes = LANES, vrange_decode_stats* pStats = NULL);
+
+
+	// Optional allocator hook for vrange_encoder_context, e.g. to place its scratch memory in an arena. Allocations must be 16-byte aligned.
+	typedef void* (*vrange_alloc_func)(size_t size, void* pUser);
+	typedef void (*vrange_free_func)(void* p, void* pUser);
+
+	struct vrange_allocator
+	{
+		vrange_alloc_func m_pAlloc;
+		vrange_free_func m_pFree;
+		void* m_pUser;
+	};
+
+	// Limits for vrange_encoder_context::encode_mt(): the max number of threads, and the min number of input bytes per thread (smaller inputs use fewer threads).
+	const uint32_t cRangeEncodeMaxThreads = 64;
+	const size_t cRangeEncodeMinBytesPerThread = 64 * 1024;
+
+	// Reusable encoder state for repeated vrange_encode() calls. The context owns all scratch memory (including the output buffer), which only grows,
+	// so once it has encoded the largest input size no further allocations are made.
+	class vrange_encoder_context
+	{
+	public:
+		// pAllocator may be NULL, in which case malloc()/free() are used
+		explicit vrange_encoder_context(const vrange_allocator* pAllocator = NULL);
+		~vrange_encoder_context();
+
+		// Frees the scratch memory
+		void clear();
+
+		// Makes sure inputs of up to max_data_size bytes can be encoded without allocating. Returns false if the allocation fails.
+		// The output buffer is only needed by the encode() overload returning pComp, the others reserve around 2.5 bytes per input byte.
+		bool reserve(size_t max_data_size);
+
+		// Same as vrange_create_cum_probs() (pSym_freq isn't modified). The context keeps the model, see get_scaled_cum_prob().
+		bool create_model(const uint32_t* pSym_freq, uint32_t num_syms);
+
+		uint32_t get_num_syms() const { return m_num_syms; }
+		const uint32_t* get_scaled_cum_prob() const { return m_scaled_cum_prob; }
+
+		// Encodes pData exactly like vrange_encode(). pScaled_cum_prob may be get_scaled_cum_prob(). Fails if a symbol in pData has a zero frequency.
+		// On success pComp points to comp_size bytes in the context's buffer, valid until the next call.
+		bool encode(const uint8_t* pData, size_t data_size, const uint32_t* pScaled_cum_prob, const uint8_t*& pComp, size_t& comp_size, uint32_t num_lanes = LANES, vrange_encode_stats* pStats = NULL);
+
+		// Same, but writes directly to pDst which has room for dst_capacity bytes. Fails if the output doesn't fit (vrange_compress_bound(data_size) always fits).
+		bool encode(const uint8_t* pData, size_t data_size, const uint32_t* pScaled_cum_prob, uint8_t* pDst, size_t dst_capacity, size_t& comp_size, uint32_t num_lanes = LANES, vrange_encode_stats* pStats = NULL);
+
+		// Encodes the concatenation of a list of fragments (empty ones are allowed) without copying them, producing the same output as encode() would.
+		// The lanes continue across fragment boundaries, i.e. the lane of each byte is its offset in the concatenated data & (num_lanes - 1).
+		bool encode_iov(const vrange_const_iovec* pSrc_segs, uint32_t num_src_segs, const uint32_t* pScaled_cum_prob, uint8_t* pDst, size_t dst_capacity, size_t& comp_size, uint32_t num_lanes = LANES, vrange_encode_stats* pStats = NULL);
+
+		// Same as the above, but uses up to num_threads threads (including the caller) for one large input. Each thread encodes a group of lanes, reading every 
+		// num_lanes'th input byte, then the swizzle is split into ranges of symbols whose output offsets are prefix sums of the lanes' sizes at the range starts.
+		// The output is identical to encode()'s. num_threads is limited to the number of cores and to one per cRangeEncodeMinBytesPerThread input bytes,
+		// so small inputs and single core machines just call encode().
+		bool encode_mt(const uint8_t* pData, size_t data_size, const uint32_t* pScaled_cum_prob, uint8_t* pDst, size_t dst_capacity, size_t& comp_size, uint32_t num_threads, uint32_t num_lanes = LANES, vrange_encode_stats* pStats = NULL);
+
+		// Number of times the scratch memory was (re)allocated
+		uint32_t get_total_allocs() const { return m_total_allocs; }
+
+	private:
+		vrange_allocator m_allocator;
+
+		uint8_t* m_pScratch;
+		size_t m_max_data_size;
+		uint32_t m_total_allocs;
+		bool m_has_output_buf;
+
+		uint32_t m_num_syms;
+		uint32_t m_scaled_cum_prob[cRangeCodecMaxSyms + 1];
+
+		bool reserve(size_t max_data_size, bool output_buf);
+
+		vrange_encoder_context(const vrange_encoder_context&);
+		vrange_encoder_context& operator= (const vrange_encoder_context&);
+	};
+
+	// Reusable decoder state: a model and its decoding table, stored inline so the context never allocates.
+	class vrange_decoder_context
+	{
+	public:
+		vrange_decoder_context() : m_num_syms(0) { }
+
+		// Recreates the encoder's model from the same symbol frequencies, see vrange_encoder_context::create_model()
+		// legacy_quantizer selects vrange_create_cum_probs_legacy(), for data whose model was built by it
+		bool create_model(const uint32_t* pSym_freq, uint32_t num_syms, bool legacy_quantizer = false);
+
+		// Uses an existing scaled_cum_prob table (num_syms + 1 entries). Returns false if the table is invalid.
+		bool set_model(const uint32_t* pScaled_cum_prob, uint32_t num_syms);
+
+		bool has_model() const { return m_num_syms != 0; }
+		const uint32_t* get_scaled_cum_prob() const { return m_scaled_cum_prob; }
+		const uint32_t* get_dec_table() const { return m_dec_table; }
+
+		// vrange_decode() with the context's model
+		bool decode(const uint8_t* pSrc, size_t src_size, uint8_t* pDst, size_t dst_size, uint32_t num_lanes = LANES, vrange_decode_stats* pStats = NULL) const;
+
+		// vrange_rans_decode() with the context's model
+		bool decode_rans(const uint8_t* pSrc, size_t src_size, uint8_t* pDst, size_t dst_size) const;
+
+	private:
+		uint32_t m_num_syms;
+		uint32_t m_scaled_cum_prob[cRangeCodecMaxSyms + 1];
+		uint32_t m_dec_table[cRangeCodecProbScale];
+	};
+
+	// Encodes pData to 16 interleaved rANS streams, using the same scaled_cum_prob tables as vrange_encode(). 
+	// The output is the 16 final states (4 bytes each) followed by the renormalization words, in decoding order.
+	void vrange_rans_encode(const uint8_t* pData, size_t data_size, uint8_vec& enc_buf, const uint32_vec& scaled_cum_prob);
+
+	// Decodes data created by vrange_rans_encode() using the table from vrange_init_table(). Fails unless the whole input is consumed and every stream ends in its initial state.
+	bool vrange_rans_decode(const uint8_t* pSrc_start, size_t comp_size, uint8_t* pDst_start, size_t orig_size, const uint32_t* pDec_table);
 	
 } // sserangecoder
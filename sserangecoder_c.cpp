@@ -0,0 +1,108 @@
+// sserangecoder_c.cpp
+// C interface to the interleaved range coder, Richard Geldreich, Jr., public domain (see full text at unlicense.org)
+#include "sserangecoder_c.h"
+#include "sserangecoder.h"
+#include <new>
+
+using namespace sserangecoder;
+
+struct sserange_encoder
+{
+	explicit sserange_encoder(const vrange_allocator* pAllocator) : m_ctx(pAllocator) { }
+
+	vrange_encoder_context m_ctx;
+};
+
+struct sserange_decoder
+{
+	vrange_decoder_context m_ctx;
+};
+
+static_assert(SSERANGE_DEFAULT_LANES == LANES, "SSERANGE_DEFAULT_LANES must match sserangecoder::LANES");
+
+uint32_t sserange_choose_num_lanes(size_t data_size)
+{
+	return vrange_choose_num_lanes(data_size);
+}
+
+size_t sserange_compress_bound(size_t data_size)
+{
+	return vrange_compress_bound(data_size);
+}
+
+int sserange_create_cum_probs(const uint32_t* pSym_freq, uint32_t num_syms, uint32_t* pScaled_cum_prob)
+{
+	if ((!pSym_freq) || (!pScaled_cum_prob) || (num_syms < cRangeCodecMinSyms) || (num_syms > cRangeCodecMaxSyms))
+		return 0;
+
+	uint32_t freq[cRangeCodecMaxSyms];
+	memcpy(freq, pSym_freq, num_syms * sizeof(uint32_t));
+
+	return vrange_create_cum_probs(pScaled_cum_prob, freq, num_syms) ? 1 : 0;
+}
+
+sserange_encoder* sserange_encoder_create(sserange_alloc_func pAlloc, sserange_free_func pFree, void* pUser)
+{
+	if ((pAlloc != NULL) != (pFree != NULL))
+		return NULL;
+
+	vrange_allocator allocator;
+	allocator.m_pAlloc = pAlloc;
+	allocator.m_pFree = pFree;
+	allocator.m_pUser = pUser;
+
+	return new (std::nothrow) sserange_encoder(pAlloc ? &allocator : NULL);
+}
+
+void sserange_encoder_destroy(sserange_encoder* pEncoder)
+{
+	delete pEncoder;
+}
+
+size_t sserange_encode(sserange_encoder* pEncoder, const uint8_t* pData, size_t data_size, const uint32_t* pScaled_cum_prob, uint32_t num_syms, uint32_t num_lanes,
+	uint8_t* pDst, size_t dst_capacity)
+{
+	if ((!pEncoder) || ((!pData) && (data_size)) || (!pScaled_cum_prob) || (!pDst) || (!vrange_is_valid_num_lanes(num_lanes)))
+		return 0;
+
+	if (!vrange_is_valid_model(pScaled_cum_prob, num_syms))
+		return 0;
+
+	// The encoder indexes the model by byte value, so pad it to 256 symbols with zero frequencies
+	uint32_t scaled_cum_prob[cRangeCodecMaxSyms + 1];
+	memcpy(scaled_cum_prob, pScaled_cum_prob, (num_syms + 1) * sizeof(uint32_t));
+	for (uint32_t i = num_syms + 1; i <= cRangeCodecMaxSyms; i++)
+		scaled_cum_prob[i] = cRangeCodecProbScale;
+
+	size_t comp_size;
+	if (!pEncoder->m_ctx.encode(pData, data_size, scaled_cum_prob, pDst, dst_capacity, comp_size, num_lanes))
+		return 0;
+
+	return comp_size;
+}
+
+sserange_decoder* sserange_decoder_create(void)
+{
+	return new (std::nothrow) sserange_decoder;
+}
+
+void sserange_decoder_destroy(sserange_decoder* pDecoder)
+{
+	delete pDecoder;
+}
+
+int sserange_decoder_set_model(sserange_decoder* pDecoder, const uint32_t* pScaled_cum_prob, uint32_t num_syms)
+{
+	if ((!pDecoder) || (!pScaled_cum_prob))
+		return 0;
+
+	return pDecoder->m_ctx.set_model(pScaled_cum_prob, num_syms) ? 1 : 0;
+}
+
+int sserange_decode(const sserange_decoder* pDecoder, const uint8_t* pSrc, size_t src_size, uint8_t* pDst, size_t dst_size, uint32_t num_lanes)
+{
+	if ((!pDecoder) || (!pSrc) || ((!pDst) && (dst_size)) || (!vrange_is_valid_num_lanes(num_lanes)))
+		return 0;
+
+	return pDecoder->m_ctx.decode(pSrc, src_size, pDst, dst_size, num_lanes) ? 1 : 0;
+}
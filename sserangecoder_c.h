@@ -0,0 +1,52 @@
+// sserangecoder_c.h
+// C interface to the interleaved range coder, Richard Geldreich, Jr., public domain (see full text at unlicense.org)
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct sserange_encoder sserange_encoder;
+typedef struct sserange_decoder sserange_decoder;
+
+/* Optional allocator hook for the encoder's scratch memory (same as sserangecoder::vrange_allocator). Allocations must be 16-byte aligned. */
+typedef void* (*sserange_alloc_func)(size_t size, void* pUser);
+typedef void (*sserange_free_func)(void* p, void* pUser);
+
+/* Lane counts (4, 8 or 16) trade speed for size on small inputs. The lane count isn't stored in the encoded data, the decoder must be given the same one. */
+#define SSERANGE_DEFAULT_LANES 16
+
+/* Returns the lane count sserangecoder::vrange_choose_num_lanes() picks for data_size bytes: fewer lanes for small inputs. */
+uint32_t sserange_choose_num_lanes(size_t data_size);
+
+/* Worst case encoded size for data_size input bytes (with any lane count), or 0 if it doesn't fit in a size_t. */
+size_t sserange_compress_bound(size_t data_size);
+
+/* Computes the scaled cumulative probabilities (num_syms + 1 entries) from num_syms symbol frequencies. Returns 0 on failure. */
+int sserange_create_cum_probs(const uint32_t* pSym_freq, uint32_t num_syms, uint32_t* pScaled_cum_prob);
+
+/* Encoder contexts own all of their scratch memory and reuse it between calls. pAlloc/pFree may be NULL to use malloc()/free(). */
+sserange_encoder* sserange_encoder_create(sserange_alloc_func pAlloc, sserange_free_func pFree, void* pUser);
+void sserange_encoder_destroy(sserange_encoder* pEncoder);
+
+/* Encodes data_size bytes to num_lanes streams directly into pDst, which has room for dst_capacity bytes (sserange_compress_bound(data_size) is always enough).
+   pScaled_cum_prob has num_syms + 1 entries and is validated like sserange_decoder_set_model(). Returns the encoded size, or 0 on failure, including an
+   invalid model and bytes with a zero frequency (bytes >= num_syms count as zero frequency). */
+size_t sserange_encode(sserange_encoder* pEncoder, const uint8_t* pData, size_t data_size, const uint32_t* pScaled_cum_prob, uint32_t num_syms, uint32_t num_lanes, 
+	uint8_t* pDst, size_t dst_capacity);
+
+/* Decoder contexts hold a model's decoding table. */
+sserange_decoder* sserange_decoder_create(void);
+void sserange_decoder_destroy(sserange_decoder* pDecoder);
+
+/* Sets the decoder's model from num_syms + 1 scaled cumulative probabilities. Returns 0 if the table is invalid. */
+int sserange_decoder_set_model(sserange_decoder* pDecoder, const uint32_t* pScaled_cum_prob, uint32_t num_syms);
+
+/* Decodes exactly dst_size bytes from data encoded with num_lanes lanes. Returns 0 on failure. */
+int sserange_decode(const sserange_decoder* pDecoder, const uint8_t* pSrc, size_t src_size, uint8_t* pDst, size_t dst_size, uint32_t num_lanes);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,315 @@
+// sserangedict.cpp
+// Pre-trained shared model dictionaries for coding many small messages, Richard Geldreich, Jr., public domain (see full text at unlicense.org)
+#include "sserangedict.h"
+#include <algorithm>
+
+namespace sserangecoder
+{
+	static inline uint32_t get_lanes_code(uint32_t num_lanes)
+	{
+		return (num_lanes == 4) ? 2 : ((num_lanes == 8) ? 1 : 0);
+	}
+
+	// Creates a model from a cluster's histogram. Symbols seen anywhere in the training data (pGlobal_hist) get a frequency of at least 1.
+	static bool create_cluster_model(const uint64_t* pHist, const uint32_t* pGlobal_hist, uint32_vec& scaled_cum_prob, uint32_vec& sym_costs)
+	{
+		uint64_t max_count = 0;
+		for (uint32_t i = 0; i < 256; i++)
+			max_count = std::max(max_count, pHist[i]);
+
+		// Scale down the counts of very large clusters so they fit in 32 bits
+		const uint32_t shift = (max_count > (UINT32_MAX >> 1)) ? 16 : 0;
+
+		uint32_vec freq(256);
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			freq[i] = (uint32_t)(pHist[i] >> shift);
+			if ((!freq[i]) && ((pHist[i]) || (pGlobal_hist[i])))
+				freq[i] = 1;
+		}
+
+		if (!vrange_create_cum_probs(scaled_cum_prob, freq))
+			return false;
+
+		vrange_get_sym_costs(256, scaled_cum_prob, sym_costs);
+		return true;
+	}
+
+	void vrange_model_dict::clear()
+	{
+		m_models.resize(0);
+		m_sym_costs.resize(0);
+		m_dec_tables.resize(0);
+		m_small_tables.resize(0);
+	}
+
+	void vrange_model_dict::init_tables()
+	{
+		const uint32_t num_models = get_num_models();
+
+		m_sym_costs.resize(num_models);
+		m_dec_tables.resize(num_models * cRangeCodecProbScale);
+		m_small_tables.resize(num_models);
+
+		for (uint32_t i = 0; i < num_models; i++)
+		{
+			vrange_get_sym_costs(256, m_models[i], m_sym_costs[i]);
+			vrange_init_table(256, &m_models[i][0], &m_dec_tables[i * cRangeCodecProbScale]);
+			vrange_init_small_table(256, &m_models[i][0], m_small_tables[i]);
+		}
+	}
+
+	bool vrange_model_dict::train(const uint8_t* const* ppSamples, const size_t* pSample_sizes, uint32_t num_samples, const vrange_dict_params& params)
+	{
+		clear();
+
+		if ((!num_samples) || (!params.m_max_models) || (params.m_max_models > cDictMaxModels))
+			return false;
+
+		uint32_t global_hist[256];
+		clear_obj(global_hist);
+
+		for (uint32_t i = 0; i < num_samples; i++)
+			vrange_histogram(ppSamples[i], pSample_sizes[i], global_hist);
+
+		uint32_t total_used_syms = 0;
+		for (uint32_t i = 0; i < 256; i++)
+			if (global_hist[i])
+				total_used_syms++;
+
+		if (!total_used_syms)
+			return false;
+
+		// Seed the clusters with evenly spaced samples (skipping empty ones)
+		const uint32_t max_models = std::min(params.m_max_models, num_samples);
+
+		std::vector<uint64_t> cluster_hists(max_models * 256);
+		uint32_t num_clusters = 0;
+
+		for (uint32_t i = 0; i < max_models; i++)
+		{
+			const uint32_t sample_index = (uint32_t)(((uint64_t)i * num_samples) / max_models);
+			if (!pSample_sizes[sample_index])
+				continue;
+
+			uint32_t hist[256];
+			clear_obj(hist);
+			vrange_histogram(ppSamples[sample_index], pSample_sizes[sample_index], hist);
+
+			for (uint32_t j = 0; j < 256; j++)
+				cluster_hists[num_clusters * 256 + j] = hist[j];
+
+			num_clusters++;
+		}
+
+		if (!num_clusters)
+			return false;
+
+		std::vector<uint8_t> assignments(num_samples, 0xFF);
+
+		for (uint32_t iter = 0; iter <= params.m_max_iters; iter++)
+		{
+			// Rebuild the models from the current clusters, dropping empty ones
+			m_models.resize(0);
+			m_sym_costs.resize(0);
+
+			for (uint32_t i = 0; i < num_clusters; i++)
+			{
+				const uint64_t* pHist = &cluster_hists[i * 256];
+
+				uint64_t total = 0;
+				for (uint32_t j = 0; j < 256; j++)
+					total += pHist[j];
+
+				if (!total)
+					continue;
+
+				m_models.resize(m_models.size() + 1);
+				m_sym_costs.resize(m_sym_costs.size() + 1);
+
+				if (!create_cluster_model(pHist, global_hist, m_models.back(), m_sym_costs.back()))
+				{
+					clear();
+					return false;
+				}
+			}
+
+			num_clusters = get_num_models();
+
+			if (iter == params.m_max_iters)
+				break;
+
+			// Assign each sample to the model which codes it in the fewest bits, and accumulate the new clusters
+			std::fill(cluster_hists.begin(), cluster_hists.end(), 0);
+
+			uint32_t total_changed = 0;
+
+			for (uint32_t s = 0; s < num_samples; s++)
+			{
+				if (!pSample_sizes[s])
+					continue;
+
+				uint32_t hist[256];
+				clear_obj(hist);
+				vrange_histogram(ppSamples[s], pSample_sizes[s], hist);
+
+				uint64_t best_cost = UINT64_MAX;
+				uint32_t best_model = 0;
+
+				for (uint32_t m = 0; m < num_clusters; m++)
+				{
+					const uint64_t cost = vrange_get_hist_cost(hist, &m_sym_costs[m][0]);
+					if (cost < best_cost)
+					{
+						best_cost = cost;
+						best_model = m;
+					}
+				}
+
+				if (assignments[s] != best_model)
+				{
+					assignments[s] = (uint8_t)best_model;
+					total_changed++;
+				}
+
+				uint64_t* pCluster_hist = &cluster_hists[best_model * 256];
+				for (uint32_t j = 0; j < 256; j++)
+					pCluster_hist[j] += hist[j];
+			}
+
+			if (!total_changed)
+				break;
+		}
+
+		init_tables();
+		return true;
+	}
+
+	void vrange_model_dict::write(uint8_vec& buf) const
+	{
+		buf.push_back((uint8_t)cDictSig[0]);
+		buf.push_back((uint8_t)cDictSig[1]);
+		buf.push_back((uint8_t)get_num_models());
+
+		for (uint32_t i = 0; i < get_num_models(); i++)
+			vrange_write_model(m_models[i], buf);
+	}
+
+	bool vrange_model_dict::read(const uint8_t* pSrc, size_t src_size)
+	{
+		clear();
+
+		if ((src_size < 3) || (pSrc[0] != (uint8_t)cDictSig[0]) || (pSrc[1] != (uint8_t)cDictSig[1]))
+			return false;
+
+		const uint32_t num_models = pSrc[2];
+		if ((!num_models) || (num_models > cDictMaxModels))
+			return false;
+
+		const uint8_t* pCur = pSrc + 3;
+		const uint8_t* pSrc_end = pSrc + src_size;
+
+		m_models.resize(num_models);
+		for (uint32_t i = 0; i < num_models; i++)
+		{
+			if (!vrange_read_model(pCur, pSrc_end, m_models[i]))
+			{
+				clear();
+				return false;
+			}
+		}
+
+		if (pCur != pSrc_end)
+		{
+			clear();
+			return false;
+		}
+
+		init_tables();
+		return true;
+	}
+
+	uint32_t vrange_model_dict::find_best_model(const uint8_t* pData, size_t data_size) const
+	{
+		uint32_t hist[256];
+		clear_obj(hist);
+		vrange_histogram(pData, data_size, hist);
+
+		uint64_t best_cost = UINT64_MAX;
+		uint32_t best_model = cDictRawMessage;
+
+		for (uint32_t m = 0; m < get_num_models(); m++)
+		{
+			const uint64_t cost = vrange_get_hist_cost(hist, &m_sym_costs[m][0]);
+			if (cost < best_cost)
+			{
+				best_cost = cost;
+				best_model = m;
+			}
+		}
+
+		return best_model;
+	}
+
+	bool vrange_model_dict::compress(const uint8_t* pData, size_t data_size, vrange_encoder_context& enc_ctx, uint8_t* pDst, size_t dst_capacity, size_t& comp_size) const
+	{
+		comp_size = 0;
+
+		if (dst_capacity < vrange_dict_compress_bound(data_size))
+			return false;
+
+		const uint32_t model_id = data_size ? find_best_model(pData, data_size) : cDictRawMessage;
+
+		if (model_id != cDictRawMessage)
+		{
+			const uint32_t num_lanes = vrange_choose_num_lanes(data_size);
+
+			// Only accept coded output smaller than the message, so the encoder stops as soon as it doesn't fit
+			size_t enc_size;
+			if (enc_ctx.encode(pData, data_size, &m_models[model_id][0], pDst + cDictMessageHeaderSize, data_size - 1, enc_size, num_lanes))
+			{
+				pDst[0] = (uint8_t)(model_id | (get_lanes_code(num_lanes) << 6));
+				comp_size = cDictMessageHeaderSize + enc_size;
+				return true;
+			}
+		}
+
+		pDst[0] = (uint8_t)cDictRawMessage;
+		if (data_size)
+			memcpy(pDst + cDictMessageHeaderSize, pData, data_size);
+
+		comp_size = cDictMessageHeaderSize + data_size;
+		return true;
+	}
+
+	bool vrange_model_dict::decompress(const uint8_t* pSrc, size_t src_size, uint8_t* pDst, size_t dst_size) const
+	{
+		if (src_size < cDictMessageHeaderSize)
+			return false;
+
+		const uint32_t model_id = pSrc[0] & 63;
+		const uint32_t lanes_code = pSrc[0] >> 6;
+
+		pSrc += cDictMessageHeaderSize;
+		src_size -= cDictMessageHeaderSize;
+
+		if (model_id == cDictRawMessage)
+		{
+			if ((lanes_code) || (src_size != dst_size))
+				return false;
+
+			if (dst_size)
+				memcpy(pDst, pSrc, dst_size);
+			return true;
+		}
+
+		if ((model_id >= get_num_models()) || (lanes_code > 2) || (!dst_size))
+			return false;
+
+		if (vrange_prefer_small_table(m_small_tables[model_id], dst_size))
+			return vrange_decode_small(pSrc, src_size, pDst, dst_size, m_small_tables[model_id], LANES >> lanes_code);
+
+		return vrange_decode(pSrc, src_size, pDst, dst_size, get_dec_table(model_id), LANES >> lanes_code);
+	}
+
+} // namespace sserangecoder
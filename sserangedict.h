@@ -0,0 +1,80 @@
+// sserangedict.h
+// Pre-trained shared model dictionaries for coding many small messages, Richard Geldreich, Jr., public domain (see full text at unlicense.org)
+#pragma once
+#include "sserangeblocks.h"
+
+namespace sserangecoder
+{
+	// Each coded message starts with a 1 byte header: bits [5:0] are the model ID (or cDictRawMessage if the message is stored uncompressed),
+	// bits [7:6] the lane count code used by the blocked format (0 = 16 lanes, 1 = 8, 2 = 4). The vrange_encode() payload follows.
+	const uint32_t cDictMaxModels = 63;
+	const uint32_t cDictRawMessage = 63;
+	const uint32_t cDictMessageHeaderSize = 1;
+
+	// Serialized dictionaries start with this signature, then the number of models (1 byte), then each model in vrange_write_model()'s format.
+	const char* const cDictSig = "Rm";
+
+	struct vrange_dict_params
+	{
+		vrange_dict_params() { clear(); }
+
+		void clear()
+		{
+			m_max_models = 16;
+			m_max_iters = 10;
+		}
+
+		// Number of models to train (max cDictMaxModels). More models fit the messages better, but each model's decoding table takes 16KB.
+		uint32_t m_max_models;
+
+		// Max number of clustering passes over the samples
+		uint32_t m_max_iters;
+	};
+
+	// A set of models trained from sample messages. Once trained or loaded the dictionary is read-only, so one instance can be shared by any number of threads,
+	// each with its own vrange_encoder_context. The decoding tables are built when the dictionary is trained or loaded, so decoding a message
+	// only costs the SIMD decode.
+	class vrange_model_dict
+	{
+	public:
+		vrange_model_dict() { clear(); }
+
+		void clear();
+
+		// Clusters the samples by their histograms (k-means, with the coded size under each model as the distance) and creates a model per cluster.
+		// Every symbol seen in the samples gets a non-zero frequency in every model, messages containing other symbols are stored uncompressed.
+		bool train(const uint8_t* const* ppSamples, const size_t* pSample_sizes, uint32_t num_samples, const vrange_dict_params& params);
+
+		// Appends the serialized dictionary to buf
+		void write(uint8_vec& buf) const;
+
+		// Loads a dictionary created by write(), building every model's decoding table
+		bool read(const uint8_t* pSrc, size_t src_size);
+
+		uint32_t get_num_models() const { return (uint32_t)m_models.size(); }
+		const uint32_vec& get_scaled_cum_prob(uint32_t model_id) const { return m_models[model_id]; }
+		const uint32_t* get_dec_table(uint32_t model_id) const { return &m_dec_tables[model_id * cRangeCodecProbScale]; }
+
+		// Returns the ID of the model which codes pData in the fewest bits, or cDictRawMessage if no model can code it
+		uint32_t find_best_model(const uint8_t* pData, size_t data_size) const;
+
+		// Codes a message with the best model into pDst (which has room for dst_capacity bytes), falling back to storing it uncompressed.
+		// The output is never larger than vrange_dict_compress_bound(data_size).
+		bool compress(const uint8_t* pData, size_t data_size, vrange_encoder_context& enc_ctx, uint8_t* pDst, size_t dst_capacity, size_t& comp_size) const;
+
+		// Decodes a message created by compress(). dst_size must be the original message size. Short messages coded with models using only a few symbols
+		// are decoded with the model's vrange_small_table, which avoids missing the cache on one of many 16KB tables.
+		bool decompress(const uint8_t* pSrc, size_t src_size, uint8_t* pDst, size_t dst_size) const;
+
+	private:
+		std::vector<uint32_vec> m_models;
+		std::vector<uint32_vec> m_sym_costs;
+		uint32_vec m_dec_tables;
+		std::vector<vrange_small_table> m_small_tables;
+
+		void init_tables();
+	};
+
+	inline size_t vrange_dict_compress_bound(size_t data_size) { return cDictMessageHeaderSize + data_size; }
+
+} // namespace sserangecoder
@@ -0,0 +1,347 @@
+// sserangehuff.cpp
+// Interleaved length limited Huffman codec, an alternative backend to the range coder, Richard Geldreich, Jr., public domain (see full text at unlicense.org)
+#include "sserangehuff.h"
+#include "packagemerge.h"
+
+namespace sserangecoder
+{
+	static inline void write_le32(uint8_t* pDst, uint32_t v)
+	{
+		for (uint32_t i = 0; i < 4; i++)
+			pDst[i] = (uint8_t)(v >> (i * 8));
+	}
+
+	static inline uint32_t read_le32(const uint8_t* pSrc)
+	{
+		return pSrc[0] | (pSrc[1] << 8) | (pSrc[2] << 16) | ((uint32_t)pSrc[3] << 24);
+	}
+
+	bool vrange_huff_create_code_lens(const uint32_t* pHist, uint8_t* pCode_lens)
+	{
+		return packageMerge((unsigned char)cHuffMaxCodeLen, 256, pHist, pCode_lens) != 0;
+	}
+
+	uint64_t vrange_huff_get_hist_bits(const uint32_t* pHist, const uint8_t* pCode_lens)
+	{
+		uint64_t total_bits = 0;
+		for (uint32_t i = 0; i < 256; i++)
+			total_bits += (uint64_t)pHist[i] * pCode_lens[i];
+		return total_bits;
+	}
+
+	uint32_t vrange_huff_get_code_lens_size(const uint8_t* pCode_lens)
+	{
+		uint32_t num_used = 0;
+		for (uint32_t i = 0; i < 256; i++)
+			num_used += (pCode_lens[i] != 0);
+
+		return 32 + (num_used + 1) / 2;
+	}
+
+	void vrange_huff_write_code_lens(const uint8_t* pCode_lens, uint8_vec& buf)
+	{
+		const size_t mask_ofs = buf.size();
+		buf.resize(mask_ofs + 32);
+
+		uint32_t nibble_buf = 0, num_nibbles = 0;
+
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			if (!pCode_lens[i])
+				continue;
+
+			buf[mask_ofs + (i >> 3)] |= (uint8_t)(1 << (i & 7));
+
+			nibble_buf |= pCode_lens[i] << (num_nibbles * 4);
+			if (++num_nibbles == 2)
+			{
+				buf.push_back((uint8_t)nibble_buf);
+				nibble_buf = 0;
+				num_nibbles = 0;
+			}
+		}
+
+		if (num_nibbles)
+			buf.push_back((uint8_t)nibble_buf);
+	}
+
+	bool vrange_huff_read_code_lens(const uint8_t*& pSrc, const uint8_t* pSrc_end, uint8_t* pCode_lens)
+	{
+		if ((pSrc_end - pSrc) < 32)
+			return false;
+
+		const uint8_t* pMask = pSrc;
+		const uint8_t* pCur = pSrc + 32;
+
+		uint32_t num_nibbles = 0, kraft_total = 0;
+
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			pCode_lens[i] = 0;
+
+			if ((pMask[i >> 3] & (1 << (i & 7))) == 0)
+				continue;
+
+			if (pCur == pSrc_end)
+				return false;
+
+			const uint32_t len = (*pCur >> (num_nibbles * 4)) & 15;
+			if ((!len) || (len > cHuffMaxCodeLen))
+				return false;
+
+			if (++num_nibbles == 2)
+			{
+				pCur++;
+				num_nibbles = 0;
+			}
+
+			pCode_lens[i] = (uint8_t)len;
+			kraft_total += cHuffTableSize >> len;
+		}
+
+		if (num_nibbles)
+			pCur++;
+
+		// The code must be non-empty and satisfy the Kraft inequality (it may be incomplete, e.g. a single symbol uses a 1 bit code)
+		if ((!kraft_total) || (kraft_total > cHuffTableSize))
+			return false;
+
+		pSrc = pCur;
+		return true;
+	}
+
+	// Computes the canonical code for each symbol, bit reversed so the bit streams can be read LSB first. Each entry is code | (len << 16).
+	static void create_codes(const uint8_t* pCode_lens, uint32_t* pCodes)
+	{
+		uint32_t num_codes[cHuffMaxCodeLen + 1], next_code[cHuffMaxCodeLen + 1];
+		clear_obj(num_codes);
+
+		for (uint32_t i = 0; i < 256; i++)
+			num_codes[pCode_lens[i]]++;
+		num_codes[0] = 0;
+
+		uint32_t code = 0;
+		for (uint32_t len = 1; len <= cHuffMaxCodeLen; len++)
+		{
+			code = (code + num_codes[len - 1]) << 1;
+			next_code[len] = code;
+		}
+
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			const uint32_t len = pCode_lens[i];
+			if (!len)
+			{
+				pCodes[i] = 0;
+				continue;
+			}
+
+			const uint32_t c = next_code[len]++;
+
+			uint32_t rev = 0;
+			for (uint32_t j = 0; j < len; j++)
+				rev |= ((c >> j) & 1) << (len - 1 - j);
+
+			pCodes[i] = rev | (len << 16);
+		}
+	}
+
+	void vrange_huff_init_table(const uint8_t* pCode_lens, uint16_vec& dec_table)
+	{
+		uint32_t codes[256];
+		create_codes(pCode_lens, codes);
+
+		// Entries not covered by an incomplete code decode to a zero length code, which consumes no bits
+		dec_table.resize(0);
+		dec_table.resize(cHuffTableSize);
+
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			const uint32_t len = codes[i] >> 16;
+			if (!len)
+				continue;
+
+			const uint16_t entry = (uint16_t)(i | (len << 8));
+			for (uint32_t j = codes[i] & 0xFFFF; j < cHuffTableSize; j += (1 << len))
+				dec_table[j] = entry;
+		}
+	}
+
+	void vrange_huff_encode(const uint8_t* pData, size_t data_size, uint8_vec& enc_buf, const uint8_t* pCode_lens)
+	{
+		uint32_t codes[256];
+		create_codes(pCode_lens, codes);
+
+		// Each stream gets a worst case sized region, plus room for the 8 byte stores of the bit writer. The streams are compacted at the end.
+		const size_t max_stream_size = ((data_size + cHuffStreams - 1) / cHuffStreams * cHuffMaxCodeLen + 7) / 8 + sizeof(uint64_t);
+
+		const size_t streams_ofs = (cHuffStreams - 1) * sizeof(uint32_t);
+		enc_buf.resize(streams_ofs + max_stream_size * cHuffStreams + cHuffPadding);
+
+		uint8_t* pStream_start[cHuffStreams];
+		uint8_t* pDst[cHuffStreams];
+		uint64_t bit_buf[cHuffStreams];
+		uint32_t bit_count[cHuffStreams];
+
+		for (uint32_t k = 0; k < cHuffStreams; k++)
+		{
+			pStream_start[k] = &enc_buf[streams_ofs + max_stream_size * k];
+			pDst[k] = pStream_start[k];
+			bit_buf[k] = 0;
+			bit_count[k] = 0;
+		}
+
+		size_t i = 0;
+		for (; (i + cHuffStreams) <= data_size; i += cHuffStreams)
+		{
+			for (uint32_t k = 0; k < cHuffStreams; k++)
+			{
+				const uint32_t c = codes[pData[i + k]];
+				assert(c);
+
+				bit_buf[k] |= (uint64_t)(c & 0xFFFF) << bit_count[k];
+				bit_count[k] += c >> 16;
+
+				// Branchless flush: always store 8 bytes, but only advance past the whole bytes
+				memcpy(pDst[k], &bit_buf[k], sizeof(uint64_t));
+				pDst[k] += bit_count[k] >> 3;
+				bit_buf[k] >>= (bit_count[k] & ~7);
+				bit_count[k] &= 7;
+			}
+		}
+
+		for (uint32_t k = 0; i < data_size; i++, k++)
+		{
+			const uint32_t c = codes[pData[i]];
+			assert(c);
+
+			bit_buf[k] |= (uint64_t)(c & 0xFFFF) << bit_count[k];
+			bit_count[k] += c >> 16;
+
+			memcpy(pDst[k], &bit_buf[k], sizeof(uint64_t));
+			pDst[k] += bit_count[k] >> 3;
+			bit_buf[k] >>= (bit_count[k] & ~7);
+			bit_count[k] &= 7;
+		}
+
+		size_t total_size = streams_ofs;
+		for (uint32_t k = 0; k < cHuffStreams; k++)
+		{
+			if (bit_count[k])
+				*pDst[k]++ = (uint8_t)bit_buf[k];
+
+			const uint32_t stream_size = (uint32_t)(pDst[k] - pStream_start[k]);
+
+			if (k < (cHuffStreams - 1))
+				write_le32(&enc_buf[k * sizeof(uint32_t)], stream_size);
+
+			if (stream_size)
+				memmove(&enc_buf[total_size], pStream_start[k], stream_size);
+			total_size += stream_size;
+		}
+
+		memset(&enc_buf[total_size], 0, cHuffPadding);
+		enc_buf.resize(total_size + cHuffPadding);
+	}
+
+	// Branchless refill (LSB first): afterwards 56-63 bits are available. Reads 8 bytes at pSrc.
+	static inline void huff_refill(uint64_t& bit_buf, uint32_t& bit_count, const uint8_t*& pSrc)
+	{
+		uint64_t v;
+		memcpy(&v, pSrc, sizeof(v));
+
+		bit_buf |= v << bit_count;
+		pSrc += (63 - bit_count) >> 3;
+		bit_count |= 56;
+	}
+
+	// Refill which never reads at or beyond pSrc_end. Missing bytes are treated as 0's.
+	static inline void huff_refill_safe(uint64_t& bit_buf, uint32_t& bit_count, const uint8_t*& pSrc, const uint8_t* pSrc_end)
+	{
+		if ((pSrc_end - pSrc) >= (ptrdiff_t)sizeof(uint64_t))
+		{
+			huff_refill(bit_buf, bit_count, pSrc);
+			return;
+		}
+
+		while (bit_count <= 56)
+		{
+			if (pSrc < pSrc_end)
+				bit_buf |= (uint64_t)(*pSrc++) << bit_count;
+			bit_count += 8;
+		}
+	}
+
+	static inline uint8_t huff_decode_sym(uint64_t& bit_buf, uint32_t& bit_count, const uint16_t* pTable)
+	{
+		const uint32_t e = pTable[bit_buf & (cHuffTableSize - 1)];
+		const uint32_t len = e >> 8;
+
+		bit_buf >>= len;
+		bit_count -= len;
+
+		return (uint8_t)e;
+	}
+
+	bool vrange_huff_decode(const uint8_t* pSrc, size_t src_size, uint8_t* pDst, size_t dst_size, const uint16_t* pTable)
+	{
+		if (src_size < cHuffOverheadSize)
+			return false;
+
+		const uint8_t* pSrc_end = pSrc + src_size;
+
+		const uint8_t* pStreams[cHuffStreams];
+
+		size_t ofs = (cHuffStreams - 1) * sizeof(uint32_t);
+		for (uint32_t k = 0; k < cHuffStreams - 1; k++)
+		{
+			pStreams[k] = pSrc + ofs;
+
+			ofs += read_le32(pSrc + k * sizeof(uint32_t));
+			if (ofs > (src_size - cHuffPadding))
+				return false;
+		}
+		pStreams[cHuffStreams - 1] = pSrc + ofs;
+
+		// Streams may read into the following streams or the padding, but never beyond pSrc_end
+		const uint8_t* pSrc_fast_end = pSrc_end - sizeof(uint64_t);
+
+		const uint8_t* p0 = pStreams[0], * p1 = pStreams[1], * p2 = pStreams[2], * p3 = pStreams[3];
+		uint64_t b0 = 0, b1 = 0, b2 = 0, b3 = 0;
+		uint32_t c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+
+		uint8_t* pOut = pDst;
+		uint8_t* pOut_end = pDst + dst_size;
+
+		// Each refill gives at least 56 bits, enough for 4 max length codes per stream
+		while (((pOut_end - pOut) >= 16) && (p0 <= pSrc_fast_end) && (p1 <= pSrc_fast_end) && (p2 <= pSrc_fast_end) && (p3 <= pSrc_fast_end))
+		{
+			huff_refill(b0, c0, p0);
+			huff_refill(b1, c1, p1);
+			huff_refill(b2, c2, p2);
+			huff_refill(b3, c3, p3);
+
+			for (uint32_t j = 0; j < 4; j++)
+			{
+				pOut[0] = huff_decode_sym(b0, c0, pTable);
+				pOut[1] = huff_decode_sym(b1, c1, pTable);
+				pOut[2] = huff_decode_sym(b2, c2, pTable);
+				pOut[3] = huff_decode_sym(b3, c3, pTable);
+				pOut += 4;
+			}
+		}
+
+		const uint8_t* p[cHuffStreams] = { p0, p1, p2, p3 };
+		uint64_t b[cHuffStreams] = { b0, b1, b2, b3 };
+		uint32_t c[cHuffStreams] = { c0, c1, c2, c3 };
+
+		for (uint32_t k = 0; pOut < pOut_end; k = (k + 1) & (cHuffStreams - 1))
+		{
+			huff_refill_safe(b[k], c[k], p[k], pSrc_end);
+			*pOut++ = huff_decode_sym(b[k], c[k], pTable);
+		}
+
+		return true;
+	}
+
+} // namespace sserangecoder
@@ -0,0 +1,43 @@
+// sserangehuff.h
+// Interleaved length limited Huffman codec, an alternative backend to the range coder, Richard Geldreich, Jr., public domain (see full text at unlicense.org)
+#pragma once
+#include "sserangecoder.h"
+
+namespace sserangecoder
+{
+	// Code lengths are limited with package-merge so the decode table has 4096 entries, like the range coder's 12-bit probabilities.
+	const uint32_t cHuffMaxCodeLen = 12;
+	const uint32_t cHuffTableSize = 1 << cHuffMaxCodeLen;
+
+	// Symbol i is coded into bit stream (i & (cHuffStreams - 1)), so the decoder can follow the streams in parallel.
+	const uint32_t cHuffStreams = 4;
+
+	// The encoded data starts with the sizes of the first cHuffStreams - 1 streams (4 bytes each, LE), and ends with this many zero bytes
+	// so the decoder can always read whole 64-bit words.
+	const uint32_t cHuffPadding = 8;
+	const uint32_t cHuffOverheadSize = (cHuffStreams - 1) * sizeof(uint32_t) + cHuffPadding;
+
+	typedef std::vector<uint16_t> uint16_vec;
+
+	// Computes length limited code lengths for the 256 entry histogram. pCode_lens receives 256 lengths (0 for unused symbols).
+	// Returns false if the histogram is empty.
+	bool vrange_huff_create_code_lens(const uint32_t* pHist, uint8_t* pCode_lens);
+
+	// Returns the number of bits needed to code the symbols in pHist, not including any overhead.
+	uint64_t vrange_huff_get_hist_bits(const uint32_t* pHist, const uint8_t* pCode_lens);
+
+	// Code length serialization: a 256-bit used symbol mask followed by each used symbol's code length in 4 bits.
+	uint32_t vrange_huff_get_code_lens_size(const uint8_t* pCode_lens);
+	void vrange_huff_write_code_lens(const uint8_t* pCode_lens, uint8_vec& buf);
+	bool vrange_huff_read_code_lens(const uint8_t*& pSrc, const uint8_t* pSrc_end, uint8_t* pCode_lens);
+
+	// Creates the decoding table: cHuffTableSize entries, each the symbol in the low 8 bits and its code length in the high 8 bits.
+	void vrange_huff_init_table(const uint8_t* pCode_lens, uint16_vec& dec_table);
+
+	// Encodes data_size bytes. Every symbol in pData must have a non-zero code length.
+	void vrange_huff_encode(const uint8_t* pData, size_t data_size, uint8_vec& enc_buf, const uint8_t* pCode_lens);
+
+	// Decodes exactly dst_size bytes. Corrupted input can't cause reads outside of [pSrc, pSrc + src_size), but may decode to garbage.
+	bool vrange_huff_decode(const uint8_t* pSrc, size_t src_size, uint8_t* pDst, size_t dst_size, const uint16_t* pTable);
+
+} // namespace sserangecoder
@@ -0,0 +1,389 @@
+// sserangelz.cpp
+// LZ77 front end for the interleaved range coder, Richard Geldreich, Jr., public domain (see full text at unlicense.org)
+#include "sserangelz.h"
+#include <algorithm>
+
+namespace sserangecoder
+{
+	const uint32_t cLZHashBits = 16;
+	const uint32_t cLZHashSize = 1 << cLZHashBits;
+
+	// Positions are stored in 32-bit hash tables, so the tables are reset every cLZSegmentSize bytes. Matches never cross a segment boundary.
+	const size_t cLZSegmentSize = 1024U * 1024U * 1024U;
+
+	// Slack at the end of decoded streams, so the literal copies can read past the end
+	const uint32_t cLZStreamPadding = 16;
+
+	static inline uint32_t read_le32(const uint8_t* p)
+	{
+		uint32_t v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	static inline uint32_t hash4(const uint8_t* p)
+	{
+		return (read_le32(p) * 2654435761U) >> (32 - cLZHashBits);
+	}
+
+	// Lengths are coded as 1 byte if < 254, otherwise a 254 or 255 escape byte followed by 2 or 4 bytes.
+	static void put_len(uint8_vec& buf, uint32_t len)
+	{
+		if (len < 254)
+			buf.push_back((uint8_t)len);
+		else if ((len - 254) < 65536)
+		{
+			buf.push_back(254);
+			buf.push_back((uint8_t)(len - 254));
+			buf.push_back((uint8_t)((len - 254) >> 8));
+		}
+		else
+		{
+			buf.push_back(255);
+			for (uint32_t i = 0; i < 4; i++)
+				buf.push_back((uint8_t)(len >> (i * 8)));
+		}
+	}
+
+	static sser_forceinline bool get_len(const uint8_t*& pSrc, const uint8_t* pSrc_end, uint32_t& len)
+	{
+		if (pSrc >= pSrc_end)
+			return false;
+
+		len = *pSrc++;
+		if (len < 254)
+			return true;
+
+		if (len == 254)
+		{
+			if ((pSrc_end - pSrc) < 2)
+				return false;
+
+			len = 254 + (pSrc[0] | (pSrc[1] << 8));
+			pSrc += 2;
+		}
+		else
+		{
+			if ((pSrc_end - pSrc) < 4)
+				return false;
+
+			len = read_le32(pSrc);
+			pSrc += 4;
+		}
+
+		return true;
+	}
+
+	class lz_match_finder
+	{
+	public:
+		lz_match_finder() : m_head(cLZHashSize), m_prev(cLZWindowSize) { }
+
+		void reset(const uint8_t* pBase)
+		{
+			m_pBase = pBase;
+			memset(&m_head[0], 0, m_head.size() * sizeof(m_head[0]));
+		}
+
+		// Adds pos to the hash chains. Positions are stored biased by 1, 0 means empty.
+		inline void insert(uint32_t pos)
+		{
+			const uint32_t h = hash4(m_pBase + pos);
+			m_prev[pos & (cLZWindowSize - 1)] = m_head[h];
+			m_head[h] = pos + 1;
+		}
+
+		// Finds the longest match at pos (that ends at or before end_pos), then inserts pos. Returns the match length, or 0 if there's no match.
+		uint32_t find_match_and_insert(uint32_t pos, uint32_t end_pos, uint32_t max_chain_len, uint32_t& match_ofs)
+		{
+			const uint8_t* pCur = m_pBase + pos;
+			const uint32_t max_len = end_pos - pos;
+			const uint32_t h = hash4(pCur);
+
+			uint32_t best_len = 0;
+			uint32_t cand = m_head[h];
+
+			for (uint32_t chain_len = 0; (cand) && (chain_len < max_chain_len); chain_len++)
+			{
+				const uint32_t cand_pos = cand - 1;
+				const uint32_t dist = pos - cand_pos;
+				if ((dist >= cLZWindowSize) || (!dist))
+					break;
+
+				const uint8_t* pCand = m_pBase + cand_pos;
+
+				// Check the byte which would extend the current best match first
+				if ((pCand[best_len] == pCur[best_len]) && (read_le32(pCand) == read_le32(pCur)))
+				{
+					uint32_t len = cLZMinMatchLen;
+					while ((len < max_len) && (pCand[len] == pCur[len]))
+						len++;
+
+					if (len > best_len)
+					{
+						best_len = len;
+						match_ofs = dist;
+
+						if (len == max_len)
+							break;
+					}
+				}
+
+				const uint32_t next = m_prev[cand_pos & (cLZWindowSize - 1)];
+				if (next >= cand)
+					break;
+
+				cand = next;
+			}
+
+			m_prev[pos & (cLZWindowSize - 1)] = m_head[h];
+			m_head[h] = pos + 1;
+
+			return (best_len >= cLZMinMatchLen) ? best_len : 0;
+		}
+
+	private:
+		const uint8_t* m_pBase;
+		uint32_vec m_head, m_prev;
+	};
+
+	// Parses [chunk_pos, chunk_end) (positions relative to the match finder's base) into the LZ streams
+	static void lz_parse_chunk(lz_match_finder& mf, const uint8_t* pBase, uint32_t chunk_pos, uint32_t chunk_end, const vrange_lz_params& params, uint8_vec* pStreams)
+	{
+		uint32_t pos = chunk_pos, lit_start = chunk_pos;
+
+		// Matches must leave room to read the 4 bytes hashed at each position
+		const uint32_t match_limit = (chunk_end - chunk_pos) >= cLZMinMatchLen ? (chunk_end - cLZMinMatchLen + 1) : chunk_pos;
+
+		while (pos < match_limit)
+		{
+			uint32_t match_ofs = 0;
+			uint32_t match_len = mf.find_match_and_insert(pos, chunk_end, params.m_max_chain_len, match_ofs);
+
+			if (!match_len)
+			{
+				pos++;
+				continue;
+			}
+
+			if (params.m_lazy_matching)
+			{
+				while ((pos + 1) < match_limit)
+				{
+					uint32_t next_ofs = 0;
+					const uint32_t next_len = mf.find_match_and_insert(pos + 1, chunk_end, params.m_max_chain_len, next_ofs);
+					if (next_len <= match_len)
+						break;
+
+					pos++;
+					match_len = next_len;
+					match_ofs = next_ofs;
+				}
+			}
+
+			put_len(pStreams[cLZStreamLengths], pos - lit_start);
+			pStreams[cLZStreamLiterals].insert(pStreams[cLZStreamLiterals].end(), pBase + lit_start, pBase + pos);
+
+			put_len(pStreams[cLZStreamLengths], match_len - cLZMinMatchLen);
+			pStreams[cLZStreamOffsetsLo].push_back((uint8_t)match_ofs);
+			pStreams[cLZStreamOffsetsHi].push_back((uint8_t)(match_ofs >> 8));
+
+			// Insert the positions covered by the match (a lazy match may have already inserted pos + 1)
+			const uint32_t match_end = pos + match_len;
+			for (uint32_t i = pos + 1 + (params.m_lazy_matching ? 1 : 0); i < std::min(match_end, match_limit); i++)
+				mf.insert(i);
+
+			pos = match_end;
+			lit_start = pos;
+		}
+
+		// The final literal run, which isn't followed by a match
+		put_len(pStreams[cLZStreamLengths], chunk_end - lit_start);
+		pStreams[cLZStreamLiterals].insert(pStreams[cLZStreamLiterals].end(), pBase + lit_start, pBase + chunk_end);
+	}
+
+	bool vrange_lz_compress(const uint8_t* pData, size_t data_size, uint8_vec& comp_data, const vrange_lz_params& params)
+	{
+		const uint32_t chunk_size = clamp<uint32_t>(params.m_chunk_size, 1, cLZMaxChunkSize);
+
+		lz_match_finder mf;
+
+		// One block encoder per stream type, so each stream can keep reusing its model across chunks
+		vrange_block_encoder encs[cLZTotalStreams];
+		uint8_vec streams[cLZTotalStreams];
+
+		for (size_t seg_ofs = 0; seg_ofs < data_size; seg_ofs += cLZSegmentSize)
+		{
+			const uint8_t* pSeg = pData + seg_ofs;
+			const uint32_t seg_size = (uint32_t)std::min(cLZSegmentSize, data_size - seg_ofs);
+
+			mf.reset(pSeg);
+
+			for (uint32_t chunk_pos = 0; chunk_pos < seg_size; chunk_pos += chunk_size)
+			{
+				const uint32_t chunk_end = std::min(seg_size, chunk_pos + chunk_size);
+
+				for (uint32_t i = 0; i < cLZTotalStreams; i++)
+					streams[i].resize(0);
+
+				lz_parse_chunk(mf, pSeg, chunk_pos, chunk_end, params, streams);
+
+				const uint32_t chunk_orig_size = chunk_end - chunk_pos;
+				for (uint32_t i = 0; i < 4; i++)
+					comp_data.push_back((uint8_t)(chunk_orig_size >> (i * 8)));
+
+				for (uint32_t i = 0; i < cLZTotalStreams; i++)
+				{
+					if (streams[i].size() > cRangeBlockMaxSize)
+						return false;
+
+					if (!encs[i].encode_block(streams[i].data(), (uint32_t)streams[i].size(), comp_data, true))
+						return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	// Copies a match of len bytes from offset bytes behind pDst. Writes up to 15 bytes past the match when there's room before pDst_end.
+	static sser_forceinline void lz_copy_match(uint8_t* pDst, uint8_t* pDst_end, uint32_t offset, uint32_t len)
+	{
+		const uint8_t* pSrc = pDst - offset;
+
+		if ((offset >= 16) && ((size_t)(pDst_end - pDst) >= (len + 16)))
+		{
+			// Wild copy 16 bytes at a time
+			uint8_t* pEnd = pDst + len;
+			do
+			{
+				_mm_storeu_si128((__m128i*)pDst, _mm_loadu_si128((const __m128i*)pSrc));
+				pDst += 16;
+				pSrc += 16;
+			} while (pDst < pEnd);
+		}
+		else if ((offset >= 8) && ((size_t)(pDst_end - pDst) >= (len + 8)))
+		{
+			uint8_t* pEnd = pDst + len;
+			do
+			{
+				memcpy(pDst, pSrc, 8);
+				pDst += 8;
+				pSrc += 8;
+			} while (pDst < pEnd);
+		}
+		else
+		{
+			// Short offsets overlap the bytes being written
+			for (uint32_t i = 0; i < len; i++)
+				pDst[i] = pSrc[i];
+		}
+	}
+
+	bool vrange_lz_decompress(const uint8_t* pComp, size_t comp_size, uint8_t* pDst, size_t dst_size)
+	{
+		const uint8_t* pSrc = pComp;
+		const uint8_t* pSrc_end = pComp + comp_size;
+		uint8_t* pDst_end = pDst + dst_size;
+
+		vrange_block_decoder decs[cLZTotalStreams];
+		uint8_vec streams[cLZTotalStreams];
+
+		size_t seg_ofs = 0;
+		uint8_t* pOut = pDst;
+
+		while (pOut < pDst_end)
+		{
+			if ((pSrc_end - pSrc) < 4)
+				return false;
+
+			const uint32_t chunk_orig_size = pSrc[0] | (pSrc[1] << 8) | (pSrc[2] << 16) | ((uint32_t)pSrc[3] << 24);
+			pSrc += 4;
+
+			if ((!chunk_orig_size) || (chunk_orig_size > cLZMaxChunkSize) || (chunk_orig_size > (size_t)(pDst_end - pOut)))
+				return false;
+
+			// Matches can't reach back past the start of the segment
+			if ((size_t)(pOut - pDst) >= (seg_ofs + cLZSegmentSize))
+				seg_ofs += cLZSegmentSize;
+
+			const uint8_t* pSeg = pDst + seg_ofs;
+
+			uint32_t stream_sizes[cLZTotalStreams];
+
+			for (uint32_t i = 0; i < cLZTotalStreams; i++)
+			{
+				if (!vrange_block_decoder::peek_block_size(pSrc, pSrc_end, stream_sizes[i]))
+					return false;
+
+				if (streams[i].size() < (stream_sizes[i] + cLZStreamPadding))
+					streams[i].resize(stream_sizes[i] + cLZStreamPadding);
+
+				uint32_t decoded_size;
+				if (!decs[i].decode_block(pSrc, pSrc_end, &streams[i][0], stream_sizes[i], decoded_size))
+					return false;
+			}
+
+			const uint8_t* pLits = &streams[cLZStreamLiterals][0];
+			const uint8_t* pLits_end = pLits + stream_sizes[cLZStreamLiterals];
+			const uint8_t* pLens = &streams[cLZStreamLengths][0];
+			const uint8_t* pLens_end = pLens + stream_sizes[cLZStreamLengths];
+			const uint8_t* pOfs_lo = &streams[cLZStreamOffsetsLo][0];
+			const uint8_t* pOfs_hi = &streams[cLZStreamOffsetsHi][0];
+			const size_t num_offsets = stream_sizes[cLZStreamOffsetsLo];
+
+			if (stream_sizes[cLZStreamOffsetsHi] != num_offsets)
+				return false;
+
+			uint8_t* pChunk_end = pOut + chunk_orig_size;
+			size_t cur_offset = 0;
+
+			for (; ; )
+			{
+				uint32_t lit_len;
+				if (!get_len(pLens, pLens_end, lit_len))
+					return false;
+
+				if ((lit_len > (size_t)(pChunk_end - pOut)) || (lit_len > (size_t)(pLits_end - pLits)))
+					return false;
+
+				// The literal stream is padded, so it's safe to read past its end
+				if ((size_t)(pDst_end - pOut) >= (lit_len + 16))
+				{
+					for (uint32_t i = 0; i < lit_len; i += 16)
+						_mm_storeu_si128((__m128i*)(pOut + i), _mm_loadu_si128((const __m128i*)(pLits + i)));
+				}
+				else if (lit_len)
+					memcpy(pOut, pLits, lit_len);
+
+				pOut += lit_len;
+				pLits += lit_len;
+
+				if (pOut == pChunk_end)
+					break;
+
+				uint32_t match_len;
+				if ((!get_len(pLens, pLens_end, match_len)) || (cur_offset >= num_offsets))
+					return false;
+
+				match_len += cLZMinMatchLen;
+
+				const uint32_t match_ofs = pOfs_lo[cur_offset] | (pOfs_hi[cur_offset] << 8);
+				cur_offset++;
+
+				if ((match_len > (size_t)(pChunk_end - pOut)) || (!match_ofs) || (match_ofs > (size_t)(pOut - pSeg)))
+					return false;
+
+				lz_copy_match(pOut, pDst_end, match_ofs, match_len);
+				pOut += match_len;
+			}
+
+			// All of the chunk's streams must be fully consumed
+			if ((pLits != pLits_end) || (pLens != pLens_end) || (cur_offset != num_offsets))
+				return false;
+		}
+
+		return pSrc == pSrc_end;
+	}
+
+} // namespace sserangecoder
@@ -0,0 +1,60 @@
+// sserangelz.h
+// LZ77 front end for the interleaved range coder, Richard Geldreich, Jr., public domain (see full text at unlicense.org)
+#pragma once
+#include "sserangeblocks.h"
+
+namespace sserangecoder
+{
+	// The LZ parse is split into byte streams, each range coded as a separate block with its own model:
+	// literals, lengths (literal run and match lengths), and the low and high bytes of the match offsets.
+	enum
+	{
+		cLZStreamLiterals,
+		cLZStreamLengths,
+		cLZStreamOffsetsLo,
+		cLZStreamOffsetsHi,
+
+		cLZTotalStreams
+	};
+
+	const uint32_t cLZMinMatchLen = 4;
+	const uint32_t cLZWindowSize = 65536;
+	const uint32_t cLZMaxChunkSize = 16 * 1024 * 1024;
+
+	struct vrange_lz_params
+	{
+		vrange_lz_params() { clear(); }
+
+		void clear()
+		{
+			set_level(2);
+			m_chunk_size = 1024 * 1024;
+		}
+
+		// Level 0 is fastest (greedy, short chains), level 3 gives the highest ratio (lazy, long chains)
+		void set_level(uint32_t level)
+		{
+			static const uint32_t s_max_chain_len[4] = { 4, 16, 48, 256 };
+
+			level = std::min<uint32_t>(level, 3);
+			m_max_chain_len = s_max_chain_len[level];
+			m_lazy_matching = level >= 2;
+		}
+
+		// Max number of hash chain entries examined per position
+		uint32_t m_max_chain_len;
+
+		// If true, a match is deferred by one byte when the next position has a longer match
+		bool m_lazy_matching;
+
+		// The input is parsed and coded in chunks of this size (max cLZMaxChunkSize). Matches can reach back into previous chunks.
+		uint32_t m_chunk_size;
+	};
+
+	// Compresses pData with LZ77 + range coding, appending the result to comp_data.
+	bool vrange_lz_compress(const uint8_t* pData, size_t data_size, uint8_vec& comp_data, const vrange_lz_params& params);
+
+	// Decompresses data created by vrange_lz_compress(). Fails unless exactly dst_size bytes are decoded.
+	bool vrange_lz_decompress(const uint8_t* pComp, size_t comp_size, uint8_t* pDst, size_t dst_size);
+
+} // namespace sserangecoder
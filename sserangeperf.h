@@ -0,0 +1,214 @@
+// sserangeperf.h
+// Optional hardware performance counters (Linux perf_event_open) for instrumenting the codec, Richard Geldreich, Jr., public domain (see full text at unlicense.org)
+#pragma once
+#include "sserangecoder.h"
+
+// Set to 1 to enable the counters (Linux only). When 0, vrange_perf_counters is an empty class whose methods are inline no-ops.
+#ifndef SSER_USE_PERF_COUNTERS
+#define SSER_USE_PERF_COUNTERS 0
+#endif
+
+#if SSER_USE_PERF_COUNTERS
+#ifndef __linux__
+#error SSER_USE_PERF_COUNTERS requires Linux
+#endif
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <string.h>
+#include <cpuid.h>
+#endif
+
+namespace sserangecoder
+{
+	enum vrange_perf_event
+	{
+		cPerfCycles,
+		cPerfInstructions,
+		cPerfL1DMisses,
+		cPerfBranchMisses,
+		cPerfUops,
+		cTotalPerfEvents
+	};
+
+	inline const char* vrange_get_perf_event_name(uint32_t event)
+	{
+		static const char* s_names[cTotalPerfEvents] = { "cycles", "instructions", "l1d_misses", "branch_misses", "uops" };
+		assert(event < cTotalPerfEvents);
+		return s_names[event];
+	}
+
+	// Accumulated event counts. Events the CPU or kernel doesn't support aren't valid.
+	struct vrange_perf_sample
+	{
+		vrange_perf_sample() { clear(); }
+
+		void clear()
+		{
+			for (uint32_t i = 0; i < cTotalPerfEvents; i++)
+			{
+				m_counts[i] = 0;
+				m_valid[i] = false;
+			}
+		}
+
+		uint64_t m_counts[cTotalPerfEvents];
+		bool m_valid[cTotalPerfEvents];
+	};
+
+#if SSER_USE_PERF_COUNTERS
+	// Counts user mode events of the calling thread between start() and stop(). Each event is opened separately, so missing events (e.g. uops on
+	// an unknown CPU, or any event in a VM without a virtual PMU) don't disable the others. Counts are scaled if the kernel multiplexes the counters.
+	class vrange_perf_counters
+	{
+	public:
+		vrange_perf_counters()
+		{
+			for (uint32_t i = 0; i < cTotalPerfEvents; i++)
+				m_fds[i] = -1;
+		}
+
+		~vrange_perf_counters() { clear(); }
+
+		void clear()
+		{
+			for (uint32_t i = 0; i < cTotalPerfEvents; i++)
+			{
+				if (m_fds[i] >= 0)
+					close(m_fds[i]);
+				m_fds[i] = -1;
+			}
+		}
+
+		// Returns true if at least one event could be opened. perf_event_paranoid must be <= 2 (or the process needs CAP_PERFMON).
+		bool init()
+		{
+			clear();
+
+			bool any_opened = false;
+			for (uint32_t i = 0; i < cTotalPerfEvents; i++)
+			{
+				uint32_t type;
+				uint64_t config;
+				if (!get_event_config(i, type, config))
+					continue;
+
+				perf_event_attr attr;
+				memset(&attr, 0, sizeof(attr));
+				attr.size = sizeof(attr);
+				attr.type = type;
+				attr.config = config;
+				attr.disabled = 1;
+				attr.exclude_kernel = 1;
+				attr.exclude_hv = 1;
+				attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+				m_fds[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+				if (m_fds[i] >= 0)
+					any_opened = true;
+			}
+
+			return any_opened;
+		}
+
+		bool is_available() const
+		{
+			for (uint32_t i = 0; i < cTotalPerfEvents; i++)
+				if (m_fds[i] >= 0)
+					return true;
+			return false;
+		}
+
+		void start()
+		{
+			for (uint32_t i = 0; i < cTotalPerfEvents; i++)
+			{
+				if (m_fds[i] >= 0)
+				{
+					ioctl(m_fds[i], PERF_EVENT_IOC_RESET, 0);
+					ioctl(m_fds[i], PERF_EVENT_IOC_ENABLE, 0);
+				}
+			}
+		}
+
+		// Stops counting and adds the counts since start() to sample
+		void stop(vrange_perf_sample& sample)
+		{
+			for (uint32_t i = 0; i < cTotalPerfEvents; i++)
+				if (m_fds[i] >= 0)
+					ioctl(m_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+			for (uint32_t i = 0; i < cTotalPerfEvents; i++)
+			{
+				if (m_fds[i] < 0)
+					continue;
+
+				// value, time enabled, time running
+				uint64_t vals[3];
+				if ((read(m_fds[i], vals, sizeof(vals)) != (ssize_t)sizeof(vals)) || (!vals[2]))
+					continue;
+
+				uint64_t count = vals[0];
+				if (vals[2] < vals[1])
+					count = (uint64_t)((double)count * ((double)vals[1] / (double)vals[2]));
+
+				sample.m_counts[i] += count;
+				sample.m_valid[i] = true;
+			}
+		}
+
+	private:
+		int m_fds[cTotalPerfEvents];
+
+		static bool get_event_config(uint32_t event, uint32_t& type, uint64_t& config)
+		{
+			type = PERF_TYPE_HARDWARE;
+
+			switch (event)
+			{
+			case cPerfCycles: config = PERF_COUNT_HW_CPU_CYCLES; return true;
+			case cPerfInstructions: config = PERF_COUNT_HW_INSTRUCTIONS; return true;
+			case cPerfBranchMisses: config = PERF_COUNT_HW_BRANCH_MISSES; return true;
+			case cPerfL1DMisses:
+				type = PERF_TYPE_HW_CACHE;
+				config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+				return true;
+			default: break;
+			}
+
+			assert(event == cPerfUops);
+
+			// There's no generic uops event, so use a raw one: UOPS_ISSUED.ANY on Intel, retired ops on AMD Zen
+			uint32_t eax, ebx, ecx, edx;
+			if (!__get_cpuid(0, &eax, &ebx, &ecx, &edx))
+				return false;
+
+			type = PERF_TYPE_RAW;
+
+			if ((ebx == 0x756e6547) && (edx == 0x49656e69) && (ecx == 0x6c65746e)) // "GenuineIntel"
+				config = 0x010E;
+			else if ((ebx == 0x68747541) && (edx == 0x69746e65) && (ecx == 0x444d4163)) // "AuthenticAMD"
+				config = 0x00C1;
+			else
+				return false;
+
+			return true;
+		}
+
+		vrange_perf_counters(const vrange_perf_counters&);
+		vrange_perf_counters& operator= (const vrange_perf_counters&);
+	};
+#else
+	class vrange_perf_counters
+	{
+	public:
+		void clear() { }
+		bool init() { return false; }
+		bool is_available() const { return false; }
+		void start() { }
+		void stop(vrange_perf_sample& sample) { (void)sample; }
+	};
+#endif
+
+} // namespace sserangecoder
@@ -0,0 +1,91 @@
+// sserangescalar.cpp
+// Portable scalar decoder for the interleaved range coder's streams, which doesn't need SSE 4.1 (built without -msse4.1), Richard Geldreich, Jr., public domain (see full text at unlicense.org)
+#include "sserangescalar.h"
+
+namespace sserangecoder
+{
+	// ceil(2^cRangeRecipShift / r), or 0 if that doesn't fit in 32 bits (r <= 16, r < 16 never occurs in valid streams)
+	static constexpr uint32_t range_recip(uint32_t r)
+	{
+		return (r <= 16) ? 0 : (uint32_t)(((1ULL << cRangeRecipShift) + r - 1) / r);
+	}
+
+#define SSER_REP4(m, i) m(i), m((i) + 1), m((i) + 2), m((i) + 3)
+#define SSER_REP16(m, i) SSER_REP4(m, i), SSER_REP4(m, (i) + 4), SSER_REP4(m, (i) + 8), SSER_REP4(m, (i) + 12)
+#define SSER_REP64(m, i) SSER_REP16(m, i), SSER_REP16(m, (i) + 16), SSER_REP16(m, (i) + 32), SSER_REP16(m, (i) + 48)
+#define SSER_REP256(m, i) SSER_REP64(m, i), SSER_REP64(m, (i) + 64), SSER_REP64(m, (i) + 128), SSER_REP64(m, (i) + 192)
+#define SSER_REP1024(m, i) SSER_REP256(m, i), SSER_REP256(m, (i) + 256), SSER_REP256(m, (i) + 512), SSER_REP256(m, (i) + 768)
+#define SSER_REP4096(m, i) SSER_REP1024(m, i), SSER_REP1024(m, (i) + 1024), SSER_REP1024(m, (i) + 2048), SSER_REP1024(m, (i) + 3072)
+
+	alignas(16) const uint32_t g_range_recip[cRangeCodecProbScale] = { SSER_REP4096(range_recip, 0) };
+
+#undef SSER_REP4
+#undef SSER_REP16
+#undef SSER_REP64
+#undef SSER_REP256
+#undef SSER_REP1024
+#undef SSER_REP4096
+
+	template <uint32_t NUM_LANES>
+	static bool vrange_decode_scalar_lanes(const uint8_t* pSrc_start, size_t comp_size, uint8_t* pDst_start, size_t orig_size, const uint32_t* pDec_table)
+	{
+		// One group of lanes reads at most 2 bytes per lane
+		const uint32_t max_iter_bytes = NUM_LANES * 2;
+
+		if (comp_size < NUM_LANES * 3)
+			return false;
+
+		const uint8_t* pSrc = pSrc_start;
+		const uint8_t* pSrc_end = pSrc_start + comp_size;
+
+		uint32_t arith_value[NUM_LANES], arith_length[NUM_LANES];
+		for (uint32_t lane = 0; lane < NUM_LANES; lane++)
+		{
+			arith_value[lane] = read_be24(pSrc);
+			arith_length[lane] = cRangeCodecMaxLen;
+		}
+
+		size_t dst_ofs = 0;
+
+		vrange_decode_tail tail;
+
+		for ( ; ; )
+		{
+			for ( ; ((dst_ofs + NUM_LANES) <= orig_size) && (pSrc + max_iter_bytes) <= pSrc_end; dst_ofs += NUM_LANES)
+			{
+				for (uint32_t lane = 0; lane < NUM_LANES; lane++)
+					pDst_start[dst_ofs + lane] = (uint8_t)vrange_decode_scalar(arith_value[lane], arith_length[lane], pDec_table);
+
+				// The lanes' bytes are interleaved in symbol order
+				for (uint32_t lane = 0; lane < NUM_LANES; lane++)
+					vrange_normalize_scalar(arith_value[lane], arith_length[lane], pSrc);
+			}
+
+			if ((dst_ofs + NUM_LANES) > orig_size)
+				break;
+
+			if (!tail.begin(pSrc, pSrc_end, pSrc_start))
+				return false;
+		}
+
+		// The last symbols don't need renormalizing, so no input is read
+		const size_t num_left = orig_size - dst_ofs;
+		for (uint32_t lane = 0; lane < num_left; lane++)
+			pDst_start[dst_ofs + lane] = (uint8_t)vrange_decode_scalar(arith_value[lane], arith_length[lane], pDec_table);
+
+		return tail.get_bytes_read(pSrc, pSrc_start) <= comp_size;
+	}
+
+	bool vrange_decode_scalar(const uint8_t* pSrc_start, size_t comp_size, uint8_t* pDst_start, size_t orig_size, const uint32_t* pDec_table, uint32_t num_lanes)
+	{
+		switch (num_lanes)
+		{
+		case 4: return vrange_decode_scalar_lanes<4>(pSrc_start, comp_size, pDst_start, orig_size, pDec_table);
+		case 8: return vrange_decode_scalar_lanes<8>(pSrc_start, comp_size, pDst_start, orig_size, pDec_table);
+		case 16: return vrange_decode_scalar_lanes<16>(pSrc_start, comp_size, pDst_start, orig_size, pDec_table);
+		default: break;
+		}
+
+		return false;
+	}
+}
@@ -0,0 +1,98 @@
+// sserangescalar.h
+// Portable scalar decoder for the interleaved range coder's streams, which doesn't need SSE 4.1 (built without -msse4.1), Richard Geldreich, Jr., public domain (see full text at unlicense.org)
+#pragma once
+#include "sserangebase.h"
+
+namespace sserangecoder
+{
+	// Scalar decoding replaces the divide by r = (length >> cRangeCodecProbBits) with a multiply by g_range_recip[r] = ceil(2^cRangeRecipShift / r),
+	// which gives the exact quotient for any 24-bit value and r in [16, 4096). ceil(2^36 / 16) needs 33 bits, so it's stored as 0 and handled with a select.
+	const uint32_t cRangeRecipShift = 36;
+	extern const uint32_t g_range_recip[cRangeCodecProbScale];
+
+	static sser_forceinline uint32_t vrange_scalar_quotient(uint32_t arith_value, uint32_t r)
+	{
+		const uint64_t m = g_range_recip[r];
+		return (uint32_t)((arith_value * m + (m ? 0 : ((uint64_t)arith_value << 32))) >> cRangeRecipShift);
+	}
+
+	// Decodes one symbol from a scalar range coder's state using the packed vrange_init_table() entries, without renormalizing
+	static sser_forceinline uint32_t vrange_decode_scalar(uint32_t& arith_value, uint32_t& arith_length, const uint32_t* pTable)
+	{
+		const uint32_t r = arith_length >> cRangeCodecProbBits;
+
+		// AND is for safety in case the input stream is corrupted, it's not stricly necessary if you know it can't be
+		const uint32_t encoded_val = pTable[vrange_scalar_quotient(arith_value, r) & (cRangeCodecProbScale - 1)];
+
+		arith_value -= ((encoded_val >> 8) & (cRangeCodecProbScale - 1)) * r;
+		arith_length = (encoded_val >> (8 + 12)) * r;
+
+		return encoded_val & 255;
+	}
+
+	// Branch-free renormalization: always loads 2 bytes from pSrc and consumes [0,2] of them. The streams end with 2 bytes of padding, so this never
+	// reads past a valid stream.
+	static sser_forceinline void vrange_normalize_scalar(uint32_t& arith_value, uint32_t& arith_length, const uint8_t*& pSrc)
+	{
+		const uint32_t num_bytes = (arith_length < cRangeCodecMinLen) + (arith_length < 256);
+		const uint32_t shift = num_bytes * 8;
+		const uint32_t src_bits = (pSrc[0] << 8) | pSrc[1];
+
+		arith_value = (arith_value << shift) | (src_bits >> (16 - shift));
+		arith_length <<= shift;
+
+		pSrc += num_bytes;
+	}
+
+	static sser_forceinline uint32_t read_be24(const uint8_t*& pSrc)
+	{
+		const uint32_t res = (pSrc[0] << 16) | (pSrc[1] << 8) | pSrc[2];
+		pSrc += 3;
+		return res;
+	}
+
+	// One iteration of the vector decoders reads at most 32 bytes past pSrc (4 normalizes, each loading 8 bytes and consuming up to 8), and one group of
+	// the scalar decoder's lanes at most 2 per lane. Once less than that remains, decoding continues from a zero padded copy of the input's tail, so every
+	// symbol is decoded by the same code without ever reading past the end of the input. Shared with the SSE 4.1 decoders in sserangecoder.cpp.
+	const uint32_t cDecodeTailBufSize = 64;
+
+	struct vrange_decode_tail
+	{
+		vrange_decode_tail() : m_src_ofs(0), m_active(false) { }
+
+		// Returns false if the copy is already in use: a valid stream never consumes the zero padding, so the input must be corrupted.
+		bool begin(const uint8_t*& pSrc, const uint8_t*& pSrc_end, const uint8_t* pSrc_start)
+		{
+			if (m_active)
+				return false;
+
+			assert(pSrc <= pSrc_end);
+			const size_t n = pSrc_end - pSrc;
+			assert(n < 32);
+
+			memset(m_buf, 0, sizeof(m_buf));
+			memcpy(m_buf, pSrc, n);
+
+			m_src_ofs = pSrc - pSrc_start;
+			m_active = true;
+
+			pSrc = m_buf;
+			pSrc_end = m_buf + cDecodeTailBufSize;
+			return true;
+		}
+
+		size_t get_bytes_read(const uint8_t* pSrc, const uint8_t* pSrc_start) const
+		{
+			return m_active ? (m_src_ofs + (pSrc - m_buf)) : (size_t)(pSrc - pSrc_start);
+		}
+
+		uint8_t m_buf[cDecodeTailBufSize];
+		size_t m_src_ofs;
+		bool m_active;
+	};
+
+	// Portable decoder for vrange_encode() streams which doesn't use SIMD, e.g. for hosts without SSE 4.1. The lanes are decoded as independent scalar
+	// states (all lanes' quotients are computed before any lane is renormalized, so the multiplies and table lookups overlap), using vrange_decode_scalar()
+	// and vrange_normalize_scalar(). Same output and safety guarantees as vrange_decode().
+	bool vrange_decode_scalar(const uint8_t* pSrc_start, size_t comp_size, uint8_t* pDst_start, size_t orig_size, const uint32_t* pDec_table, uint32_t num_lanes = LANES);
+}
@@ -1,9 +1,18 @@
 // SSE 4.1 Interleaved Range Coding example with an 8-bit alphabet, Richard Geldreich, Jr., public domain (see full text at unlicense.org)
 // Simple test app with 3 modes (compression/decompression testing, compression, or decompression)
 #include "sserangecoder.h"
+#include "sserangeblocks.h"
+#include "sserangelz.h"
+#include "sserangebwt.h"
+#include "sserangecoder_c.h"
+#include "sserangedict.h"
+#include "sserangealloc.h"
 #include <stdarg.h>
 #include <time.h>
 #include <math.h>
+#include <new>
+#include <atomic>
+#include <algorithm>
 
 // The CRC-32 check is so slow it's the bottleneck in this app during decompression (using the 'd' mode command), ignoring file I/O.
 // Disable if you only want to benchmark the decompressor (and file I/O) and not the slow CRC-32.
@@ -17,6 +26,45 @@
 #include <windows.h>
 #endif
 
+// The memory mapped compression/decompression modes use POSIX mmap()
+#ifndef _WIN32
+#define SSER_USE_MMAP 1
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#define SSER_USE_MMAP 0
+#endif
+
+// The pipelined 's'/'x' modes use threads and POSIX file descriptors. On Linux the reader uses io_uring when the kernel allows it.
+#ifndef _WIN32
+#define SSER_USE_PIPELINE 1
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <errno.h>
+#include <sys/uio.h>
+#else
+#define SSER_USE_PIPELINE 0
+#endif
+
+#ifndef SSER_USE_IO_URING
+#ifdef __linux__
+#define SSER_USE_IO_URING 1
+#else
+#define SSER_USE_IO_URING 0
+#endif
+#endif
+
+#if SSER_USE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+
 #ifdef _MSC_VER
 #pragma warning (disable:4127) // warning C4127: conditional expression is constant
 #endif
@@ -217,6 +265,34 @@ static void test_plain_range_coding(
 	printf("Decompression OK\n");
 }
 
+static void test_cold_start_decode(const uint8_vec& file_data, const uint32_vec& scaled_cum_prob, const uint32_vec& dec_table)
+{
+	printf("\nMeasuring cold start decoding latency:\n");
+
+	// This must run before any other vectorized decoding, so the decoder's lookup tables haven't been touched yet
+	const uint32_t size = std::min<uint32_t>((uint32_t)file_data.size(), 4096);
+
+	uint8_vec enc_buf;
+	vrange_encode(&file_data[0], size, enc_buf, scaled_cum_prob);
+
+	uint8_vec decoded_buf(size);
+
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		const uint64_t start_cycles = __rdtsc();
+
+		if (!vrange_decode(&enc_buf[0], enc_buf.size(), &decoded_buf[0], size, &dec_table[0]))
+			panic("vrange_decode() failed!\n");
+
+		const uint64_t total_cycles = __rdtsc() - start_cycles;
+
+		if (memcmp(&decoded_buf[0], &file_data[0], size) != 0)
+			panic("Decompression failed!\n");
+
+		printf("%s vrange_decode() of %u bytes: %llu cycles\n", i ? "Warm" : "First", size, (unsigned long long)total_cycles);
+	}
+}
+
 static void test_vectorized_range_coding(
 	const uint8_vec& file_data,
 	const uint32_vec& scaled_cum_prob,
@@ -275,221 +351,2922 @@ static void test_vectorized_range_coding(
 	} // r
 }
 
-static const char *g_file_sig = "Rc";
-const uint32_t TOTAL_HEADER_SIZE = 2 + sizeof(uint32_t) * 3 + 256 * 2;
-
-// Karl Malbrain's compact CRC-32. See "A compact CCITT crc16 and crc32 C implementation that balances processor cache usage against speed": http://www.geocities.com/malbrain/
-// This CRC-32 function is quite slow, but it's small.
-static uint32_t crc32(uint32_t crc, const uint8_t* ptr, size_t buf_len)
-{
-	static const uint32_t s_crc32[16] = { 0, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
-	  0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c };
-	uint32_t crcu32 = (uint32_t)crc;
-	if (!ptr) return 0;
-	crcu32 = ~crcu32; while (buf_len--) { uint8_t b = *ptr++; crcu32 = (crcu32 >> 4) ^ s_crc32[(crcu32 & 0xF) ^ (b & 0xF)]; crcu32 = (crcu32 >> 4) ^ s_crc32[(crcu32 & 0xF) ^ (b >> 4)]; }
-	return ~crcu32;
-}
-
-static bool interleaved_encode(const uint8_vec& file_data, uint8_vec& comp_data)
+static void test_scalar_decode(const uint8_vec& file_data, const uint32_vec& scaled_cum_prob, const uint32_vec& dec_table)
 {
-	const uint32_t file_size = (uint32_t)file_data.size();
-	if ((!file_size) || (file_size > UINT32_MAX))
-		return false;
-
-	const uint32_t file_data_crc32 = crc32(0, &file_data[0], file_size);
+	printf("\nTesting scalar decoding:\n");
 
-	uint32_vec sym_freq(256);
-	for (uint32_t i = 0; i < file_data.size(); i++)
-		sym_freq[file_data[i]]++;
-	
-	uint32_t max_freq = 0;
-	for (uint32_t i = 0; i < 256; i++)
-		max_freq = std::max<uint32_t>(max_freq, sym_freq[i]);
-	
-	// Reduce frequencies to 16-bits (hurts efficiency, but reduces the overhead).
-	for (uint32_t i = 0; i < 256; i++)
-		if (sym_freq[i])
-			sym_freq[i] = std::max<uint32_t>(1, (UINT16_MAX * (uint64_t)sym_freq[i] + (max_freq / 2)) / max_freq);
+	uint8_vec comp_data, decoded_data(file_data.size());
 
-	comp_data.resize(0);
-	comp_data.reserve(file_data.size());
-	
-	comp_data.push_back(g_file_sig[0]);
-	comp_data.push_back(g_file_sig[1]);
+	// Small messages, so every partial lane group and tail length gets decoded
+	for (uint32_t num_lanes = cRangeCodecMinLanes; num_lanes <= LANES; num_lanes *= 2)
+	{
+		for (uint32_t size = 1; size <= std::min<uint32_t>(300, (uint32_t)file_data.size()); size++)
+		{
+			vrange_encode(&file_data[0], size, comp_data, scaled_cum_prob, num_lanes);
 
-	for (uint32_t i = 0; i < 4; i++)
-		comp_data.push_back((uint8_t)(file_size >> (i * 8)) & 0xFF);
-	
-	const size_t comp_size_ofs = comp_data.size();
+			if ((!vrange_decode_scalar(&comp_data[0], comp_data.size(), &decoded_data[0], size, &dec_table[0], num_lanes)) || (memcmp(&decoded_data[0], &file_data[0], size) != 0))
+				panic("vrange_decode_scalar() failed on a %u byte message with %u lanes!\n", size, num_lanes);
+		}
+	}
 
-	for (uint32_t i = 0; i < 4; i++)
-		comp_data.push_back(0);
+	const double file_size_mb = (double)file_data.size() / (1024.0f * 1024.0f);
 
-	for (uint32_t i = 0; i < 4; i++)
-		comp_data.push_back((uint8_t)(file_data_crc32 >> (i * 8)) & 0xFF);
+	printf("Lanes | Scalar MiB/sec. | SIMD MiB/sec.\n");
 
-	for (uint32_t i = 0; i < 256; i++)
+	for (uint32_t num_lanes = cRangeCodecMinLanes; num_lanes <= LANES; num_lanes *= 2)
 	{
-		comp_data.push_back((uint8_t)sym_freq[i]);
-		comp_data.push_back((uint8_t)(sym_freq[i] >> 8));
-	}
+		vrange_encode(&file_data[0], file_data.size(), comp_data, scaled_cum_prob, num_lanes);
 
-	assert(TOTAL_HEADER_SIZE == comp_data.size());
+		double best_scalar_time = 1e+9f, best_simd_time = 1e+9f;
 
-	// Create the scaled cumulative probability table needed for encoding
-	uint32_vec scaled_cum_prob;
-	if (!vrange_create_cum_probs(scaled_cum_prob, sym_freq))
-		return false;
+		for (uint32_t trial = 0; trial < 8; trial++)
+		{
+			memset(&decoded_data[0], 0, decoded_data.size());
 
-	// Encode the symbols
-	uint8_vec enc_buf;
-	vrange_encode(file_data, enc_buf, scaled_cum_prob);
-	if (enc_buf.size() > UINT32_MAX)
-		return false;
-			
-	const size_t comp_data_ofs = comp_data.size();
-	if (comp_data.size() + enc_buf.size() > UINT32_MAX)
-		return false;
+			uint64_t start_time = get_clock();
+			if (!vrange_decode_scalar(&comp_data[0], comp_data.size(), &decoded_data[0], decoded_data.size(), &dec_table[0], num_lanes))
+				panic("vrange_decode_scalar() failed!\n");
+			best_scalar_time = std::min(best_scalar_time, (double)(get_clock() - start_time) / (double)get_ticks_per_sec());
 
-	comp_data.resize(comp_data.size() + enc_buf.size());
-	memcpy(&comp_data[comp_data_ofs], &enc_buf[0], enc_buf.size());
+			if (memcmp(&decoded_data[0], &file_data[0], file_data.size()) != 0)
+				panic("Scalar decompression failed!\n");
 
-	for (uint32_t i = 0; i < 4; i++)
-		comp_data[comp_size_ofs + i] = (uint8_t)(enc_buf.size() >> (i * 8));
+			start_time = get_clock();
+			if (!vrange_decode(&comp_data[0], comp_data.size(), &decoded_data[0], decoded_data.size(), &dec_table[0], num_lanes))
+				panic("vrange_decode() failed!\n");
+			best_simd_time = std::min(best_simd_time, (double)(get_clock() - start_time) / (double)get_ticks_per_sec());
+		}
 
-	return true;
+		printf("%5u | %15.1f | %13.1f\n", num_lanes, file_size_mb / best_scalar_time, file_size_mb / best_simd_time);
+	}
+
+	printf("Scalar decoding OK\n");
 }
 
-static bool interleaved_decode(const uint8_vec& comp_data, uint8_vec& decomp_data, uint32_t &expected_crc32)
+static void test_mt_encode(const uint8_vec& file_data, const uint32_vec& scaled_cum_prob)
 {
-	// Sanity check the input size
-	if (comp_data.size() < (TOTAL_HEADER_SIZE + LANES * 3))
-		return false;
+	printf("\nTesting multithreaded encoding:\n");
 
-	// Check for compressed file signature
-	if ((comp_data[0] != g_file_sig[0]) || (comp_data[1] != g_file_sig[1]))
-		return false;
+	// Always asks for several threads, book1 is large enough for up to 11. encode_mt() uses at most one per core, so on fewer cores this checks its fallback.
+	const uint32_t max_threads = std::max(8U, std::min(std::thread::hardware_concurrency(), cRangeEncodeMaxThreads));
 
-	const uint32_t orig_size = comp_data[2] | (comp_data[3] << 8) | (comp_data[4] << 16) | (comp_data[5] << 24);
-	const uint32_t comp_size = comp_data[6] | (comp_data[7] << 8) | (comp_data[8] << 16) | (comp_data[9] << 24);
-	expected_crc32 = comp_data[10] | (comp_data[11] << 8) | (comp_data[12] << 16) | (comp_data[13] << 24);
+	vrange_encoder_context enc_ctx, mt_enc_ctx;
+	uint8_vec comp_data(vrange_compress_bound(file_data.size())), mt_comp_data(comp_data.size());
 
-	// Sanity check the sizes in the header
-	if ((!orig_size) || (comp_size < LANES * 3))
-		return false;
+	printf("Lanes | Threads | MiB/sec.\n");
 
-	if (comp_data.size() < (TOTAL_HEADER_SIZE + comp_size))
-		return false;
+	for (uint32_t num_lanes = cRangeCodecMinLanes; num_lanes <= LANES; num_lanes *= 2)
+	{
+		// Also check an input which ends with a partial group of lanes
+		for (size_t size = file_data.size() - 5; size <= file_data.size(); size += 5)
+		{
+			size_t comp_size;
+			if (!enc_ctx.encode(&file_data[0], size, &scaled_cum_prob[0], &comp_data[0], comp_data.size(), comp_size, num_lanes))
+				panic("vrange_encoder_context::encode() failed!\n");
 
-	// Read the 16-bit symbol frequencies
-	uint32_vec sym_freq(256);
-	for (uint32_t i = 0; i < 256; i++)
-		sym_freq[i] = comp_data[14 + i * 2] | (comp_data[14 + i * 2 + 1] << 8);
-		
-	// Compute the tables needed for decompression
-	uint32_vec scaled_cum_prob;
-	if (!vrange_create_cum_probs(scaled_cum_prob, sym_freq))
-		return false;
-		
-	uint32_vec dec_table;
-	vrange_init_table(256, scaled_cum_prob, dec_table);
-				
-	decomp_data.resize(orig_size);
-	
-	// Decode the symbols
-	if (!vrange_decode(&comp_data[TOTAL_HEADER_SIZE], comp_size, &decomp_data[0], orig_size, &dec_table[0]))
-		return false;
-		
-	return true;
+			for (uint32_t num_threads = 1; num_threads <= max_threads; num_threads *= 2)
+			{
+				double best_time = 1e+9f;
+
+				for (uint32_t trial = 0; trial < 4; trial++)
+				{
+					const uint64_t start_time = get_clock();
+
+					size_t mt_comp_size;
+					if (!mt_enc_ctx.encode_mt(&file_data[0], size, &scaled_cum_prob[0], &mt_comp_data[0], mt_comp_data.size(), mt_comp_size, num_threads, num_lanes))
+						panic("vrange_encoder_context::encode_mt() failed!\n");
+
+					best_time = std::min(best_time, (double)(get_clock() - start_time) / (double)get_ticks_per_sec());
+
+					if ((mt_comp_size != comp_size) || (memcmp(&mt_comp_data[0], &comp_data[0], comp_size) != 0))
+						panic("encode_mt() output differs from encode() with %u lanes and %u threads!\n", num_lanes, num_threads);
+				}
+
+				if (size == file_data.size())
+					printf("%5u | %7u | %8.1f\n", num_lanes, num_threads, ((double)size / (1024.0f * 1024.0f)) / best_time);
+			}
+		}
+	}
+
+	printf("Multithreaded encoding OK\n");
 }
 
-enum 
+static void test_rans_coding(
+	const uint8_vec& file_data,
+	const uint32_vec& scaled_cum_prob,
+	const uint32_vec& dec_table,
+	double total_theoretical_bits)
 {
-	cModeTest,
-	cModeComp,
-	cModeDecomp
-};
+	printf("\nTesting vectorized interleaved rANS decoding vs. range decoding (same models and tables):\n");
 
-static void print_usage()
+	const uint32_t file_size = (uint32_t)file_data.size();
+
+	uint8_vec decoded_buf(file_size);
+
+	for (uint32_t use_rans = 0; use_rans < 2; use_rans++)
+	{
+		const uint64_t enc_start_time = get_clock();
+
+		uint8_vec enc_buf;
+		if (use_rans)
+			vrange_rans_encode(&file_data[0], file_size, enc_buf, scaled_cum_prob);
+		else
+			vrange_encode(&file_data[0], file_size, enc_buf, scaled_cum_prob);
+
+		const double total_enc_time = (double)(get_clock() - enc_start_time) / (double)get_ticks_per_sec();
+
+		memset(&decoded_buf[0], 0xCD, file_size);
+
+#ifdef _DEBUG
+		const uint32_t TIMES_TO_DECODE = 1;
+#else
+		const uint32_t TIMES_TO_DECODE = 100;
+#endif
+		const uint64_t before_time = get_clock();
+		uint64_t total_cycles = 0;
+
+		for (uint32_t times = 0; times < TIMES_TO_DECODE; times++)
+		{
+			const uint64_t start_cycles = __rdtsc();
+
+			bool status;
+			if (use_rans)
+				status = vrange_rans_decode(&enc_buf[0], enc_buf.size(), &decoded_buf[0], file_size, &dec_table[0]);
+			else
+				status = vrange_decode(&enc_buf[0], enc_buf.size(), &decoded_buf[0], file_size, &dec_table[0]);
+
+			if (!status)
+				panic("Decoding failed!\n");
+
+			total_cycles += __rdtsc() - start_cycles;
+		}
+
+		const double total_time = ((double)(get_clock() - before_time) / (double)get_ticks_per_sec()) / TIMES_TO_DECODE;
+
+		if (memcmp(&decoded_buf[0], &file_data[0], file_size) != 0)
+			panic("Decompression failed!\n");
+
+		printf("%s: %zu bytes, %.3f%% vs. theoretical limit, encode %.1f MiB/sec., decode %.1f MiB/sec., %.2f cycles per byte\n", use_rans ? "rANS " : "Range",
+			enc_buf.size(), total_theoretical_bits ? enc_buf.size() / (total_theoretical_bits / 8.0f) * 100.0f : 0.0f,
+			((double)file_size / total_enc_time) / (1024 * 1024),
+			((double)file_size / total_time) / (1024 * 1024), ((double)total_cycles / TIMES_TO_DECODE) / file_size);
+	}
+}
+
+// Simple deterministic PRNG for generating test data
+static uint32_t test_rand(uint32_t& seed)
 {
-	printf("Usage: sserangecoding with no args tests the codec with \"book1\"\n");
-	printf("sserangecoding <filename> : Tests compression/decompression on a specific file\n");
-	printf("sserangecoding c <source_filename> <comp_filename> : Compresses file\n");
-	printf("sserangecoding d <comp_filename> <decomp_filename> : Decompresses file with CRC-32 check\n");
+	seed = seed * 1103515245U + 12345U;
+	uint32_t x = seed ^ (seed >> 15);
+	x *= 0x2C1B3C6DU;
+	return x ^ (x >> 12);
 }
-	
-int main(int argc, char **argv)
+
+static void test_segmented_decode(const uint8_vec& file_data, const uint32_vec& scaled_cum_prob, const uint32_vec& dec_table)
 {
-	vrange_init();
+	printf("\nTesting decoding into output segments and ring buffers:\n");
 
-	int mode = cModeTest;
-	const char* pSrc_filename = "book1";
-	const char* pOut_filename = "outfile";
-	
-	if (argc == 1)
-	{
-		// Test mode
-	}
-	else if ((argc == 2) && (strcmp(argv[1], "-h") == 0))
-	{
-		print_usage();
-		exit(EXIT_FAILURE);
-	}
-	else if (argc == 2)
-	{
-		pSrc_filename = argv[1];
-	}
-	else if (argc == 4)
+	const size_t file_size = file_data.size();
+
+	uint8_vec comp_data, decoded_data(file_size);
+	std::vector<vrange_iovec> segs;
+
+	for (uint32_t num_lanes = cRangeCodecMinLanes; num_lanes <= LANES; num_lanes *= 2)
 	{
-		if (argv[1][0] == 'c')
-			mode = cModeComp;
-		else if (argv[1][0] == 'd')
-			mode = cModeDecomp;
-		else
+		vrange_encode(&file_data[0], file_size, comp_data, scaled_cum_prob, num_lanes);
+
+		// Random segment sizes, from empty to larger than a group of lanes
+		for (uint32_t max_seg_size = 1; max_seg_size <= 4096; max_seg_size *= 8)
 		{
-			print_usage();
-			panic("Invalid mode!\n");
+			uint32_t seed = max_seg_size;
+
+			segs.resize(0);
+			for (size_t ofs = 0; ofs < file_size; )
+			{
+				const size_t seg_size = std::min<size_t>(file_size - ofs, test_rand(seed) % (max_seg_size + 1));
+				const vrange_iovec seg = { &decoded_data[ofs], seg_size };
+				segs.push_back(seg);
+				ofs += seg_size;
+			}
+
+			memset(&decoded_data[0], 0, file_size);
+
+			if ((!vrange_decode_iov(&comp_data[0], comp_data.size(), &segs[0], (uint32_t)segs.size(), &dec_table[0], num_lanes)) || (memcmp(&decoded_data[0], &file_data[0], file_size) != 0))
+				panic("vrange_decode_iov() failed with %u lanes!\n", num_lanes);
 		}
 
-		pSrc_filename = argv[2];
-		pOut_filename = argv[3];
+		// Ring buffer, wrapping at an offset which isn't a multiple of the lane count
+		const size_t ring_ofs = file_size / 3 + 1;
+
+		memset(&decoded_data[0], 0, file_size);
+
+		if (!vrange_decode_ring(&comp_data[0], comp_data.size(), &decoded_data[0], file_size, ring_ofs, file_size, &dec_table[0], num_lanes))
+			panic("vrange_decode_ring() failed with %u lanes!\n", num_lanes);
+
+		if ((memcmp(&decoded_data[ring_ofs], &file_data[0], file_size - ring_ofs) != 0) || (memcmp(&decoded_data[0], &file_data[file_size - ring_ofs], ring_ofs) != 0))
+			panic("Ring buffer decompression failed with %u lanes!\n", num_lanes);
 	}
-	else
+
+	// Decoding speed into 4KB segments (each starting at an odd offset, so most boundaries split a group) vs. one buffer
+	segs.resize(0);
+	for (size_t ofs = 0; ofs < file_size; ofs += 4099)
 	{
-		print_usage();
-		panic("Invalid command line arguments!\n");
+		const vrange_iovec seg = { &decoded_data[ofs], std::min<size_t>(file_size - ofs, 4099) };
+		segs.push_back(seg);
 	}
 
-	printf("Reading file %s\n", pSrc_filename);
+	double best_time = 1e+9f, best_iov_time = 1e+9f;
 
-	uint8_vec file_data;
-	if (!read_file_to_vec(pSrc_filename, file_data))
-		panic("Failed reading source file!\n");
+	for (uint32_t trial = 0; trial < 8; trial++)
+	{
+		uint64_t start_time = get_clock();
+		if (!vrange_decode(&comp_data[0], comp_data.size(), &decoded_data[0], file_size, &dec_table[0]))
+			panic("vrange_decode() failed!\n");
+		best_time = std::min(best_time, (double)(get_clock() - start_time) / (double)get_ticks_per_sec());
 
-	if (!file_data.size())
-		panic("File empty!\n");
+		memset(&decoded_data[0], 0, file_size);
 
-	if (file_data.size() >= UINT32_MAX)
-		panic("File too big!\n");
+		start_time = get_clock();
+		if (!vrange_decode_iov(&comp_data[0], comp_data.size(), &segs[0], (uint32_t)segs.size(), &dec_table[0]))
+			panic("vrange_decode_iov() failed!\n");
+		best_iov_time = std::min(best_iov_time, (double)(get_clock() - start_time) / (double)get_ticks_per_sec());
 
-	const uint32_t file_size = (uint32_t)file_data.size();
+		if (memcmp(&decoded_data[0], &file_data[0], file_size) != 0)
+			panic("Segmented decompression failed!\n");
+	}
 
-	if (mode == cModeTest)
-	{
-		uint32_vec sym_freq(256);
-		for (uint32_t i = 0; i < file_data.size(); i++)
-			sym_freq[file_data[i]]++;
+	const double file_size_mb = (double)file_size / (1024.0f * 1024.0f);
+	printf("One buffer: %.1f MiB/sec., 4KB segments: %.1f MiB/sec.\n", file_size_mb / best_time, file_size_mb / best_iov_time);
 
-		double total_theoretical_bits = 0.0f;
-		for (uint32_t i = 0; i < 256; i++)
-			if (sym_freq[i])
-				total_theoretical_bits += sym_freq[i] * -log2((double)sym_freq[i] / file_size);
-		printf("Source file size %u bytes contains %.1f bytes of entropy\n", file_size, total_theoretical_bits / 8.0f);
+	printf("Segmented decoding OK\n");
+}
 
-		uint32_vec scaled_cum_prob;
-		bool status = vrange_create_cum_probs(scaled_cum_prob, sym_freq);
-		if (!status)
-			panic("vrange_create_cum_probs() failed!\n");
+static void test_scatter_gather_encode(const uint8_vec& file_data, const uint32_vec& scaled_cum_prob)
+{
+	printf("\nTesting encoding from input fragments:\n");
+
+	const size_t file_size = file_data.size();
+
+	vrange_encoder_context enc_ctx;
+	uint8_vec comp_data(vrange_compress_bound(file_size)), iov_comp_data(comp_data.size());
+	std::vector<vrange_const_iovec> segs;
+
+	uint32_t hist[256];
+	clear_obj(hist);
+	vrange_histogram(&file_data[0], file_size, hist);
+
+	for (uint32_t num_lanes = cRangeCodecMinLanes; num_lanes <= LANES; num_lanes *= 2)
+	{
+		size_t comp_size;
+		if (!enc_ctx.encode(&file_data[0], file_size, &scaled_cum_prob[0], &comp_data[0], comp_data.size(), comp_size, num_lanes))
+			panic("vrange_encoder_context::encode() failed!\n");
+
+		// Random fragment sizes, from empty to much larger than a group of lanes
+		for (uint32_t max_seg_size = 1; max_seg_size <= 4096; max_seg_size *= 8)
+		{
+			uint32_t seed = max_seg_size;
+
+			segs.resize(0);
+			for (size_t ofs = 0; ofs < file_size; )
+			{
+				const size_t seg_size = std::min<size_t>(file_size - ofs, test_rand(seed) % (max_seg_size + 1));
+				const vrange_const_iovec seg = { &file_data[ofs], seg_size };
+				segs.push_back(seg);
+				ofs += seg_size;
+			}
+
+			size_t iov_comp_size;
+			if (!enc_ctx.encode_iov(&segs[0], (uint32_t)segs.size(), &scaled_cum_prob[0], &iov_comp_data[0], iov_comp_data.size(), iov_comp_size, num_lanes))
+				panic("vrange_encoder_context::encode_iov() failed!\n");
+
+			if ((iov_comp_size != comp_size) || (memcmp(&iov_comp_data[0], &comp_data[0], comp_size) != 0))
+				panic("encode_iov() output differs from encode() with %u lanes!\n", num_lanes);
+
+			uint32_t iov_hist[256];
+			clear_obj(iov_hist);
+			vrange_histogram(&segs[0], (uint32_t)segs.size(), iov_hist);
+
+			if (memcmp(iov_hist, hist, sizeof(hist)) != 0)
+				panic("vrange_histogram() of fragments failed!\n");
+		}
+	}
+
+	printf("Fragment encoding OK\n");
+}
+
+// Every encoder entry point must reject a symbol with a zero frequency (its interval would be empty), and the least probable symbol must stay within vrange_compress_bound()
+static void test_encode_limits(const uint8_vec& file_data)
+{
+	printf("\nTesting zero frequency symbols and the worst case encoded size:\n");
+
+	const size_t file_size = file_data.size();
+
+	// A model missing the most frequent byte of the file
+	uint32_t hist[256];
+	clear_obj(hist);
+	vrange_histogram(&file_data[0], file_size, hist);
+
+	const uint32_t missing_sym = (uint32_t)(std::max_element(hist, hist + 256) - hist);
+	hist[missing_sym] = 0;
+
+	uint32_vec sym_freq(hist, hist + 256), scaled_cum_prob;
+	if (!vrange_create_cum_probs(scaled_cum_prob, sym_freq))
+		panic("vrange_create_cum_probs() failed!\n");
+
+	vrange_encoder_context enc_ctx;
+	uint8_vec comp_data(vrange_compress_bound(file_size));
+	size_t comp_size;
+
+	if (enc_ctx.encode(&file_data[0], file_size, &scaled_cum_prob[0], &comp_data[0], comp_data.size(), comp_size))
+		panic("vrange_encoder_context::encode() accepted a zero frequency symbol!\n");
+
+	if (enc_ctx.encode_mt(&file_data[0], file_size, &scaled_cum_prob[0], &comp_data[0], comp_data.size(), comp_size, 4))
+		panic("vrange_encoder_context::encode_mt() accepted a zero frequency symbol!\n");
+
+	if (vrange_encode(&file_data[0], file_size, &comp_data[0], comp_data.size(), &scaled_cum_prob[0]))
+		panic("vrange_encode() accepted a zero frequency symbol!\n");
+
+	uint8_vec enc_buf;
+	vrange_encode(file_data, enc_buf, scaled_cum_prob);
+	if (enc_buf.size())
+		panic("vrange_encode() accepted a zero frequency symbol!\n");
+
+	sserange_encoder* pEncoder = sserange_encoder_create(NULL, NULL, NULL);
+	if ((!pEncoder) || (sserange_encode(pEncoder, &file_data[0], file_size, &scaled_cum_prob[0], 256, LANES, &comp_data[0], comp_data.size())))
+		panic("sserange_encode() accepted a zero frequency symbol!\n");
+	sserange_encoder_destroy(pEncoder);
+
+	// Worst case: every symbol has the lowest probability (1/4096)
+	const size_t worst_size = 100000;
+	sym_freq.assign(256, 0);
+	sym_freq[0] = 1000000;
+	sym_freq[1] = 1;
+	if ((!vrange_create_cum_probs(scaled_cum_prob, sym_freq)) || ((scaled_cum_prob[2] - scaled_cum_prob[1]) != 1))
+		panic("vrange_create_cum_probs() failed!\n");
+
+	uint32_vec dec_table;
+	vrange_init_table(256, scaled_cum_prob, dec_table);
+
+	const uint8_vec worst_data(worst_size, 1);
+	uint8_vec decoded_buf(worst_size);
+
+	for (uint32_t num_lanes = cRangeCodecMinLanes; num_lanes <= LANES; num_lanes *= 2)
+	{
+		vrange_encode(worst_data, enc_buf, scaled_cum_prob, num_lanes);
+		if ((enc_buf.empty()) || (enc_buf.size() > vrange_compress_bound(worst_size)))
+			panic("Worst case encoded size %zu exceeds vrange_compress_bound() %zu!\n", enc_buf.size(), vrange_compress_bound(worst_size));
+
+		if ((!vrange_decode(&enc_buf[0], enc_buf.size(), &decoded_buf[0], worst_size, &dec_table[0], num_lanes)) || (decoded_buf != worst_data))
+			panic("Decompression failed!\n");
+
+		printf("%u lanes: %zu bytes, vrange_compress_bound() %zu\n", num_lanes, enc_buf.size(), vrange_compress_bound(worst_size));
+	}
+}
+
+template <typename T>
+static void test_decode_values_type(const uint8_vec& syms, const uint8_vec& comp_data, const uint32_vec& dec_table, uint32_t num_lanes, const vrange_value_table& values, const char* pDesc)
+{
+	const size_t n = syms.size();
+	std::vector<T> decoded_values(n);
+	uint8_vec decoded_syms(n);
+
+	if (!vrange_decode_values(&comp_data[0], comp_data.size(), &decoded_values[0], n, &dec_table[0], values, num_lanes))
+		panic("vrange_decode_values() failed!\n");
+
+	for (size_t i = 0; i < n; i++)
+		if (decoded_values[i] != (T)values.m_values[syms[i]])
+			panic("vrange_decode_values() output is wrong at offset %zu!\n", i);
+
+	if (num_lanes != LANES)
+		return;
+
+	// Fused decoding vs. decoding the symbols then expanding them in a second pass
+	double best_time = 1e+9f, best_fused_time = 1e+9f;
+
+	for (uint32_t trial = 0; trial < 8; trial++)
+	{
+		uint64_t start_time = get_clock();
+
+		if (!vrange_decode(&comp_data[0], comp_data.size(), &decoded_syms[0], n, &dec_table[0], num_lanes))
+			panic("vrange_decode() failed!\n");
+
+		for (size_t i = 0; i < n; i++)
+			decoded_values[i] = (T)values.m_values[decoded_syms[i]];
+
+		best_time = std::min(best_time, (double)(get_clock() - start_time) / (double)get_ticks_per_sec());
+
+		start_time = get_clock();
+
+		if (!vrange_decode_values(&comp_data[0], comp_data.size(), &decoded_values[0], n, &dec_table[0], values, num_lanes))
+			panic("vrange_decode_values() failed!\n");
+
+		best_fused_time = std::min(best_fused_time, (double)(get_clock() - start_time) / (double)get_ticks_per_sec());
+	}
+
+	printf("%s, %u-bit values: decode then expand %.1f, fused %.1f million values/sec.\n", pDesc, (uint32_t)(sizeof(T) * 8), n / best_time / 1e+6f, n / best_fused_time / 1e+6f);
+}
+
+static void test_decode_values(const uint8_vec& file_data)
+{
+	printf("\nTesting decoding to dictionary values:\n");
+
+	for (uint32_t small_dict = 0; small_dict < 2; small_dict++)
+	{
+		// A column of dictionary codes: 12 codes, or book1's bytes
+		uint8_vec syms(file_data);
+		if (small_dict)
+		{
+			for (size_t i = 0; i < syms.size(); i++)
+				syms[i] = (uint8_t)(syms[i] % 12);
+		}
+
+		const uint32_t num_values = small_dict ? 12 : 256;
+
+		uint32_t dict_values[256];
+		uint32_t seed = 1;
+		for (uint32_t i = 0; i < num_values; i++)
+			dict_values[i] = test_rand(seed) ^ (test_rand(seed) << 16);
+
+		vrange_value_table values;
+		if (!values.init(dict_values, num_values))
+			panic("vrange_value_table::init() failed!\n");
+
+		uint32_vec sym_freq(256);
+		for (size_t i = 0; i < syms.size(); i++)
+			sym_freq[syms[i]]++;
+
+		uint32_vec scaled_cum_prob, dec_table;
+		if (!vrange_create_cum_probs(scaled_cum_prob, sym_freq))
+			panic("vrange_create_cum_probs() failed!\n");
+		vrange_init_table(256, scaled_cum_prob, dec_table);
+
+		for (uint32_t num_lanes = cRangeCodecMinLanes; num_lanes <= LANES; num_lanes *= 2)
+		{
+			// Odd size, so the final partial group is expanded too
+			uint8_vec msg(syms.begin(), syms.end() - 3), comp_data;
+			vrange_encode(&msg[0], msg.size(), comp_data, scaled_cum_prob, num_lanes);
+
+			const char* pDesc = small_dict ? "12 values" : "256 values";
+			test_decode_values_type<uint16_t>(msg, comp_data, dec_table, num_lanes, values, pDesc);
+			test_decode_values_type<uint32_t>(msg, comp_data, dec_table, num_lanes, values, pDesc);
+		}
+	}
+
+	printf("Decoding to values OK\n");
+}
+
+static void test_split_coding()
+{
+	printf("\nTesting split coding with raw low bits:\n");
+
+	// Simulated 12-bit sensor samples: a slowly changing signal plus ~5 bits of noise
+	const size_t num_values = 1024 * 1024 + 7;
+
+	std::vector<uint16_t> samples(num_values), values(num_values), decoded(num_values);
+	uint32_t seed = 1;
+	for (size_t i = 0; i < num_values; i++)
+		samples[i] = (uint16_t)(2048 + (int)(1500.0f * sin(i * .0001f)) + (int)(test_rand(seed) & 31) - 16);
+
+	const uint32_t best_raw_bits = vrange_choose_num_raw_bits(&samples[0], num_values);
+	if (!best_raw_bits)
+		panic("vrange_choose_num_raw_bits() failed!\n");
+
+	uint8_vec high(num_values), raw, comp_data;
+
+	for (uint32_t num_raw_bits = 1; num_raw_bits <= cRangeMaxRawBits; num_raw_bits++)
+	{
+		// With less than 4 raw bits the samples are scaled down to fit in 8 + num_raw_bits bits
+		for (size_t i = 0; i < num_values; i++)
+			values[i] = (uint16_t)(samples[i] >> ((num_raw_bits < 4) ? (4 - num_raw_bits) : 0));
+
+		raw.resize(vrange_get_raw_bits_size(num_values, num_raw_bits));
+		if (!vrange_split_values(&values[0], num_values, num_raw_bits, &high[0], &raw[0]))
+			panic("vrange_split_values() failed!\n");
+
+		uint32_vec sym_freq(256);
+		for (size_t i = 0; i < num_values; i++)
+			sym_freq[high[i]]++;
+
+		uint32_vec scaled_cum_prob, dec_table;
+		if (!vrange_create_cum_probs(scaled_cum_prob, sym_freq))
+			panic("vrange_create_cum_probs() failed!\n");
+		vrange_init_table(256, scaled_cum_prob, dec_table);
+
+		for (uint32_t num_lanes = cRangeCodecMinLanes; num_lanes <= LANES; num_lanes *= 2)
+		{
+			vrange_encode(&high[0], num_values, comp_data, scaled_cum_prob, num_lanes);
+
+			double best_time = 1e+9f, best_split_time = 1e+9f;
+
+			for (uint32_t trial = 0; trial < ((num_lanes == LANES) ? 8 : 1); trial++)
+			{
+				memset(&decoded[0], 0, num_values * sizeof(uint16_t));
+
+				uint64_t start_time = get_clock();
+				if (!vrange_decode_split(&comp_data[0], comp_data.size(), &raw[0], raw.size(), &decoded[0], num_values, num_raw_bits, &dec_table[0], num_lanes))
+					panic("vrange_decode_split() failed!\n");
+				best_split_time = std::min(best_split_time, (double)(get_clock() - start_time) / (double)get_ticks_per_sec());
+
+				if (memcmp(&decoded[0], &values[0], num_values * sizeof(uint16_t)) != 0)
+					panic("Split decoding failed with %u raw bits and %u lanes!\n", num_raw_bits, num_lanes);
+
+				// Decoding just the high parts
+				start_time = get_clock();
+				if (!vrange_decode(&comp_data[0], comp_data.size(), &high[0], num_values, &dec_table[0], num_lanes))
+					panic("vrange_decode() failed!\n");
+				best_time = std::min(best_time, (double)(get_clock() - start_time) / (double)get_ticks_per_sec());
+			}
+
+			if ((num_lanes == LANES) && (num_raw_bits >= 4))
+			{
+				printf("%u raw bits%s: %.2f bits/value, high parts alone %.1f, merged with raw bits %.1f million values/sec.\n", num_raw_bits, (num_raw_bits == best_raw_bits) ? " (chosen)" : "",
+					(comp_data.size() + raw.size()) * 8.0f / num_values, num_values / best_time / 1e+6f, num_values / best_split_time / 1e+6f);
+			}
+		}
+	}
+
+	printf("Split coding OK\n");
+}
+
+static void test_small_alphabet_decode(const uint8_vec& file_data)
+{
+	printf("\nTesting the small alphabet decoder:\n");
+
+	const size_t file_size = file_data.size();
+
+	uint8_vec data(file_size), decoded(file_size), comp_data;
+
+	for (uint32_t num_used_syms = 2; num_used_syms <= cRangeSmallAlphabetMaxSyms + 1; num_used_syms++)
+	{
+		// Spread the used symbols out, so ranks and symbols differ
+		for (size_t i = 0; i < file_size; i++)
+			data[i] = (uint8_t)('A' + (file_data[i] % num_used_syms) * 11);
+
+		uint32_vec sym_freq(256);
+		for (size_t i = 0; i < file_size; i++)
+			sym_freq[data[i]]++;
+
+		uint32_vec scaled_cum_prob, dec_table;
+		if (!vrange_create_cum_probs(scaled_cum_prob, sym_freq))
+			panic("vrange_create_cum_probs() failed!\n");
+
+		vrange_small_table small_table;
+		const bool has_small_table = vrange_init_small_table(256, &scaled_cum_prob[0], small_table);
+		if (has_small_table != (num_used_syms <= cRangeSmallAlphabetMaxSyms))
+			panic("vrange_init_small_table() failed with %u symbols!\n", num_used_syms);
+
+		if (!has_small_table)
+			continue;
+
+		// The block decoder and model dictionary pick the small table with vrange_prefer_small_table(): only up to 4 symbols and 2KB, where it measured faster
+		const bool expect_small = (num_used_syms <= 4);
+		if ((vrange_prefer_small_table(small_table, 1) != expect_small) || (vrange_prefer_small_table(small_table, 2048) != expect_small) || (vrange_prefer_small_table(small_table, 2049)))
+			panic("vrange_prefer_small_table() chose the wrong decoder with %u symbols!\n", num_used_syms);
+
+		vrange_init_table(256, scaled_cum_prob, dec_table);
+
+		for (uint32_t num_lanes = cRangeCodecMinLanes; num_lanes <= LANES; num_lanes *= 2)
+		{
+			// Odd sizes leave partial groups in the final iteration
+			for (size_t size = 1; size <= 67; size += ((size < 40) ? 1 : 9))
+			{
+				vrange_encode(&data[0], size, comp_data, scaled_cum_prob, num_lanes);
+
+				memset(&decoded[0], 0, size);
+				if ((!vrange_decode_small(&comp_data[0], comp_data.size(), &decoded[0], size, small_table, num_lanes)) || (memcmp(&decoded[0], &data[0], size) != 0))
+					panic("Small alphabet decoding failed with %u symbols, %u lanes and %u bytes!\n", num_used_syms, num_lanes, (uint32_t)size);
+			}
+
+			vrange_encode(&data[0], file_size, comp_data, scaled_cum_prob, num_lanes);
+
+			double best_table_time = 1e+9f, best_small_time = 1e+9f;
+
+			for (uint32_t trial = 0; trial < ((num_lanes == LANES) ? 8 : 1); trial++)
+			{
+				memset(&decoded[0], 0, file_size);
+
+				uint64_t start_time = get_clock();
+				if (!vrange_decode_small(&comp_data[0], comp_data.size(), &decoded[0], file_size, small_table, num_lanes))
+					panic("vrange_decode_small() failed!\n");
+				best_small_time = std::min(best_small_time, (double)(get_clock() - start_time) / (double)get_ticks_per_sec());
+
+				if (memcmp(&decoded[0], &data[0], file_size) != 0)
+					panic("Small alphabet decoding failed with %u symbols and %u lanes!\n", num_used_syms, num_lanes);
+
+				start_time = get_clock();
+				if (!vrange_decode(&comp_data[0], comp_data.size(), &decoded[0], file_size, &dec_table[0], num_lanes))
+					panic("vrange_decode() failed!\n");
+				best_table_time = std::min(best_table_time, (double)(get_clock() - start_time) / (double)get_ticks_per_sec());
+			}
+
+			if ((num_lanes == LANES) && ((num_used_syms & (num_used_syms - 1)) == 0))
+			{
+				printf("%u symbols: table decode %.1f MiB/sec, small table decode %.1f MiB/sec\n", num_used_syms,
+					file_size / best_table_time / (1024.0f * 1024.0f), file_size / best_small_time / (1024.0f * 1024.0f));
+			}
+		}
+	}
+
+	// Short messages, each with a new model: building the 16KB table costs more than the small table's slower decoding
+	const uint32_t msg_size = cRangeSmallAlphabetAutoMaxSize / 2;
+	const uint32_t num_msgs = (uint32_t)std::min<size_t>(file_size / msg_size, 256);
+
+	for (size_t i = 0; i < file_size; i++)
+		data[i] = "ACGT"[file_data[i] & 3];
+
+	uint32_vec sym_freq(256), scaled_cum_prob, dec_table(cRangeCodecProbScale);
+	for (size_t i = 0; i < file_size; i++)
+		sym_freq[data[i]]++;
+	if (!vrange_create_cum_probs(scaled_cum_prob, sym_freq))
+		panic("vrange_create_cum_probs() failed!\n");
+
+	vrange_encode(&data[0], msg_size, comp_data, scaled_cum_prob);
+
+	vrange_small_table small_table;
+	double best_table_time = 1e+9f, best_small_time = 1e+9f;
+
+	for (uint32_t trial = 0; trial < 8; trial++)
+	{
+		uint64_t start_time = get_clock();
+		for (uint32_t i = 0; i < num_msgs; i++)
+		{
+			vrange_init_table(256, &scaled_cum_prob[0], &dec_table[0]);
+			if (!vrange_decode(&comp_data[0], comp_data.size(), &decoded[i * msg_size], msg_size, &dec_table[0]))
+				panic("vrange_decode() failed!\n");
+		}
+		best_table_time = std::min(best_table_time, (double)(get_clock() - start_time) / (double)get_ticks_per_sec());
+
+		start_time = get_clock();
+		for (uint32_t i = 0; i < num_msgs; i++)
+		{
+			vrange_init_small_table(256, &scaled_cum_prob[0], small_table);
+			if (!vrange_decode_small(&comp_data[0], comp_data.size(), &decoded[i * msg_size], msg_size, small_table))
+				panic("vrange_decode_small() failed!\n");
+		}
+		best_small_time = std::min(best_small_time, (double)(get_clock() - start_time) / (double)get_ticks_per_sec());
+	}
+
+	for (uint32_t i = 0; i < num_msgs; i++)
+		if (memcmp(&decoded[i * msg_size], &data[0], msg_size) != 0)
+			panic("Small alphabet decoding of short messages failed!\n");
+
+	printf("%u byte DNA messages with new models: table init+decode %.1f MiB/sec, small table init+decode %.1f MiB/sec\n", msg_size,
+		num_msgs * msg_size / best_table_time / (1024.0f * 1024.0f), num_msgs * msg_size / best_small_time / (1024.0f * 1024.0f));
+
+	// Small blocks with new models are decoded with the small table, blocks reusing a model may need the full table later
+	vrange_block_params params;
+	params.m_fixed_block_size = cRangeSmallAlphabetAutoMaxSize;
+	params.m_huffman_speed_bias = -1.0f;
+
+	const size_t blocks_size = std::min<size_t>(file_size, 256 * 1024);
+	for (size_t i = 0; i < blocks_size; i++)
+		data[i] = "ACGT"[std::min(file_data[i] & 7, 3)];
+
+	for (uint32_t use_rans = 0; use_rans < 2; use_rans++)
+	{
+		params.m_use_rans = (use_rans != 0);
+
+		comp_data.resize(0);
+		if (!vrange_encode_blocks(&data[0], blocks_size, comp_data, params))
+			panic("vrange_encode_blocks() failed!\n");
+
+		memset(&decoded[0], 0, blocks_size);
+		if ((!vrange_decode_blocks(&comp_data[0], comp_data.size(), &decoded[0], blocks_size)) || (memcmp(&decoded[0], &data[0], blocks_size) != 0))
+			panic("Small alphabet blocked decoding failed!\n");
+	}
+
+	printf("Small alphabet decoding OK\n");
+}
+
+extern "C" int sserange_test_c99(const uint8_t* pData, size_t data_size);
+
+static void test_c_api(const uint8_vec& file_data)
+{
+	printf("\nTesting the C interface and vrange_compress_bound():\n");
+
+	const uint32_t file_size = (uint32_t)file_data.size();
+
+	uint32_t sym_freq[256];
+	clear_obj(sym_freq);
+	vrange_histogram(&file_data[0], file_size, sym_freq);
+
+	uint32_t scaled_cum_prob[257];
+	if (!sserange_create_cum_probs(sym_freq, 256, scaled_cum_prob))
+		panic("sserange_create_cum_probs() failed!\n");
+
+	sserange_encoder* pEncoder = sserange_encoder_create(NULL, NULL, NULL);
+	sserange_decoder* pDecoder = sserange_decoder_create();
+	if ((!pEncoder) || (!pDecoder) || (!sserange_decoder_set_model(pDecoder, scaled_cum_prob, 256)))
+		panic("Failed creating the C encoder/decoder!\n");
+
+	const size_t bound = sserange_compress_bound(file_size);
+	uint8_t* pComp = (uint8_t*)malloc(bound);
+	uint8_t* pDecoded = (uint8_t*)malloc(file_size);
+	if ((!pComp) || (!pDecoded))
+		panic("Out of memory!\n");
+
+	const size_t comp_size = sserange_encode(pEncoder, &file_data[0], file_size, scaled_cum_prob, 256, SSERANGE_DEFAULT_LANES, pComp, bound);
+	if (!comp_size)
+		panic("sserange_encode() failed!\n");
+
+	if ((!sserange_decode(pDecoder, pComp, comp_size, pDecoded, file_size, SSERANGE_DEFAULT_LANES)) || (memcmp(pDecoded, &file_data[0], file_size) != 0))
+		panic("sserange_decode() failed!\n");
+
+	// Too small output buffers must be rejected
+	if (sserange_encode(pEncoder, &file_data[0], file_size, scaled_cum_prob, 256, SSERANGE_DEFAULT_LANES, pComp, comp_size - 1))
+		panic("sserange_encode() didn't fail with a too small buffer!\n");
+
+	printf("Encoded %u bytes to %zu bytes, bound: %zu bytes\n", file_size, comp_size, bound);
+
+	// Worst case: only code the least probable symbol, using a model where it has the minimum frequency
+	uint32_t skewed_freq[256];
+	for (uint32_t i = 0; i < 256; i++)
+		skewed_freq[i] = i ? 1 : 1000000;
+
+	if (!sserange_create_cum_probs(skewed_freq, 256, scaled_cum_prob))
+		panic("sserange_create_cum_probs() failed!\n");
+
+	const uint32_t worst_size = std::min<uint32_t>(file_size, 65536);
+	memset(pDecoded, 255, worst_size);
+
+	const size_t worst_bound = sserange_compress_bound(worst_size);
+	const size_t worst_comp_size = sserange_encode(pEncoder, pDecoded, worst_size, scaled_cum_prob, 256, SSERANGE_DEFAULT_LANES, pComp, worst_bound);
+	if (!worst_comp_size)
+		panic("sserange_encode() exceeded sserange_compress_bound()!\n");
+
+	printf("Worst case: encoded %u bytes to %zu bytes, bound: %zu bytes\n", worst_size, worst_comp_size, worst_bound);
+
+	// The same API used from C, compiled as C99 (test_c99.c)
+	if (!sserange_test_c99(&file_data[0], std::min<size_t>(file_size, 65536)))
+		panic("sserange_test_c99() failed!\n");
+
+	printf("C99 API test OK\n");
+
+	free(pComp);
+	free(pDecoded);
+	sserange_encoder_destroy(pEncoder);
+	sserange_decoder_destroy(pDecoder);
+}
+
+// Bump allocator used as the encoder context's allocator hook. Memory is only released when the arena is destroyed.
+struct test_arena
+{
+	uint8_t* m_pBuf;
+	size_t m_size, m_ofs;
+	uint32_t m_total_allocs;
+};
+
+static void* test_arena_alloc(size_t size, void* pUser)
+{
+	test_arena* pArena = (test_arena*)pUser;
+
+	const size_t ofs = (pArena->m_ofs + 15) & ~15;
+	if ((ofs > pArena->m_size) || (size > (pArena->m_size - ofs)))
+		return NULL;
+
+	pArena->m_ofs = ofs + size;
+	pArena->m_total_allocs++;
+
+	return pArena->m_pBuf + ofs;
+}
+
+static void test_arena_free(void* p, void* pUser)
+{
+	(void)p;
+	(void)pUser;
+}
+
+static void test_context_allocations(const uint8_vec& file_data)
+{
+	printf("\nTesting steady state allocations of the encoder/decoder contexts:\n");
+
+	const uint32_t file_size = (uint32_t)file_data.size();
+	const uint32_t max_size = std::min<uint32_t>(file_size, 65536);
+
+	test_arena arena;
+	arena.m_size = 16 * max_size + 65536;
+	arena.m_pBuf = (uint8_t*)malloc(arena.m_size);
+	arena.m_ofs = 0;
+	arena.m_total_allocs = 0;
+	if (!arena.m_pBuf)
+		panic("Out of memory!\n");
+
+	const vrange_allocator allocator = { test_arena_alloc, test_arena_free, &arena };
+
+	vrange_encoder_context enc_ctx(&allocator);
+	vrange_decoder_context dec_ctx;
+
+	uint8_vec decoded_buf(max_size);
+
+	// Warm up: size the encoder's scratch memory for the largest input
+	if (!enc_ctx.reserve(max_size))
+		panic("vrange_encoder_context::reserve() failed!\n");
+
+	// Make sure the replaced operator new (sserangealloc.cpp) is the one being called, otherwise the heap check below can't fail
+	{
+		const uint64_t probe_start_allocs = vrange_get_total_heap_allocs();
+
+		// Volatile, so the compiler can't elide the new/delete pairs
+		uint8_vec probe_vec(16);
+		uint32_t* volatile pProbe_array = new uint32_t[16];
+		uint32_t* volatile pProbe = new (std::nothrow) uint32_t;
+		delete pProbe;
+		delete[] pProbe_array;
+
+		if ((vrange_get_total_heap_allocs() - probe_start_allocs) != 3)
+			panic("The heap allocation counter isn't counting!\n");
+	}
+
+	// The encoder context gets all of its memory from the arena, and the decoder context's model and table are members, so neither may allocate
+	const uint64_t start_heap_allocs = vrange_get_total_heap_allocs();
+	const uint32_t start_arena_allocs = arena.m_total_allocs;
+
+	const uint32_t NUM_CALLS = 1000;
+	uint32_t seed = 1;
+	uint64_t total_bytes = 0;
+
+	const uint64_t start_time = get_clock();
+
+	for (uint32_t i = 0; i < NUM_CALLS; i++)
+	{
+		const uint32_t size = 1 + test_rand(seed) % max_size;
+		const uint8_t* pData = &file_data[test_rand(seed) % (file_size - size + 1)];
+
+		uint32_t hist[256];
+		clear_obj(hist);
+		vrange_histogram(pData, size, hist);
+
+		if (!enc_ctx.create_model(hist, 256))
+			panic("vrange_encoder_context::create_model() failed!\n");
+
+		const uint8_t* pComp;
+		size_t comp_size;
+		if (!enc_ctx.encode(pData, size, enc_ctx.get_scaled_cum_prob(), pComp, comp_size))
+			panic("vrange_encoder_context::encode() failed!\n");
+
+		if (!dec_ctx.create_model(hist, 256))
+			panic("vrange_decoder_context::create_model() failed!\n");
+
+		if (!dec_ctx.decode(pComp, comp_size, &decoded_buf[0], size))
+			panic("vrange_decoder_context::decode() failed!\n");
+
+		if (memcmp(&decoded_buf[0], pData, size) != 0)
+			panic("Decompression failed!\n");
+
+		total_bytes += size;
+	}
+
+	const double total_time = (double)(get_clock() - start_time) / (double)get_ticks_per_sec();
+
+	const uint64_t heap_allocs = vrange_get_total_heap_allocs() - start_heap_allocs;
+	const uint32_t arena_allocs = arena.m_total_allocs - start_arena_allocs;
+
+	printf("%u encode+decode calls (%.1f MiB), %.1f calls/sec., %llu heap allocations, %u arena allocations\n",
+		NUM_CALLS, total_bytes / (1024.0f * 1024.0f), NUM_CALLS / total_time, (unsigned long long)heap_allocs, arena_allocs);
+
+	if ((heap_allocs) || (arena_allocs))
+		panic("The contexts allocated memory after warm up!\n");
+
+	free(arena.m_pBuf);
+}
+
+static void test_size_estimation(const uint8_vec& file_data)
+{
+	printf("\nTesting vrange_estimate_encoded_size() vs. vrange_encode():\n");
+
+	const uint32_t s_sizes[] = { 1, 16, 100, 1000, 10000, 100000 };
+	const uint32_t NUM_SIZES = sizeof(s_sizes) / sizeof(s_sizes[0]);
+	const uint32_t TRIALS_PER_SIZE = 64;
+
+	uint32_t seed = 1;
+	uint8_vec data, enc_buf;
+	uint32_vec sym_freq, scaled_cum_prob, sym_costs;
+
+	for (uint32_t size_index = 0; size_index < NUM_SIZES; size_index++)
+	{
+		const uint32_t size = s_sizes[size_index];
+
+		double total_err = 0.0f, max_err = 0.0f;
+
+		for (uint32_t trial = 0; trial < TRIALS_PER_SIZE; trial++)
+		{
+			data.resize(size);
+
+			// Alternate between slices of the input file and random data with a geometric distribution of random skew
+			if ((trial & 1) && (file_data.size() >= size))
+			{
+				const size_t ofs = test_rand(seed) % (file_data.size() - size + 1);
+				memcpy(&data[0], &file_data[ofs], size);
+			}
+			else
+			{
+				const uint32_t skew = 1 + (test_rand(seed) % 32);
+				for (uint32_t i = 0; i < size; i++)
+				{
+					uint32_t sym = 0;
+					while ((sym < 255) && ((test_rand(seed) & 31) < skew))
+						sym++;
+					data[i] = (uint8_t)sym;
+				}
+			}
+
+			sym_freq.assign(256, 0);
+			vrange_histogram(&data[0], size, &sym_freq[0]);
+
+			if (!vrange_create_cum_probs(scaled_cum_prob, sym_freq))
+				panic("vrange_create_cum_probs() failed!\n");
+
+			vrange_get_sym_costs(256, scaled_cum_prob, sym_costs);
+
+			const size_t est_size = vrange_estimate_encoded_size(&data[0], size, &sym_costs[0]);
+
+			vrange_encode(data, enc_buf, scaled_cum_prob);
+
+			const double err = ((double)est_size - (double)enc_buf.size()) / (double)enc_buf.size();
+			total_err += err;
+			max_err = std::max(max_err, fabs(err));
+
+			// The estimate models the 24-bit coder's precision loss and the partial bytes left in each lane only on average
+			if (fabs((double)est_size - (double)enc_buf.size()) > (enc_buf.size() * .02f + 4))
+				panic("Size estimate %zu too far from actual size %zu (input size %u)!\n", est_size, enc_buf.size(), size);
+		}
+
+		printf("Size %u: average error %.3f%%, max abs error %.3f%%\n", size, total_err / TRIALS_PER_SIZE * 100.0f, max_err * 100.0f);
+	}
+}
+
+static void test_lane_counts(const uint8_vec& file_data, const uint32_vec& scaled_cum_prob, const uint32_vec& dec_table)
+{
+	printf("\nTesting small messages with 4, 8 and 16 lanes (shared model, ratio excludes the model):\n");
+
+	const uint32_t s_sizes[] = { 64, 128, 256, 512, 1024, 2048, 4096 };
+	const uint32_t NUM_SIZES = sizeof(s_sizes) / sizeof(s_sizes[0]);
+	const uint32_t NUM_MSGS = 256;
+
+	const uint32_t file_size = (uint32_t)file_data.size();
+
+	vrange_encoder_context enc_ctx;
+	uint8_vec comp_bufs(NUM_MSGS * vrange_compress_bound(s_sizes[NUM_SIZES - 1]));
+	size_t comp_sizes[NUM_MSGS];
+	uint32_t msg_ofs[NUM_MSGS];
+	uint8_vec decoded_buf(s_sizes[NUM_SIZES - 1]);
+
+	printf("   Size |  4 lanes  msgs/sec. |  8 lanes  msgs/sec. | 16 lanes  msgs/sec. | Chosen\n");
+
+	for (uint32_t size_index = 0; size_index < NUM_SIZES; size_index++)
+	{
+		const uint32_t size = s_sizes[size_index];
+		if (size > file_size)
+			break;
+
+		const size_t bound = vrange_compress_bound(size);
+
+		uint32_t seed = 1;
+		for (uint32_t i = 0; i < NUM_MSGS; i++)
+			msg_ofs[i] = test_rand(seed) % (file_size - size + 1);
+
+		printf("%7u", size);
+
+		for (uint32_t num_lanes = cRangeCodecMinLanes; num_lanes <= LANES; num_lanes *= 2)
+		{
+			size_t total_comp_size = 0;
+
+			for (uint32_t i = 0; i < NUM_MSGS; i++)
+			{
+				if (!enc_ctx.encode(&file_data[msg_ofs[i]], size, &scaled_cum_prob[0], &comp_bufs[i * bound], bound, comp_sizes[i], num_lanes))
+					panic("vrange_encoder_context::encode() failed!\n");
+
+				total_comp_size += comp_sizes[i];
+			}
+
+			double best_time = 1e+9f;
+
+			for (uint32_t trial = 0; trial < 8; trial++)
+			{
+				const uint64_t start_time = get_clock();
+
+				for (uint32_t i = 0; i < NUM_MSGS; i++)
+				{
+					if (!vrange_decode(&comp_bufs[i * bound], comp_sizes[i], &decoded_buf[0], size, &dec_table[0], num_lanes))
+						panic("vrange_decode() failed!\n");
+				}
+
+				best_time = std::min(best_time, (double)(get_clock() - start_time) / (double)get_ticks_per_sec());
+
+				if (memcmp(&decoded_buf[0], &file_data[msg_ofs[NUM_MSGS - 1]], size) != 0)
+					panic("Decompression failed!\n");
+			}
+
+			printf(" | %7.2f%% %9.0f", (double)total_comp_size / ((double)size * NUM_MSGS) * 100.0f, NUM_MSGS / best_time);
+		}
+
+		printf(" | %u\n", vrange_choose_num_lanes(size));
+	}
+}
+
+static void test_model_dict(const uint8_vec& file_data)
+{
+	printf("\nTesting pre-trained model dictionaries on 64-512 byte messages (trained on the 1st half of the file, tested on the 2nd):\n");
+
+	const size_t file_size = file_data.size();
+	if (file_size < 4096)
+		return;
+
+	// Cut the file into messages of random sizes
+	std::vector<const uint8_t*> msgs;
+	std::vector<size_t> msg_sizes;
+
+	uint32_t seed = 1;
+	for (size_t ofs = 0; ofs < file_size; )
+	{
+		const size_t size = std::min<size_t>(64 + test_rand(seed) % 449, file_size - ofs);
+		msgs.push_back(&file_data[ofs]);
+		msg_sizes.push_back(size);
+		ofs += size;
+	}
+
+	const uint32_t num_train = (uint32_t)msgs.size() / 2;
+	const uint32_t num_test = (uint32_t)msgs.size() - num_train;
+
+	size_t total_test_size = 0;
+	for (uint32_t i = num_train; i < msgs.size(); i++)
+		total_test_size += msg_sizes[i];
+
+	// Baseline: every message carries its own model (in the blocked format's compact serialization)
+	{
+		size_t total_comp_size = 0;
+		uint32_vec freq, scaled_cum_prob;
+		uint8_vec model_buf, enc_buf;
+
+		for (uint32_t i = num_train; i < msgs.size(); i++)
+		{
+			freq.assign(256, 0);
+			vrange_histogram(msgs[i], msg_sizes[i], &freq[0]);
+
+			if (!vrange_create_cum_probs(scaled_cum_prob, freq))
+				panic("vrange_create_cum_probs() failed!\n");
+
+			model_buf.resize(0);
+			vrange_write_model(scaled_cum_prob, model_buf);
+
+			const uint32_t num_lanes = vrange_choose_num_lanes(msg_sizes[i]);
+			vrange_encode(msgs[i], msg_sizes[i], enc_buf, scaled_cum_prob, num_lanes);
+
+			total_comp_size += std::min(model_buf.size() + enc_buf.size(), msg_sizes[i]) + 1;
+		}
+
+		printf("Per message models: %.2f%%\n", (double)total_comp_size / total_test_size * 100.0f);
+	}
+
+	const uint32_t s_num_models[] = { 1, 4, 16, 63 };
+
+	vrange_encoder_context enc_ctx;
+	uint8_vec comp_buf(vrange_dict_compress_bound(total_test_size) + num_test), decoded_buf(file_size), dict_buf;
+	std::vector<size_t> comp_ofs(num_test + 1);
+
+	for (uint32_t m = 0; m < sizeof(s_num_models) / sizeof(s_num_models[0]); m++)
+	{
+		vrange_dict_params params;
+		params.m_max_models = s_num_models[m];
+
+		vrange_model_dict trained_dict;
+
+		const uint64_t train_start_time = get_clock();
+		if (!trained_dict.train(&msgs[0], &msg_sizes[0], num_train, params))
+			panic("vrange_model_dict::train() failed!\n");
+		const double train_time = (double)(get_clock() - train_start_time) / (double)get_ticks_per_sec();
+
+		dict_buf.resize(0);
+		trained_dict.write(dict_buf);
+
+		vrange_model_dict dict;
+		if (!dict.read(&dict_buf[0], dict_buf.size()))
+			panic("vrange_model_dict::read() failed!\n");
+
+		comp_ofs[0] = 0;
+		for (uint32_t i = 0; i < num_test; i++)
+		{
+			size_t comp_size;
+			if (!dict.compress(msgs[num_train + i], msg_sizes[num_train + i], enc_ctx, &comp_buf[comp_ofs[i]], comp_buf.size() - comp_ofs[i], comp_size))
+				panic("vrange_model_dict::compress() failed!\n");
+
+			comp_ofs[i + 1] = comp_ofs[i] + comp_size;
+		}
+
+		const size_t total_comp_size = comp_ofs[num_test];
+
+		const uint64_t dec_start_time = get_clock();
+
+		uint8_t* pDst = &decoded_buf[0];
+		for (uint32_t i = 0; i < num_test; i++)
+		{
+			if (!dict.decompress(&comp_buf[comp_ofs[i]], comp_ofs[i + 1] - comp_ofs[i], pDst, msg_sizes[num_train + i]))
+				panic("vrange_model_dict::decompress() failed!\n");
+
+			pDst += msg_sizes[num_train + i];
+		}
+
+		const double total_dec_time = (double)(get_clock() - dec_start_time) / (double)get_ticks_per_sec();
+
+		if (memcmp(&decoded_buf[0], msgs[num_train], total_test_size) != 0)
+			panic("Decompression failed!\n");
+
+		printf("%2u models (%u trained, %zu byte dictionary, trained in %.3f secs): %.2f%%, decode %.0f msgs/sec.\n", s_num_models[m], dict.get_num_models(),
+			dict_buf.size(), train_time, (double)total_comp_size / total_test_size * 100.0f, num_test / std::max(total_dec_time, 1e-9));
+	}
+}
+
+static void test_blocked_range_coding(const uint8_vec& file_data, double total_theoretical_bits)
+{
+	printf("\nTesting blocked range coding:\n");
+
+	const uint32_t file_size = (uint32_t)file_data.size();
+
+	// Range code every block, test_huffman_backend() covers Huffman blocks
+	vrange_block_params params;
+	params.m_huffman_speed_bias = -1.0f;
+
+	for (uint32_t pass = 0; pass < 2; pass++)
+	{
+		// Pass 0 uses the cost-based splitter, pass 1 the fixed-size fallback
+		params.m_fixed_block_size = pass ? 65536 : 0;
+
+		const uint64_t split_start_time = get_clock();
+
+		vrange_block_desc_vec blocks;
+		vrange_split_blocks(&file_data[0], file_size, blocks, params);
+
+		const double total_split_time = (double)(get_clock() - split_start_time) / (double)get_ticks_per_sec();
+
+		const uint64_t enc_start_time = get_clock();
+
+		uint8_vec comp_data;
+		vrange_block_encoder enc;
+		enc.set_huffman_speed_bias(params.m_huffman_speed_bias);
+		for (size_t i = 0; i < blocks.size(); i++)
+			if (!enc.encode_block(&file_data[blocks[i].m_ofs], blocks[i].m_size, comp_data, params.m_allow_model_reuse))
+				panic("vrange_block_encoder::encode_block() failed!\n");
+
+		const double total_enc_time = (double)(get_clock() - enc_start_time) / (double)get_ticks_per_sec();
+
+		printf("%s: %zu blocks, split time: %f seconds, %.1f MiB/sec., encode time: %f seconds, %.1f MiB/sec.\n",
+			pass ? "Fixed size blocks" : "Cost-based splitting", blocks.size(),
+			total_split_time, ((double)file_size / total_split_time) / (1024 * 1024),
+			total_enc_time, ((double)file_size / total_enc_time) / (1024 * 1024));
+
+		printf("Compressed file from %zu bytes to %zu bytes, %.3f%% vs. theoretical limit\n",
+			file_data.size(), comp_data.size(), total_theoretical_bits ? comp_data.size() / (total_theoretical_bits / 8.0f) * 100.0f : 0.0f);
+
+		uint8_vec decoded_buf(file_size);
+		memset(&decoded_buf[0], 0xCD, file_size);
+
+		const uint64_t dec_start_time = get_clock();
+
+		if (!vrange_decode_blocks(&comp_data[0], comp_data.size(), &decoded_buf[0], file_size))
+			panic("vrange_decode_blocks() failed!\n");
+
+		const double total_dec_time = (double)(get_clock() - dec_start_time) / (double)get_ticks_per_sec();
+
+		if (memcmp(&decoded_buf[0], &file_data[0], file_size) != 0)
+			panic("Decompression failed!\n");
+
+		printf("Decompression OK, %f seconds, %.1f MiB/sec.\n", total_dec_time, ((double)file_size / total_dec_time) / (1024 * 1024));
+	}
+
+	// book1 is homogeneous, so it's a single block. Mixed input (text, random bytes, then different text) must be split, with a raw block for the random bytes.
+	const uint32_t text_size = std::min<uint32_t>(file_size / 2, 192 * 1024);
+	const uint32_t random_size = 96 * 1024;
+
+	uint8_vec mixed_data(file_data.begin(), file_data.begin() + text_size);
+
+	uint32_t seed = 1;
+	for (uint32_t i = 0; i < random_size; i++)
+		mixed_data.push_back((uint8_t)test_rand(seed));
+
+	mixed_data.insert(mixed_data.end(), file_data.end() - text_size, file_data.end());
+
+	size_t mixed_sizes[2];
+	uint32_t block_type_counts[2][cRangeBlockRansPrevModel + 1];
+	clear_obj(block_type_counts);
+
+	for (uint32_t pass = 0; pass < 2; pass++)
+	{
+		params.m_fixed_block_size = pass ? 65536 : 0;
+
+		uint8_vec comp_data;
+		if (!vrange_encode_blocks(&mixed_data[0], mixed_data.size(), comp_data, params))
+			panic("vrange_encode_blocks() failed!\n");
+
+		mixed_sizes[pass] = comp_data.size();
+
+		// Decode block by block to see which block types were used
+		uint8_vec decoded_buf(mixed_data.size());
+		vrange_block_decoder dec;
+
+		const uint8_t* pSrc = &comp_data[0];
+		const uint8_t* pSrc_end = pSrc + comp_data.size();
+		size_t dst_ofs = 0;
+
+		while (pSrc < pSrc_end)
+		{
+			const uint32_t block_type = pSrc[0] & cRangeBlockTypeMask;
+			if (block_type > cRangeBlockRansPrevModel)
+				panic("Invalid block type!\n");
+			block_type_counts[pass][block_type]++;
+
+			uint32_t decoded_size;
+			if (!dec.decode_block(pSrc, pSrc_end, &decoded_buf[dst_ofs], decoded_buf.size() - dst_ofs, decoded_size))
+				panic("vrange_block_decoder::decode_block() failed!\n");
+			dst_ofs += decoded_size;
+		}
+
+		if ((dst_ofs != mixed_data.size()) || (memcmp(&decoded_buf[0], &mixed_data[0], mixed_data.size()) != 0))
+			panic("Mixed data decompression failed!\n");
+	}
+
+	uint32_t num_cost_blocks = 0;
+	for (uint32_t i = 0; i <= cRangeBlockRansPrevModel; i++)
+		num_cost_blocks += block_type_counts[0][i];
+
+	printf("Mixed text/random/text data, %zu bytes: cost-based splitting %u blocks (%u raw, %u new model, %u previous model), %zu bytes, fixed 64KB blocks %zu bytes\n",
+		mixed_data.size(), num_cost_blocks, block_type_counts[0][cRangeBlockRaw], block_type_counts[0][cRangeBlockNewModel], block_type_counts[0][cRangeBlockPrevModel],
+		mixed_sizes[0], mixed_sizes[1]);
+
+	if ((num_cost_blocks < 3) || (!block_type_counts[0][cRangeBlockRaw]))
+		panic("Cost-based splitting didn't split the mixed data!\n");
+
+	if (mixed_sizes[0] >= mixed_sizes[1])
+		panic("Cost-based splitting wasn't smaller than fixed size blocks!\n");
+}
+
+static void print_encode_stats(const vrange_encode_stats& stats)
+{
+	const uint64_t total_ticks = stats.m_histogram_ticks + stats.m_model_ticks + stats.m_lane_encode_ticks + stats.m_swizzle_ticks + stats.m_output_ticks;
+	const double scale = total_ticks ? 100.0f / total_ticks : 0.0f;
+
+	printf("Encode: %llu calls, %llu symbols, %llu bytes, %.2f ticks/byte: histogram %.1f%%, model %.1f%%, lane encode %.1f%%, swizzle %.1f%%, output %.1f%%\n",
+		(unsigned long long)stats.m_total_calls, (unsigned long long)stats.m_total_syms, (unsigned long long)stats.m_total_comp_bytes,
+		stats.m_total_syms ? (double)total_ticks / stats.m_total_syms : 0.0f,
+		stats.m_histogram_ticks * scale, stats.m_model_ticks * scale, stats.m_lane_encode_ticks * scale, stats.m_swizzle_ticks * scale, stats.m_output_ticks * scale);
+
+	printf("Renormalized bytes per lane:");
+	for (uint32_t lane = 0; lane < LANES; lane++)
+		printf(" %llu", (unsigned long long)stats.m_lane_renorm_bytes[lane]);
+	printf("\n");
+}
+
+static void print_decode_stats(const vrange_decode_stats& stats)
+{
+	const uint64_t total_ticks = stats.m_table_ticks + stats.m_vector_ticks + stats.m_tail_ticks;
+	const double scale = total_ticks ? 100.0f / total_ticks : 0.0f;
+
+	printf("Decode: %llu calls, %llu symbols, %llu bytes read, %.2f ticks/byte: tables %.1f%%, vector loop %.1f%%, tail %.1f%%, %.3f%% of symbols decoded in the tail\n",
+		(unsigned long long)stats.m_total_calls, (unsigned long long)stats.m_total_syms, (unsigned long long)stats.m_total_bytes_read,
+		stats.m_total_syms ? (double)total_ticks / stats.m_total_syms : 0.0f,
+		stats.m_table_ticks * scale, stats.m_vector_ticks * scale, stats.m_tail_ticks * scale, stats.get_tail_fraction() * 100.0f);
+}
+
+// Checks the optional per-phase stats against the coded sizes, and measures what leaving them enabled costs
+static void test_codec_stats(const uint8_vec& file_data, const uint32_vec& scaled_cum_prob, const uint32_vec& dec_table)
+{
+	printf("\nTesting codec stats:\n");
+
+	const uint32_t file_size = (uint32_t)file_data.size();
+
+	vrange_encoder_context enc_ctx;
+	uint8_vec decoded_buf(file_size);
+
+	// Whole file, then 256 byte messages (4 lanes), where the tail is a large fraction of each message
+	for (uint32_t pass = 0; pass < 2; pass++)
+	{
+		const uint32_t msg_size = pass ? std::min<uint32_t>(256, file_size) : file_size;
+		const uint32_t num_lanes = vrange_choose_num_lanes(msg_size);
+
+		printf("%u byte messages, %u lanes:\n", msg_size, num_lanes);
+
+		vrange_encode_stats enc_stats;
+		vrange_decode_stats dec_stats;
+		uint64_t total_comp_size = 0;
+
+		for (uint32_t ofs = 0; ofs + msg_size <= file_size; ofs += msg_size)
+		{
+			const uint8_t* pComp;
+			size_t comp_size;
+			if (!enc_ctx.encode(&file_data[ofs], msg_size, &scaled_cum_prob[0], pComp, comp_size, num_lanes, &enc_stats))
+				panic("vrange_encoder_context::encode() failed!\n");
+
+			if (!vrange_decode(pComp, comp_size, &decoded_buf[ofs], msg_size, &dec_table[0], num_lanes, &dec_stats))
+				panic("vrange_decode() failed!\n");
+
+			if (memcmp(&decoded_buf[ofs], &file_data[ofs], msg_size) != 0)
+				panic("Decompression failed!\n");
+
+			total_comp_size += comp_size;
+		}
+
+		uint64_t total_renorm_bytes = 0;
+		for (uint32_t lane = 0; lane < LANES; lane++)
+			total_renorm_bytes += enc_stats.m_lane_renorm_bytes[lane];
+
+		if ((enc_stats.m_total_comp_bytes != total_comp_size) || (total_renorm_bytes + enc_stats.m_total_calls * vrange_get_stream_overhead(num_lanes) != total_comp_size) ||
+			(dec_stats.m_total_syms != enc_stats.m_total_syms) || (dec_stats.m_total_bytes_read > total_comp_size) || (dec_stats.m_tail_syms > dec_stats.m_total_syms))
+			panic("Codec stats are inconsistent!\n");
+
+		print_encode_stats(enc_stats);
+		print_decode_stats(dec_stats);
+	}
+
+	// The blocked coder adds histogram, model and table creation
+	vrange_block_params params;
+	params.m_huffman_speed_bias = -1.0f;
+
+	vrange_encode_stats enc_stats;
+	uint8_vec comp_data;
+	if (!vrange_encode_blocks(&file_data[0], file_size, comp_data, params, &enc_stats))
+		panic("vrange_encode_blocks() failed!\n");
+
+	vrange_decode_stats dec_stats;
+	if ((!vrange_decode_blocks(&comp_data[0], comp_data.size(), &decoded_buf[0], file_size, &dec_stats)) || (memcmp(&decoded_buf[0], &file_data[0], file_size) != 0))
+		panic("vrange_decode_blocks() failed!\n");
+
+	printf("Blocked format:\n");
+	print_encode_stats(enc_stats);
+	print_decode_stats(dec_stats);
+
+	// Decoding speed with and without stats
+	uint8_vec enc_buf;
+	vrange_encode(&file_data[0], file_size, enc_buf, scaled_cum_prob);
+
+#ifdef _DEBUG
+	const uint32_t TIMES_TO_DECODE = 1;
+#else
+	const uint32_t TIMES_TO_DECODE = 100;
+#endif
+	double total_times[2] = { 0, 0 };
+	for (uint32_t times = 0; times < TIMES_TO_DECODE; times++)
+	{
+		for (uint32_t use_stats = 0; use_stats < 2; use_stats++)
+		{
+			vrange_decode_stats stats;
+
+			const uint64_t start_time = get_clock();
+			if (!vrange_decode(&enc_buf[0], enc_buf.size(), &decoded_buf[0], file_size, &dec_table[0], LANES, use_stats ? &stats : NULL))
+				panic("vrange_decode() failed!\n");
+			total_times[use_stats] += (double)(get_clock() - start_time) / (double)get_ticks_per_sec();
+		}
+	}
+
+	printf("Decoding without stats: %.1f MiB/sec., with stats: %.1f MiB/sec.\n",
+		((double)file_size * TIMES_TO_DECODE / total_times[0]) / (1024 * 1024), ((double)file_size * TIMES_TO_DECODE / total_times[1]) / (1024 * 1024));
+}
+
+static void test_huffman_backend(const uint8_vec& file_data)
+{
+	printf("\nTesting automatic Huffman/range coding backend selection:\n");
+
+	const uint32_t file_size = (uint32_t)file_data.size();
+
+	// Range coding only, strictly smaller size, the default bias, then Huffman whenever it's within 10%
+	const float s_biases[4] = { -1.0f, 0.0f, cRangeBlockDefaultHuffmanBias, .1f };
+
+	uint8_vec comp_data;
+	uint8_vec decoded_buf(file_size);
+
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		vrange_block_params params;
+		params.m_huffman_speed_bias = s_biases[i];
+
+		comp_data.resize(0);
+
+		const uint64_t enc_start_time = get_clock();
+
+		if (!vrange_encode_blocks(&file_data[0], file_size, comp_data, params))
+			panic("vrange_encode_blocks() failed!\n");
+
+		const double total_enc_time = (double)(get_clock() - enc_start_time) / (double)get_ticks_per_sec();
+
+		memset(&decoded_buf[0], 0xCD, file_size);
+
+		const uint64_t dec_start_time = get_clock();
+
+		if (!vrange_decode_blocks(&comp_data[0], comp_data.size(), &decoded_buf[0], file_size))
+			panic("vrange_decode_blocks() failed!\n");
+
+		const double total_dec_time = (double)(get_clock() - dec_start_time) / (double)get_ticks_per_sec();
+
+		if (memcmp(&decoded_buf[0], &file_data[0], file_size) != 0)
+			panic("Decompression failed!\n");
+
+		printf("Speed bias %5.2f: %zu bytes (%.2f%%), encode %.1f MiB/sec., decode %.1f MiB/sec.\n", s_biases[i],
+			comp_data.size(), comp_data.size() * 100.0f / file_size,
+			((double)file_size / total_enc_time) / (1024 * 1024), ((double)file_size / total_dec_time) / (1024 * 1024));
+	}
+}
+
+static void test_lz_range_coding(const uint8_vec& file_data)
+{
+	printf("\nTesting LZ77 + range coding vs. order-0 range coding:\n");
+
+	const uint32_t file_size = (uint32_t)file_data.size();
+
+	uint8_vec comp_data;
+	uint8_vec decoded_buf(file_size);
+
+	for (uint32_t level = 0; level <= 4; level++)
+	{
+		comp_data.resize(0);
+
+		// The last pass is plain order-0 blocked range coding (with Huffman blocks disabled), for comparison
+		const bool use_lz = level < 4;
+
+		const uint64_t enc_start_time = get_clock();
+
+		bool status;
+		if (use_lz)
+		{
+			vrange_lz_params params;
+			params.set_level(level);
+			status = vrange_lz_compress(&file_data[0], file_size, comp_data, params);
+		}
+		else
+		{
+			vrange_block_params params;
+			params.m_huffman_speed_bias = -1.0f;
+			status = vrange_encode_blocks(&file_data[0], file_size, comp_data, params);
+		}
+
+		if (!status)
+			panic("Compression failed!\n");
+
+		const double total_enc_time = (double)(get_clock() - enc_start_time) / (double)get_ticks_per_sec();
+
+		memset(&decoded_buf[0], 0xCD, file_size);
+
+		const uint64_t dec_start_time = get_clock();
+
+		if (use_lz)
+			status = vrange_lz_decompress(&comp_data[0], comp_data.size(), &decoded_buf[0], file_size);
+		else
+			status = vrange_decode_blocks(&comp_data[0], comp_data.size(), &decoded_buf[0], file_size);
+
+		const double total_dec_time = (double)(get_clock() - dec_start_time) / (double)get_ticks_per_sec();
+
+		if ((!status) || (memcmp(&decoded_buf[0], &file_data[0], file_size) != 0))
+			panic("Decompression failed!\n");
+
+		if (use_lz)
+			printf("LZ level %u: ", level);
+		else
+			printf("Order-0:    ");
+
+		printf("%zu bytes (%.2f%%), encode %.1f MiB/sec., decode %.1f MiB/sec.\n",
+			comp_data.size(), comp_data.size() * 100.0f / file_size,
+			((double)file_size / total_enc_time) / (1024 * 1024), ((double)file_size / total_dec_time) / (1024 * 1024));
+	}
+}
+
+static void test_bwt_range_coding(const uint8_vec& file_data)
+{
+	printf("\nTesting BWT + MTF + zero run coding + range coding:\n");
+
+	const uint32_t file_size = (uint32_t)file_data.size();
+
+	vrange_bwt_params params;
+
+	const uint64_t enc_start_time = get_clock();
+
+	uint8_vec comp_data;
+	if (!vrange_bwt_compress(&file_data[0], file_size, comp_data, params))
+		panic("vrange_bwt_compress() failed!\n");
+
+	const double total_enc_time = (double)(get_clock() - enc_start_time) / (double)get_ticks_per_sec();
+
+	uint8_vec decoded_buf(file_size);
+	memset(&decoded_buf[0], 0xCD, file_size);
+
+	const uint64_t dec_start_time = get_clock();
+
+	if (!vrange_bwt_decompress(&comp_data[0], comp_data.size(), &decoded_buf[0], file_size))
+		panic("vrange_bwt_decompress() failed!\n");
+
+	const double total_dec_time = (double)(get_clock() - dec_start_time) / (double)get_ticks_per_sec();
+
+	if (memcmp(&decoded_buf[0], &file_data[0], file_size) != 0)
+		panic("Decompression failed!\n");
+
+	printf("%zu bytes (%.2f%%), encode %.1f MiB/sec., decode %.1f MiB/sec.\n",
+		comp_data.size(), comp_data.size() * 100.0f / file_size,
+		((double)file_size / total_enc_time) / (1024 * 1024), ((double)file_size / total_dec_time) / (1024 * 1024));
+}
+
+// "Rd" files store the symbol frequencies, which the decoder quantizes with vrange_create_cum_probs().
+// "Rc" files (same layout) were written before the quantizer changed, and are decoded with vrange_create_cum_probs_legacy().
+static const char *g_file_sig = "Rd";
+static const char *g_legacy_file_sig = "Rc";
+const uint32_t TOTAL_HEADER_SIZE = 2 + sizeof(uint32_t) * 3 + 256 * 2;
+
+// The blocked format header is followed by a sequence of blocks created by vrange_block_encoder.
+// The LZ and BWT formats use the same header (with a different 2nd signature byte), followed by the output of vrange_lz_compress() or vrange_bwt_compress().
+static const char* g_blocked_file_sig = "Rb";
+const char cFormatBlocked = 'b', cFormatLZ = 'z', cFormatBWT = 'w';
+const uint32_t TOTAL_BLOCKED_HEADER_SIZE = 2 + sizeof(uint64_t) + sizeof(uint32_t);
+
+static bool is_blocked_format(const uint8_t* pComp_data, size_t comp_size)
+{
+	return (comp_size >= 2) && (pComp_data[0] == g_blocked_file_sig[0]) && 
+		((pComp_data[1] == cFormatBlocked) || (pComp_data[1] == cFormatLZ) || (pComp_data[1] == cFormatBWT));
+}
+
+static bool is_blocked_format(const uint8_vec& comp_data)
+{
+	return is_blocked_format(comp_data.data(), comp_data.size());
+}
+
+// Karl Malbrain's compact CRC-32. See "A compact CCITT crc16 and crc32 C implementation that balances processor cache usage against speed": http://www.geocities.com/malbrain/
+// This CRC-32 function is quite slow, but it's small.
+static uint32_t crc32(uint32_t crc, const uint8_t* ptr, size_t buf_len)
+{
+	static const uint32_t s_crc32[16] = { 0, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+	  0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c };
+	uint32_t crcu32 = (uint32_t)crc;
+	if (!ptr) return 0;
+	crcu32 = ~crcu32; while (buf_len--) { uint8_t b = *ptr++; crcu32 = (crcu32 >> 4) ^ s_crc32[(crcu32 & 0xF) ^ (b & 0xF)]; crcu32 = (crcu32 >> 4) ^ s_crc32[(crcu32 & 0xF) ^ (b >> 4)]; }
+	return ~crcu32;
+}
+
+static bool interleaved_encode(const uint8_vec& file_data, uint8_vec& comp_data)
+{
+	const uint32_t file_size = (uint32_t)file_data.size();
+	if ((!file_size) || (file_size > UINT32_MAX))
+		return false;
+
+	const uint32_t file_data_crc32 = crc32(0, &file_data[0], file_size);
+
+	uint32_vec sym_freq(256);
+	for (uint32_t i = 0; i < file_data.size(); i++)
+		sym_freq[file_data[i]]++;
+	
+	uint32_t max_freq = 0;
+	for (uint32_t i = 0; i < 256; i++)
+		max_freq = std::max<uint32_t>(max_freq, sym_freq[i]);
+	
+	// Reduce frequencies to 16-bits (hurts efficiency, but reduces the overhead).
+	for (uint32_t i = 0; i < 256; i++)
+		if (sym_freq[i])
+			sym_freq[i] = std::max<uint32_t>(1, (UINT16_MAX * (uint64_t)sym_freq[i] + (max_freq / 2)) / max_freq);
+
+	comp_data.resize(0);
+	comp_data.reserve(file_data.size());
+	
+	comp_data.push_back(g_file_sig[0]);
+	comp_data.push_back(g_file_sig[1]);
+
+	for (uint32_t i = 0; i < 4; i++)
+		comp_data.push_back((uint8_t)(file_size >> (i * 8)) & 0xFF);
+	
+	const size_t comp_size_ofs = comp_data.size();
+
+	for (uint32_t i = 0; i < 4; i++)
+		comp_data.push_back(0);
+
+	for (uint32_t i = 0; i < 4; i++)
+		comp_data.push_back((uint8_t)(file_data_crc32 >> (i * 8)) & 0xFF);
+
+	for (uint32_t i = 0; i < 256; i++)
+	{
+		comp_data.push_back((uint8_t)sym_freq[i]);
+		comp_data.push_back((uint8_t)(sym_freq[i] >> 8));
+	}
+
+	assert(TOTAL_HEADER_SIZE == comp_data.size());
+
+	// Create the scaled cumulative probability table needed for encoding
+	vrange_encoder_context enc_ctx;
+	if (!enc_ctx.create_model(&sym_freq[0], 256))
+		return false;
+
+	// Encode the symbols directly into comp_data
+	const size_t comp_data_ofs = comp_data.size();
+	comp_data.resize(comp_data_ofs + vrange_compress_bound(file_size));
+
+	size_t enc_size;
+	if (!enc_ctx.encode(&file_data[0], file_size, enc_ctx.get_scaled_cum_prob(), &comp_data[comp_data_ofs], comp_data.size() - comp_data_ofs, enc_size))
+		return false;
+
+	if (comp_data_ofs + enc_size > UINT32_MAX)
+		return false;
+
+	comp_data.resize(comp_data_ofs + enc_size);
+
+	for (uint32_t i = 0; i < 4; i++)
+		comp_data[comp_size_ofs + i] = (uint8_t)(enc_size >> (i * 8));
+
+	return true;
+}
+
+static bool interleaved_decode(const uint8_vec& comp_data, uint8_vec& decomp_data, uint32_t &expected_crc32)
+{
+	// Sanity check the input size
+	if (comp_data.size() < (TOTAL_HEADER_SIZE + LANES * 3))
+		return false;
+
+	// Check for compressed file signature
+	if ((comp_data[0] != g_file_sig[0]) || ((comp_data[1] != g_file_sig[1]) && (comp_data[1] != g_legacy_file_sig[1])))
+		return false;
+
+	const bool legacy_quantizer = (comp_data[1] == g_legacy_file_sig[1]);
+
+	const uint32_t orig_size = comp_data[2] | (comp_data[3] << 8) | (comp_data[4] << 16) | (comp_data[5] << 24);
+	const uint32_t comp_size = comp_data[6] | (comp_data[7] << 8) | (comp_data[8] << 16) | (comp_data[9] << 24);
+	expected_crc32 = comp_data[10] | (comp_data[11] << 8) | (comp_data[12] << 16) | (comp_data[13] << 24);
+
+	// Sanity check the sizes in the header
+	if ((!orig_size) || (comp_size < LANES * 3))
+		return false;
+
+	if (comp_data.size() < (TOTAL_HEADER_SIZE + comp_size))
+		return false;
+
+	// Read the 16-bit symbol frequencies
+	uint32_t sym_freq[256];
+	for (uint32_t i = 0; i < 256; i++)
+		sym_freq[i] = comp_data[14 + i * 2] | (comp_data[14 + i * 2 + 1] << 8);
+		
+	// Compute the tables needed for decompression
+	vrange_decoder_context dec_ctx;
+	if (!dec_ctx.create_model(sym_freq, 256, legacy_quantizer))
+		return false;
+				
+	decomp_data.resize(orig_size);
+	
+	// Decode the symbols
+	if (!dec_ctx.decode(&comp_data[TOTAL_HEADER_SIZE], comp_size, &decomp_data[0], orig_size))
+		return false;
+		
+	return true;
+}
+
+#ifndef SSER_TEST_DATA_DIR
+#define SSER_TEST_DATA_DIR "testdata"
+#endif
+
+// Decodes a checked-in "Rc" file (the first 4KB of book1, written before the quantizer changed), then round trips the same data through the current format
+static void test_legacy_file_decode()
+{
+	printf("Testing legacy \"Rc\" file decoding:\n");
+
+	const char* pFilename = SSER_TEST_DATA_DIR "/book1_4k.rc";
+	const uint32_t cLegacyOrigSize = 4096, cLegacyCRC32 = 0x25752AED;
+
+	uint8_vec comp_data, decomp_data;
+	if (!read_file_to_vec(pFilename, comp_data))
+		panic("Failed reading %s\n", pFilename);
+
+	uint32_t expected_crc32 = 0;
+	if (!interleaved_decode(comp_data, decomp_data, expected_crc32))
+		panic("interleaved_decode() failed on %s\n", pFilename);
+
+	if ((decomp_data.size() != cLegacyOrigSize) || (expected_crc32 != cLegacyCRC32) || (crc32(0, &decomp_data[0], decomp_data.size()) != cLegacyCRC32))
+		panic("Legacy file decoded incorrectly!\n");
+
+	uint8_vec recomp_data, redecomp_data;
+	if ((!interleaved_encode(decomp_data, recomp_data)) || (recomp_data[1] != g_file_sig[1]))
+		panic("interleaved_encode() failed!\n");
+
+	if ((!interleaved_decode(recomp_data, redecomp_data, expected_crc32)) || (redecomp_data != decomp_data))
+		panic("Decompression failed!\n");
+
+	printf("%zu bytes decoded OK, %zu bytes re-encoded\n", decomp_data.size(), recomp_data.size());
+}
+
+static bool blocked_encode(const uint8_vec& file_data, uint8_vec& comp_data, char format)
+{
+	const uint64_t file_size = file_data.size();
+	if (!file_size)
+		return false;
+
+	const uint32_t file_data_crc32 = crc32(0, &file_data[0], file_data.size());
+
+	comp_data.resize(0);
+	comp_data.reserve(file_data.size());
+
+	comp_data.push_back(g_blocked_file_sig[0]);
+	comp_data.push_back(format);
+
+	for (uint32_t i = 0; i < 8; i++)
+		comp_data.push_back((uint8_t)(file_size >> (i * 8)));
+
+	for (uint32_t i = 0; i < 4; i++)
+		comp_data.push_back((uint8_t)(file_data_crc32 >> (i * 8)));
+
+	assert(TOTAL_BLOCKED_HEADER_SIZE == comp_data.size());
+
+	if (format == cFormatLZ)
+	{
+		vrange_lz_params params;
+		return vrange_lz_compress(&file_data[0], file_data.size(), comp_data, params);
+	}
+	else if (format == cFormatBWT)
+	{
+		vrange_bwt_params params;
+		return vrange_bwt_compress(&file_data[0], file_data.size(), comp_data, params);
+	}
+
+	vrange_block_params params;
+	return vrange_encode_blocks(&file_data[0], file_data.size(), comp_data, params);
+}
+
+static bool blocked_decode(const uint8_vec& comp_data, uint8_vec& decomp_data, uint32_t& expected_crc32)
+{
+	if (comp_data.size() < TOTAL_BLOCKED_HEADER_SIZE)
+		return false;
+
+	if (!is_blocked_format(comp_data))
+		return false;
+
+	const char format = (char)comp_data[1];
+
+	uint64_t orig_size = 0;
+	for (uint32_t i = 0; i < 8; i++)
+		orig_size |= (uint64_t)comp_data[2 + i] << (i * 8);
+
+	expected_crc32 = comp_data[10] | (comp_data[11] << 8) | (comp_data[12] << 16) | (comp_data[13] << 24);
+
+	if ((!orig_size) || (orig_size > SIZE_MAX))
+		return false;
+
+	decomp_data.resize((size_t)orig_size);
+
+	if (format == cFormatLZ)
+		return vrange_lz_decompress(&comp_data[TOTAL_BLOCKED_HEADER_SIZE], comp_data.size() - TOTAL_BLOCKED_HEADER_SIZE, &decomp_data[0], (size_t)orig_size);
+	else if (format == cFormatBWT)
+		return vrange_bwt_decompress(&comp_data[TOTAL_BLOCKED_HEADER_SIZE], comp_data.size() - TOTAL_BLOCKED_HEADER_SIZE, &decomp_data[0], (size_t)orig_size);
+
+	return vrange_decode_blocks(&comp_data[TOTAL_BLOCKED_HEADER_SIZE], comp_data.size() - TOTAL_BLOCKED_HEADER_SIZE, &decomp_data[0], (size_t)orig_size);
+}
+
+#if SSER_USE_MMAP
+// The memory mapped modes process the file in chunks of this size, dropping the pages of finished chunks so memory use stays bounded
+// even on files larger than RAM.
+const uint64_t cMmapChunkSize = 64 * 1024 * 1024;
+
+// A memory mapped file: read-only for input, or created at a fixed size (read/write, shared) for output.
+class mapped_file
+{
+public:
+	mapped_file() : m_pData(NULL), m_size(0), m_fd(-1), m_writable(false), m_released_ofs(0) { }
+	~mapped_file() { close(0); }
+
+	bool open_read(const char* pFilename)
+	{
+		m_fd = open(pFilename, O_RDONLY);
+		if (m_fd < 0)
+			return false;
+
+		struct stat st;
+		if ((fstat(m_fd, &st) != 0) || (st.st_size <= 0) || ((uint64_t)st.st_size > SIZE_MAX))
+			return false;
+
+		return map((uint64_t)st.st_size, false);
+	}
+
+	bool create(const char* pFilename, uint64_t size)
+	{
+		m_fd = open(pFilename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (m_fd < 0)
+			return false;
+
+		if ((!size) || (size > SIZE_MAX) || (ftruncate(m_fd, (off_t)size) != 0))
+			return false;
+
+		return map(size, true);
+	}
+
+	// Drops the mapped pages before end_ofs (rounded down to a page), writing them back first if the file is writable
+	bool release(uint64_t end_ofs)
+	{
+		const uint64_t page_size = (uint64_t)sysconf(_SC_PAGESIZE);
+		end_ofs &= ~(page_size - 1);
+
+		if (end_ofs <= m_released_ofs)
+			return true;
+
+		uint8_t* pStart = m_pData + m_released_ofs;
+		const size_t len = (size_t)(end_ofs - m_released_ofs);
+
+		if ((m_writable) && (msync(pStart, len, MS_SYNC) != 0))
+			return false;
+
+		madvise(pStart, len, MADV_DONTNEED);
+
+		m_released_ofs = end_ofs;
+		return true;
+	}
+
+	// Unmaps and closes the file. If final_size is non-zero the file is truncated to that size.
+	bool close(uint64_t final_size)
+	{
+		bool status = true;
+
+		if (m_pData)
+		{
+			munmap(m_pData, (size_t)m_size);
+			m_pData = NULL;
+		}
+
+		if (m_fd >= 0)
+		{
+			if ((final_size) && (ftruncate(m_fd, (off_t)final_size) != 0))
+				status = false;
+
+			if (::close(m_fd) != 0)
+				status = false;
+
+			m_fd = -1;
+		}
+
+		m_size = 0;
+		m_released_ofs = 0;
+		return status;
+	}
+
+	uint8_t* m_pData;
+	uint64_t m_size;
+
+private:
+	int m_fd;
+	bool m_writable;
+	uint64_t m_released_ofs;
+
+	bool map(uint64_t size, bool writable)
+	{
+		void* p = mmap(NULL, (size_t)size, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, m_fd, 0);
+		if (p == MAP_FAILED)
+			return false;
+
+		m_pData = (uint8_t*)p;
+		m_size = size;
+		m_writable = writable;
+
+		madvise(m_pData, (size_t)m_size, MADV_SEQUENTIAL);
+		return true;
+	}
+
+	mapped_file(const mapped_file&);
+	mapped_file& operator= (const mapped_file&);
+};
+
+// Compresses a file to the blocked format, reading from a mapped input and writing to a mapped output sized for the worst case (every block raw).
+// Each chunk is split and coded separately, so the block boundaries can differ from blocked_encode()'s, but the output is decoded the same way.
+static bool mmap_blocked_compress(const char* pSrc_filename, const char* pDst_filename, uint64_t& file_size, uint64_t& comp_size)
+{
+	file_size = 0;
+	comp_size = 0;
+
+	mapped_file src;
+	if (!src.open_read(pSrc_filename))
+		return false;
+
+	file_size = src.m_size;
+
+	vrange_block_params params;
+
+	// The splitter's blocks are multiples of the window size, except the last one of each chunk
+	const uint64_t num_chunks = (file_size + cMmapChunkSize - 1) / cMmapChunkSize;
+	const uint64_t max_blocks = (file_size + params.m_window_size - 1) / params.m_window_size + num_chunks;
+	const uint64_t max_comp_size = TOTAL_BLOCKED_HEADER_SIZE + file_size + max_blocks * cRangeBlockHeaderSize;
+
+	mapped_file dst;
+	if (!dst.create(pDst_filename, max_comp_size))
+		return false;
+
+	uint64_t dst_ofs = TOTAL_BLOCKED_HEADER_SIZE;
+	uint32_t file_data_crc32 = 0;
+
+	vrange_block_encoder enc;
+	enc.set_huffman_speed_bias(params.m_huffman_speed_bias);
+	enc.set_use_rans(params.m_use_rans);
+
+	vrange_block_desc_vec blocks;
+	uint8_vec block_buf;
+
+	for (uint64_t chunk_ofs = 0; chunk_ofs < file_size; chunk_ofs += cMmapChunkSize)
+	{
+		const uint8_t* pChunk = src.m_pData + chunk_ofs;
+		const size_t chunk_size = (size_t)std::min<uint64_t>(cMmapChunkSize, file_size - chunk_ofs);
+
+		file_data_crc32 = crc32(file_data_crc32, pChunk, chunk_size);
+
+		vrange_split_blocks(pChunk, chunk_size, blocks, params);
+
+		for (size_t i = 0; i < blocks.size(); i++)
+		{
+			block_buf.resize(0);
+			if (!enc.encode_block(pChunk + blocks[i].m_ofs, blocks[i].m_size, block_buf, params.m_allow_model_reuse))
+				return false;
+
+			if (block_buf.size() > (dst.m_size - dst_ofs))
+				return false;
+
+			memcpy(dst.m_pData + dst_ofs, &block_buf[0], block_buf.size());
+			dst_ofs += block_buf.size();
+		}
+
+		src.release(chunk_ofs + chunk_size);
+		if (!dst.release(dst_ofs))
+			return false;
+	}
+
+	uint8_t* pHeader = dst.m_pData;
+	pHeader[0] = g_blocked_file_sig[0];
+	pHeader[1] = cFormatBlocked;
+
+	for (uint32_t i = 0; i < 8; i++)
+		pHeader[2 + i] = (uint8_t)(file_size >> (i * 8));
+
+	for (uint32_t i = 0; i < 4; i++)
+		pHeader[10 + i] = (uint8_t)(file_data_crc32 >> (i * 8));
+
+	comp_size = dst_ofs;
+	return dst.close(comp_size);
+}
+
+// Decompresses a blocked format file from a mapped input straight into the mapped output file. 
+// 'b' files are decoded block by block, releasing finished chunks of both files. The LZ and BWT formats decode the whole file at once.
+static bool mmap_decompress(const char* pSrc_filename, const char* pDst_filename, uint64_t& comp_size, uint64_t& orig_size)
+{
+	comp_size = 0;
+	orig_size = 0;
+
+	mapped_file src;
+	if (!src.open_read(pSrc_filename))
+		return false;
+
+	comp_size = src.m_size;
+
+	const uint8_t* pComp = src.m_pData;
+	if ((comp_size < TOTAL_BLOCKED_HEADER_SIZE) || (!is_blocked_format(pComp, (size_t)comp_size)))
+		return false;
+
+	const char format = (char)pComp[1];
+
+	for (uint32_t i = 0; i < 8; i++)
+		orig_size |= (uint64_t)pComp[2 + i] << (i * 8);
+
+	const uint32_t expected_crc32 = pComp[10] | (pComp[11] << 8) | (pComp[12] << 16) | ((uint32_t)pComp[13] << 24);
+
+	mapped_file dst;
+	if (!dst.create(pDst_filename, orig_size))
+		return false;
+
+	const uint8_t* pSrc = pComp + TOTAL_BLOCKED_HEADER_SIZE;
+	const uint8_t* pSrc_end = pComp + comp_size;
+	uint8_t* pDst = dst.m_pData;
+
+	uint32_t decoded_crc32 = 0;
+
+	if (format == cFormatBlocked)
+	{
+		vrange_block_decoder dec;
+
+		uint64_t dst_ofs = 0, crc_ofs = 0;
+		while (pSrc < pSrc_end)
+		{
+			uint32_t decoded_size;
+			if (!dec.decode_block(pSrc, pSrc_end, pDst + dst_ofs, (size_t)(orig_size - dst_ofs), decoded_size))
+				return false;
+
+			dst_ofs += decoded_size;
+
+			if (((dst_ofs - crc_ofs) >= cMmapChunkSize) || (pSrc == pSrc_end))
+			{
+#if DECOMP_CRC32_CHECKING
+				decoded_crc32 = crc32(decoded_crc32, pDst + crc_ofs, (size_t)(dst_ofs - crc_ofs));
+#endif
+				crc_ofs = dst_ofs;
+
+				src.release(pSrc - pComp);
+				if (!dst.release(dst_ofs))
+					return false;
+			}
+		}
+
+		if (dst_ofs != orig_size)
+			return false;
+	}
+	else
+	{
+		bool status;
+		if (format == cFormatLZ)
+			status = vrange_lz_decompress(pSrc, pSrc_end - pSrc, pDst, (size_t)orig_size);
+		else
+			status = vrange_bwt_decompress(pSrc, pSrc_end - pSrc, pDst, (size_t)orig_size);
+
+		if (!status)
+			return false;
+
+#if DECOMP_CRC32_CHECKING
+		decoded_crc32 = crc32(0, pDst, (size_t)orig_size);
+#endif
+	}
+
+#if DECOMP_CRC32_CHECKING
+	if (decoded_crc32 != expected_crc32)
+	{
+		fprintf(stderr, "Decompressed CRC-32 doesn't match!\n");
+		return false;
+	}
+	printf("CRC-32 check OK\n");
+#else
+	(void)decoded_crc32;
+	(void)expected_crc32;
+#endif
+
+	return dst.close(0);
+}
+#endif // SSER_USE_MMAP
+
+// Prints the process's peak resident set size, to compare the memory use of the file modes
+static void print_peak_rss(FILE* pFile)
+{
+#if SSER_USE_MMAP
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+	{
+#ifdef __APPLE__
+		const double peak_rss = (double)usage.ru_maxrss;
+#else
+		const double peak_rss = (double)usage.ru_maxrss * 1024.0f;
+#endif
+		fprintf(pFile, "Peak RSS: %.1f MiB\n", peak_rss / (1024.0f * 1024.0f));
+	}
+#endif
+}
+
+#if SSER_USE_PIPELINE
+// Streaming format used by the pipelined 's'/'x' modes: "Rs", then a sequence of independently coded frames, each starting with
+// a 12 byte header: original size, coded size and CRC-32 of the original data (4 bytes LE each). A frame with an original size of 0 ends the stream.
+// The frame payload is a sequence of blocks created by vrange_encode_blocks(). Unlike the 'b' format the total size doesn't need to be known up front.
+static const char* g_stream_file_sig = "Rs";
+const uint32_t cPipeFrameSize = 4 * 1024 * 1024;
+const uint32_t cPipeFrameHeaderSize = sizeof(uint32_t) * 3;
+
+// Bounded blocking FIFO shared by the pipeline's threads. pop() returns false once the queue is closed and empty.
+template <typename T>
+class pipe_queue
+{
+public:
+	explicit pipe_queue(size_t max_size) : m_max_size(max_size), m_closed(false) { }
+
+	bool push(const T& item)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while ((m_items.size() >= m_max_size) && (!m_closed))
+			m_not_full.wait(lock);
+
+		if (m_closed)
+			return false;
+
+		m_items.push_back(item);
+		m_not_empty.notify_one();
+		return true;
+	}
+
+	bool pop(T& item)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while ((m_items.empty()) && (!m_closed))
+			m_not_empty.wait(lock);
+
+		return pop_locked(item);
+	}
+
+	bool try_pop(T& item)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		return pop_locked(item);
+	}
+
+	void close()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_closed = true;
+		m_not_empty.notify_all();
+		m_not_full.notify_all();
+	}
+
+private:
+	std::mutex m_mutex;
+	std::condition_variable m_not_empty, m_not_full;
+	std::deque<T> m_items;
+	size_t m_max_size;
+	bool m_closed;
+
+	bool pop_locked(T& item)
+	{
+		if (m_items.empty())
+			return false;
+
+		item = m_items.front();
+		m_items.pop_front();
+		m_not_full.notify_one();
+		return true;
+	}
+};
+
+// A frame travelling through the pipeline. Jobs are allocated once and recycled through the free queue, so the number of jobs caps memory use.
+struct pipe_job
+{
+	uint64_t m_index;
+	uint8_vec m_in, m_out;
+	uint32_t m_orig_size, m_crc32;
+	bool m_status;
+};
+
+static bool write_full(int fd, const void* pData, size_t len)
+{
+	const uint8_t* p = (const uint8_t*)pData;
+	while (len)
+	{
+		const ssize_t n = write(fd, p, len);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+
+		p += n;
+		len -= (size_t)n;
+	}
+	return true;
+}
+
+// Reads up to len bytes, stopping early only at the end of the input. Uses pread() on regular files, read() otherwise (stdin, pipes).
+static bool read_full(int fd, void* pData, size_t len, bool use_pread, uint64_t& ofs, size_t& bytes_read)
+{
+	uint8_t* p = (uint8_t*)pData;
+	bytes_read = 0;
+
+	while (bytes_read < len)
+	{
+		const ssize_t n = use_pread ? pread(fd, p + bytes_read, len - bytes_read, (off_t)ofs) : read(fd, p + bytes_read, len - bytes_read);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+
+		if (!n)
+			break;
+
+		bytes_read += (size_t)n;
+		ofs += (uint64_t)n;
+	}
+	return true;
+}
+
+#if SSER_USE_IO_URING
+// Minimal io_uring reader (raw syscalls, no liburing) which keeps several reads of a regular file in flight at once.
+// Only one thread submits and reaps.
+class uring_reader
+{
+public:
+	uring_reader() : m_ring_fd(-1), m_pSq_ptr(NULL), m_pCq_ptr(NULL), m_pSqes(NULL), m_sq_ring_size(0), m_cq_ring_size(0), m_sqes_size(0), m_fd(-1) { }
+	~uring_reader() { deinit(); }
+
+	// Returns false if io_uring isn't available, in which case the caller falls back to pread()
+	bool init(int fd, uint32_t depth)
+	{
+		struct io_uring_params params;
+		memset(&params, 0, sizeof(params));
+
+		m_ring_fd = (int)syscall(__NR_io_uring_setup, depth, &params);
+		if (m_ring_fd < 0)
+			return false;
+
+		m_fd = fd;
+		m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+		m_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+		const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+		if (single_mmap)
+			m_sq_ring_size = m_cq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+
+		m_pSq_ptr = (uint8_t*)mmap(NULL, m_sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQ_RING);
+		if (m_pSq_ptr == MAP_FAILED)
+		{
+			m_pSq_ptr = NULL;
+			deinit();
+			return false;
+		}
+
+		if (single_mmap)
+			m_pCq_ptr = m_pSq_ptr;
+		else
+		{
+			m_pCq_ptr = (uint8_t*)mmap(NULL, m_cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_CQ_RING);
+			if (m_pCq_ptr == MAP_FAILED)
+			{
+				m_pCq_ptr = NULL;
+				deinit();
+				return false;
+			}
+		}
+
+		m_sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+		m_pSqes = (struct io_uring_sqe*)mmap(NULL, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQES);
+		if (m_pSqes == MAP_FAILED)
+		{
+			m_pSqes = NULL;
+			deinit();
+			return false;
+		}
+
+		m_pSq_tail = (uint32_t*)(m_pSq_ptr + params.sq_off.tail);
+		m_sq_mask = *(uint32_t*)(m_pSq_ptr + params.sq_off.ring_mask);
+		m_pSq_array = (uint32_t*)(m_pSq_ptr + params.sq_off.array);
+
+		m_pCq_head = (uint32_t*)(m_pCq_ptr + params.cq_off.head);
+		m_pCq_tail = (uint32_t*)(m_pCq_ptr + params.cq_off.tail);
+		m_cq_mask = *(uint32_t*)(m_pCq_ptr + params.cq_off.ring_mask);
+		m_pCqes = (struct io_uring_cqe*)(m_pCq_ptr + params.cq_off.cqes);
+
+		m_iovs.resize(params.sq_entries);
+		return true;
+	}
+
+	void deinit()
+	{
+		if (m_pSqes)
+			munmap(m_pSqes, m_sqes_size);
+		if ((m_pCq_ptr) && (m_pCq_ptr != m_pSq_ptr))
+			munmap(m_pCq_ptr, m_cq_ring_size);
+		if (m_pSq_ptr)
+			munmap(m_pSq_ptr, m_sq_ring_size);
+		if (m_ring_fd >= 0)
+			close(m_ring_fd);
+
+		m_pSqes = NULL;
+		m_pCq_ptr = NULL;
+		m_pSq_ptr = NULL;
+		m_ring_fd = -1;
+	}
+
+	// slot must be < the queue depth and not already in flight
+	bool submit_read(uint32_t slot, void* pBuf, size_t len, uint64_t ofs)
+	{
+		const uint32_t tail = *m_pSq_tail;
+		const uint32_t index = tail & m_sq_mask;
+
+		m_iovs[slot].iov_base = pBuf;
+		m_iovs[slot].iov_len = len;
+
+		struct io_uring_sqe* pSqe = &m_pSqes[index];
+		memset(pSqe, 0, sizeof(*pSqe));
+		pSqe->opcode = IORING_OP_READV;
+		pSqe->fd = m_fd;
+		pSqe->addr = (uint64_t)(uintptr_t)&m_iovs[slot];
+		pSqe->len = 1;
+		pSqe->off = ofs;
+		pSqe->user_data = slot;
+
+		m_pSq_array[index] = index;
+		__atomic_store_n(m_pSq_tail, tail + 1, __ATOMIC_RELEASE);
+
+		for ( ; ; )
+		{
+			const int res = (int)syscall(__NR_io_uring_enter, m_ring_fd, 1, 0, 0, NULL, 0);
+			if (res >= 0)
+				return true;
+			if (errno != EINTR)
+				return false;
+		}
+	}
+
+	// Waits for the next completion. res is the number of bytes read, or -errno.
+	bool wait(uint32_t& slot, int32_t& res)
+	{
+		const uint32_t head = *m_pCq_head;
+
+		while (head == __atomic_load_n(m_pCq_tail, __ATOMIC_ACQUIRE))
+		{
+			if ((syscall(__NR_io_uring_enter, m_ring_fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0) && (errno != EINTR))
+				return false;
+		}
+
+		const struct io_uring_cqe* pCqe = &m_pCqes[head & m_cq_mask];
+		slot = (uint32_t)pCqe->user_data;
+		res = pCqe->res;
+
+		__atomic_store_n(m_pCq_head, head + 1, __ATOMIC_RELEASE);
+		return true;
+	}
+
+private:
+	int m_ring_fd;
+	uint8_t* m_pSq_ptr;
+	uint8_t* m_pCq_ptr;
+	struct io_uring_sqe* m_pSqes;
+	size_t m_sq_ring_size, m_cq_ring_size, m_sqes_size;
+
+	uint32_t* m_pSq_tail;
+	uint32_t* m_pSq_array;
+	uint32_t m_sq_mask;
+
+	uint32_t* m_pCq_head;
+	uint32_t* m_pCq_tail;
+	uint32_t m_cq_mask;
+	struct io_uring_cqe* m_pCqes;
+
+	int m_fd;
+	std::vector<struct iovec> m_iovs;
+};
+#endif // SSER_USE_IO_URING
+
+static inline void write_le32(uint8_t* pDst, uint32_t v)
+{
+	for (uint32_t i = 0; i < 4; i++)
+		pDst[i] = (uint8_t)(v >> (i * 8));
+}
+
+static inline uint32_t read_le32(const uint8_t* pSrc)
+{
+	return pSrc[0] | (pSrc[1] << 8) | (pSrc[2] << 16) | ((uint32_t)pSrc[3] << 24);
+}
+
+// Streaming compressor/decompressor: a reader thread, num_workers coder threads and an ordered writer (the calling thread).
+// The reader and the workers only hand off jobs through bounded queues, and used jobs are recycled, so memory use is about 
+// (2 * num_workers + 2) frames regardless of the input size.
+class pipeline
+{
+public:
+	pipeline(bool compress, int in_fd, int out_fd, uint32_t num_workers) :
+		m_compress(compress), m_in_fd(in_fd), m_out_fd(out_fd), m_num_workers(std::max(1U, num_workers)),
+		m_num_jobs(m_num_workers * 2 + 2), m_free(m_num_jobs), m_work(m_num_jobs), m_done(m_num_jobs),
+		m_failed(false), m_pReader_type("read"), m_total_in(0), m_total_out(0)
+	{
+	}
+
+	bool run()
+	{
+		std::vector<pipe_job> jobs(m_num_jobs);
+		for (uint32_t i = 0; i < m_num_jobs; i++)
+			m_free.push(&jobs[i]);
+
+		std::thread reader(&pipeline::reader_thread, this);
+
+		std::vector<std::thread> workers;
+		for (uint32_t i = 0; i < m_num_workers; i++)
+			workers.push_back(std::thread(&pipeline::worker_thread, this));
+
+		// Closes the done queue once every worker has exited, which ends the writer loop
+		std::thread closer([this, &workers]() 
+		{
+			for (size_t i = 0; i < workers.size(); i++)
+				workers[i].join();
+			m_done.close();
+		});
+
+		const bool write_status = writer();
+
+		if (!write_status)
+			fail();
+
+		reader.join();
+		closer.join();
+
+		return !m_failed;
+	}
+
+	const char* get_reader_type() const { return m_pReader_type; }
+	uint64_t get_total_in() const { return m_total_in; }
+	uint64_t get_total_out() const { return m_total_out; }
+
+private:
+	bool m_compress;
+	int m_in_fd, m_out_fd;
+	uint32_t m_num_workers, m_num_jobs;
+
+	pipe_queue<pipe_job*> m_free, m_work, m_done;
+
+	std::atomic<bool> m_failed;
+	const char* m_pReader_type;
+	uint64_t m_total_in, m_total_out;
+
+	void fail()
+	{
+		m_failed = true;
+		m_free.close();
+		m_work.close();
+		m_done.close();
+	}
+
+	void reader_thread()
+	{
+		const bool status = m_compress ? read_frames_compress() : read_frames_decompress();
+		if (!status)
+			fail();
+
+		m_work.close();
+	}
+
+	bool read_frames_compress()
+	{
+		struct stat st;
+		const bool is_file = (fstat(m_in_fd, &st) == 0) && (S_ISREG(st.st_mode));
+
+#if SSER_USE_IO_URING
+		if (is_file)
+		{
+			uring_reader ring;
+			if (ring.init(m_in_fd, m_num_jobs))
+			{
+				m_pReader_type = "io_uring";
+				return read_frames_uring(ring, (uint64_t)st.st_size);
+			}
+		}
+#endif
+
+		if (is_file)
+			m_pReader_type = "pread";
+
+		uint64_t ofs = 0;
+		for (uint64_t index = 0; ; index++)
+		{
+			pipe_job* pJob;
+			if (!m_free.pop(pJob))
+				return false;
+
+			pJob->m_index = index;
+			pJob->m_in.resize(cPipeFrameSize);
+
+			size_t bytes_read;
+			if (!read_full(m_in_fd, &pJob->m_in[0], cPipeFrameSize, is_file, ofs, bytes_read))
+				return false;
+
+			pJob->m_in.resize(bytes_read);
+			m_total_in += bytes_read;
+
+			// The last job is empty, telling the writer to end the stream
+			if (!m_work.push(pJob))
+				return false;
+
+			if (!bytes_read)
+				break;
+		}
+
+		return true;
+	}
+
+#if SSER_USE_IO_URING
+	bool read_frames_uring(uring_reader& ring, uint64_t file_size)
+	{
+		std::vector<pipe_job*> in_flight(m_num_jobs);
+		std::vector<uint64_t> in_flight_ofs(m_num_jobs);
+		std::vector<uint32_t> free_slots;
+		for (uint32_t i = 0; i < m_num_jobs; i++)
+			free_slots.push_back(i);
+
+		uint64_t ofs = 0, index = 0;
+		uint32_t num_in_flight = 0;
+		bool sent_end = false;
+
+		while (!sent_end)
+		{
+			// Keep as many reads in flight as there are free jobs. Only block waiting for a free job when nothing is in flight, 
+			// otherwise the completed reads the writer is waiting on would never be handed off.
+			while ((ofs < file_size) && (!free_slots.empty()))
+			{
+				pipe_job* pJob;
+				if (num_in_flight ? !m_free.try_pop(pJob) : !m_free.pop(pJob))
+				{
+					if (!num_in_flight)
+						return false;
+					break;
+				}
+
+				const size_t len = (size_t)std::min<uint64_t>(cPipeFrameSize, file_size - ofs);
+
+				pJob->m_index = index++;
+				pJob->m_in.resize(len);
+
+				const uint32_t slot = free_slots.back();
+				free_slots.pop_back();
+
+				in_flight[slot] = pJob;
+				in_flight_ofs[slot] = ofs;
+
+				if (!ring.submit_read(slot, &pJob->m_in[0], len, ofs))
+					return false;
+
+				ofs += len;
+				num_in_flight++;
+			}
+
+			if (!num_in_flight)
+			{
+				// All reads done: send the empty end job
+				pipe_job* pJob;
+				if (!m_free.pop(pJob))
+					return false;
+
+				pJob->m_index = index++;
+				pJob->m_in.resize(0);
+
+				if (!m_work.push(pJob))
+					return false;
+
+				sent_end = true;
+				break;
+			}
+
+			uint32_t slot;
+			int32_t res;
+			if (!ring.wait(slot, res))
+				return false;
+
+			if ((res < 0) || (slot >= m_num_jobs) || (!in_flight[slot]))
+				return false;
+
+			pipe_job* pJob = in_flight[slot];
+			in_flight[slot] = NULL;
+			free_slots.push_back(slot);
+			num_in_flight--;
+
+			// Short reads only happen if the file shrank, or on some file systems. Finish them synchronously.
+			if ((size_t)res < pJob->m_in.size())
+			{
+				uint64_t read_ofs = in_flight_ofs[slot] + (uint32_t)res;
+				size_t bytes_read;
+				if ((!read_full(m_in_fd, &pJob->m_in[res], pJob->m_in.size() - res, true, read_ofs, bytes_read)) || (bytes_read != pJob->m_in.size() - res))
+					return false;
+			}
+
+			m_total_in += pJob->m_in.size();
+
+			if (!m_work.push(pJob))
+				return false;
+		}
+
+		return true;
+	}
+#endif
+
+	bool read_frames_decompress()
+	{
+		struct stat st;
+		const bool is_file = (fstat(m_in_fd, &st) == 0) && (S_ISREG(st.st_mode));
+		if (is_file)
+			m_pReader_type = "pread";
+
+		uint64_t ofs = 0;
+		size_t bytes_read;
+
+		uint8_t sig[2];
+		if ((!read_full(m_in_fd, sig, sizeof(sig), is_file, ofs, bytes_read)) || (bytes_read != sizeof(sig)))
+			return false;
+
+		if ((sig[0] != g_stream_file_sig[0]) || (sig[1] != g_stream_file_sig[1]))
+			return false;
+
+		for (uint64_t index = 0; ; index++)
+		{
+			uint8_t header[cPipeFrameHeaderSize];
+			if ((!read_full(m_in_fd, header, sizeof(header), is_file, ofs, bytes_read)) || (bytes_read != sizeof(header)))
+				return false;
+
+			const uint32_t orig_size = read_le32(header);
+			const uint32_t comp_size = read_le32(header + 4);
+
+			if ((orig_size > cRangeBlockMaxSize) || (comp_size > (orig_size * 2ULL + 1024)) || ((!orig_size) && (comp_size)))
+				return false;
+
+			pipe_job* pJob;
+			if (!m_free.pop(pJob))
+				return false;
+
+			pJob->m_index = index;
+			pJob->m_orig_size = orig_size;
+			pJob->m_crc32 = read_le32(header + 8);
+			pJob->m_in.resize(comp_size);
+
+			if (comp_size)
+			{
+				if ((!read_full(m_in_fd, &pJob->m_in[0], comp_size, is_file, ofs, bytes_read)) || (bytes_read != comp_size))
+					return false;
+			}
+
+			m_total_in += cPipeFrameHeaderSize + comp_size;
+
+			if (!m_work.push(pJob))
+				return false;
+
+			if (!orig_size)
+				break;
+		}
+
+		m_total_in += sizeof(sig);
+		return true;
+	}
+
+	void worker_thread()
+	{
+		vrange_block_params params;
+
+		pipe_job* pJob;
+		while (m_work.pop(pJob))
+		{
+			pJob->m_out.resize(0);
+			pJob->m_status = true;
+
+			if (m_compress)
+			{
+				if (pJob->m_in.size())
+				{
+					pJob->m_orig_size = (uint32_t)pJob->m_in.size();
+					pJob->m_crc32 = crc32(0, &pJob->m_in[0], pJob->m_in.size());
+					pJob->m_status = vrange_encode_blocks(&pJob->m_in[0], pJob->m_in.size(), pJob->m_out, params);
+				}
+				else
+				{
+					pJob->m_orig_size = 0;
+					pJob->m_crc32 = 0;
+				}
+			}
+			else if (pJob->m_orig_size)
+			{
+				pJob->m_out.resize(pJob->m_orig_size);
+				pJob->m_status = vrange_decode_blocks(pJob->m_in.data(), pJob->m_in.size(), &pJob->m_out[0], pJob->m_orig_size);
+
+#if DECOMP_CRC32_CHECKING
+				if ((pJob->m_status) && (crc32(0, &pJob->m_out[0], pJob->m_orig_size) != pJob->m_crc32))
+					pJob->m_status = false;
+#endif
+			}
+
+			if (!m_done.push(pJob))
+				break;
+		}
+	}
+
+	bool write_output(const void* pData, size_t len)
+	{
+		m_total_out += len;
+		return write_full(m_out_fd, pData, len);
+	}
+
+	// Writes the finished jobs in input order, then recycles them
+	bool writer()
+	{
+		if ((m_compress) && (!write_output(g_stream_file_sig, 2)))
+			return false;
+
+		std::map<uint64_t, pipe_job*> pending;
+		uint64_t next_index = 0;
+		bool ended = false;
+
+		pipe_job* pJob;
+		while ((!ended) && (m_done.pop(pJob)))
+		{
+			pending[pJob->m_index] = pJob;
+
+			while ((!ended) && (!pending.empty()) && (pending.begin()->first == next_index))
+			{
+				pJob = pending.begin()->second;
+				pending.erase(pending.begin());
+				next_index++;
+
+				if (!pJob->m_status)
+					return false;
+
+				if (m_compress)
+				{
+					uint8_t header[cPipeFrameHeaderSize];
+					write_le32(header, pJob->m_orig_size);
+					write_le32(header + 4, (uint32_t)pJob->m_out.size());
+					write_le32(header + 8, pJob->m_crc32);
+
+					if ((!write_output(header, sizeof(header))) || ((pJob->m_out.size()) && (!write_output(&pJob->m_out[0], pJob->m_out.size()))))
+						return false;
+				}
+				else if ((pJob->m_out.size()) && (!write_output(&pJob->m_out[0], pJob->m_out.size())))
+					return false;
+
+				ended = (pJob->m_orig_size == 0);
+
+				if (!m_free.push(pJob))
+					return false;
+			}
+		}
+
+		return ended;
+	}
+};
+#endif // SSER_USE_PIPELINE
+
+enum 
+{
+	cModeTest,
+	cModeComp,
+	cModeCompBlocked,
+	cModeCompLZ,
+	cModeCompBWT,
+	cModeDecomp,
+	cModeCompMmap,
+	cModeDecompMmap,
+	cModeCompPipe,
+	cModeDecompPipe
+};
+
+static void print_usage()
+{
+	printf("Usage: sserangecoding with no args tests the codec with \"book1\"\n");
+	printf("sserangecoding <filename> : Tests compression/decompression on a specific file\n");
+	printf("sserangecoding c <source_filename> <comp_filename> : Compresses file\n");
+	printf("sserangecoding b <source_filename> <comp_filename> : Compresses file using the blocked format with automatic block splitting\n");
+	printf("sserangecoding z <source_filename> <comp_filename> : Compresses file using LZ77 followed by range coding\n");
+	printf("sserangecoding w <source_filename> <comp_filename> : Compresses file using BWT+MTF+zero run coding followed by range coding\n");
+	printf("sserangecoding d <comp_filename> <decomp_filename> : Decompresses file with CRC-32 check\n");
+#if SSER_USE_MMAP
+	printf("sserangecoding m <source_filename> <comp_filename> : Compresses file to the blocked format using memory mapped files (works on files larger than RAM)\n");
+	printf("sserangecoding u <comp_filename> <decomp_filename> : Decompresses a b, z or w file using memory mapped files, with CRC-32 check\n");
+#endif
+#if SSER_USE_PIPELINE
+	printf("sserangecoding s <source_filename> <comp_filename> [threads] : Compresses file to the streaming format with overlapped I/O and multiple threads\n");
+	printf("sserangecoding x <comp_filename> <decomp_filename> [threads] : Decompresses a streaming format file with overlapped I/O and multiple threads\n");
+	printf("  The s and x modes accept - for stdin/stdout. Status is printed to stderr.\n");
+#endif
+}
+	
+int main(int argc, char **argv)
+{
+	vrange_init();
+
+	int mode = cModeTest;
+	const char* pSrc_filename = "book1";
+	const char* pOut_filename = "outfile";
+	
+	if (argc == 1)
+	{
+		// Test mode
+	}
+	else if ((argc == 2) && (strcmp(argv[1], "-h") == 0))
+	{
+		print_usage();
+		exit(EXIT_FAILURE);
+	}
+	else if (argc == 2)
+	{
+		pSrc_filename = argv[1];
+	}
+	else if ((argc == 4) || ((argc == 5) && ((argv[1][0] == 's') || (argv[1][0] == 'x'))))
+	{
+		if (argv[1][0] == 'c')
+			mode = cModeComp;
+		else if (argv[1][0] == 'b')
+			mode = cModeCompBlocked;
+		else if (argv[1][0] == 'z')
+			mode = cModeCompLZ;
+		else if (argv[1][0] == 'w')
+			mode = cModeCompBWT;
+		else if (argv[1][0] == 'd')
+			mode = cModeDecomp;
+#if SSER_USE_MMAP
+		else if (argv[1][0] == 'm')
+			mode = cModeCompMmap;
+		else if (argv[1][0] == 'u')
+			mode = cModeDecompMmap;
+#endif
+#if SSER_USE_PIPELINE
+		else if (argv[1][0] == 's')
+			mode = cModeCompPipe;
+		else if (argv[1][0] == 'x')
+			mode = cModeDecompPipe;
+#endif
+		else
+		{
+			print_usage();
+			panic("Invalid mode!\n");
+		}
+
+		pSrc_filename = argv[2];
+		pOut_filename = argv[3];
+	}
+	else
+	{
+		print_usage();
+		panic("Invalid command line arguments!\n");
+	}
+
+	const uint64_t wall_start_time = get_clock();
+
+#if SSER_USE_PIPELINE
+	if ((mode == cModeCompPipe) || (mode == cModeDecompPipe))
+	{
+		const uint32_t num_threads = (argc == 5) ? (uint32_t)atoi(argv[4]) : std::max(1U, std::thread::hardware_concurrency());
+		if ((num_threads < 1) || (num_threads > 256))
+			panic("Invalid thread count!\n");
+
+		const bool use_stdin = strcmp(pSrc_filename, "-") == 0;
+		const bool use_stdout = strcmp(pOut_filename, "-") == 0;
+
+		const int in_fd = use_stdin ? STDIN_FILENO : open(pSrc_filename, O_RDONLY);
+		if (in_fd < 0)
+			panic("Failed opening source file!\n");
+
+		const int out_fd = use_stdout ? STDOUT_FILENO : open(pOut_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (out_fd < 0)
+			panic("Failed creating output file!\n");
+
+		pipeline pipe(mode == cModeCompPipe, in_fd, out_fd, num_threads);
+		if (!pipe.run())
+			panic((mode == cModeCompPipe) ? "Compression failed!\n" : "Decompression failed!\n");
+
+		if ((!use_stdout) && (close(out_fd) != 0))
+			panic("Failed writing output data!\n");
+
+		if (!use_stdin)
+			close(in_fd);
+
+		const double total_time = (double)(get_clock() - wall_start_time) / (double)get_ticks_per_sec();
+		const uint64_t total_orig = (mode == cModeCompPipe) ? pipe.get_total_in() : pipe.get_total_out();
+
+		fprintf(stderr, "%u worker threads, %s reader\nInput size: %llu\nOutput size: %llu\n", num_threads, pipe.get_reader_type(), 
+			(unsigned long long)pipe.get_total_in(), (unsigned long long)pipe.get_total_out());
+		fprintf(stderr, "Total wall time: %.3f secs, %.1f MiB/sec.\n", total_time, (total_orig / total_time) / (1024 * 1024));
+		print_peak_rss(stderr);
+		
+		return EXIT_SUCCESS;
+	}
+#endif
+
+#if SSER_USE_MMAP
+	if ((mode == cModeCompMmap) || (mode == cModeDecompMmap))
+	{
+		printf("Processing memory mapped file %s\n", pSrc_filename);
+
+		uint64_t in_size = 0, out_size = 0;
+		bool status;
+		if (mode == cModeCompMmap)
+			status = mmap_blocked_compress(pSrc_filename, pOut_filename, in_size, out_size);
+		else
+			status = mmap_decompress(pSrc_filename, pOut_filename, in_size, out_size);
+
+		if (!status)
+			panic((mode == cModeCompMmap) ? "Compression failed!\n" : "Decompression failed!\n");
+
+		const double total_time = (double)(get_clock() - wall_start_time) / (double)get_ticks_per_sec();
+
+		printf("Input size: %llu\nOutput size: %llu\n", (unsigned long long)in_size, (unsigned long long)out_size);
+		printf("Total wall time: %.3f secs, %.1f MiB/sec.\n", total_time, (std::max(in_size, out_size) / total_time) / (1024 * 1024));
+		print_peak_rss(stdout);
+		printf("Success\n");
+
+		return EXIT_SUCCESS;
+	}
+#endif
+
+	printf("Reading file %s\n", pSrc_filename);
+
+	uint8_vec file_data;
+	if (!read_file_to_vec(pSrc_filename, file_data))
+		panic("Failed reading source file!\n");
+
+	if (!file_data.size())
+		panic("File empty!\n");
+
+	if (file_data.size() >= UINT32_MAX)
+		panic("File too big!\n");
+
+	const uint32_t file_size = (uint32_t)file_data.size();
+
+	if (mode == cModeTest)
+	{
+		uint32_vec sym_freq(256);
+		for (uint32_t i = 0; i < file_data.size(); i++)
+			sym_freq[file_data[i]]++;
+
+		double total_theoretical_bits = 0.0f;
+		for (uint32_t i = 0; i < 256; i++)
+			if (sym_freq[i])
+				total_theoretical_bits += sym_freq[i] * -log2((double)sym_freq[i] / file_size);
+		printf("Source file size %u bytes contains %.1f bytes of entropy\n", file_size, total_theoretical_bits / 8.0f);
+
+		uint32_vec scaled_cum_prob;
+		bool status = vrange_create_cum_probs(scaled_cum_prob, sym_freq);
+		if (!status)
+			panic("vrange_create_cum_probs() failed!\n");
+
+		{
+			uint32_vec temp_freq(sym_freq), temp_cum_prob;
+
+			const uint64_t start_cycles = __rdtsc();
+			vrange_create_cum_probs(temp_cum_prob, temp_freq);
+			printf("vrange_create_cum_probs() took %llu cycles\n", (unsigned long long)(__rdtsc() - start_cycles));
+		}
 
 		// Compare vs. Huffman coding using package merge to limit the max code size at various sizes
 		for (uint32_t h = 0; h < 4; h++)
@@ -510,9 +3287,51 @@ int main(int argc, char **argv)
 		uint32_vec dec_table;
 		vrange_init_table(256, scaled_cum_prob, dec_table);
 				
+		test_cold_start_decode(file_data, scaled_cum_prob, dec_table);
+
 		test_plain_range_coding(file_data, scaled_cum_prob, dec_table, total_theoretical_bits);
 
 		test_vectorized_range_coding(file_data, scaled_cum_prob, dec_table, total_theoretical_bits);
+
+		test_scalar_decode(file_data, scaled_cum_prob, dec_table);
+
+		test_mt_encode(file_data, scaled_cum_prob);
+
+		test_segmented_decode(file_data, scaled_cum_prob, dec_table);
+
+		test_scatter_gather_encode(file_data, scaled_cum_prob);
+
+		test_encode_limits(file_data);
+
+		test_decode_values(file_data);
+
+		test_split_coding();
+
+		test_small_alphabet_decode(file_data);
+
+		test_rans_coding(file_data, scaled_cum_prob, dec_table, total_theoretical_bits);
+
+		test_size_estimation(file_data);
+
+		test_lane_counts(file_data, scaled_cum_prob, dec_table);
+
+		test_model_dict(file_data);
+
+		test_context_allocations(file_data);
+
+		test_c_api(file_data);
+
+		test_blocked_range_coding(file_data, total_theoretical_bits);
+
+		test_codec_stats(file_data, scaled_cum_prob, dec_table);
+
+		test_huffman_backend(file_data);
+
+		test_lz_range_coding(file_data);
+
+		test_bwt_range_coding(file_data);
+
+		test_legacy_file_decode();
 	}
 	else 
 	{
@@ -521,11 +3340,18 @@ int main(int argc, char **argv)
 
 		printf("Processing file\n");
 		
-		if (mode == cModeComp)
+		if (mode != cModeDecomp)
 		{
 			const uint64_t start_time = get_clock();
 
-			status = interleaved_encode(file_data, out_data);
+			if (mode == cModeCompBlocked)
+				status = blocked_encode(file_data, out_data, cFormatBlocked);
+			else if (mode == cModeCompLZ)
+				status = blocked_encode(file_data, out_data, cFormatLZ);
+			else if (mode == cModeCompBWT)
+				status = blocked_encode(file_data, out_data, cFormatBWT);
+			else
+				status = interleaved_encode(file_data, out_data);
 
 			const double total_time = (double)(get_clock() - start_time) / (double)get_ticks_per_sec();
 
@@ -539,8 +3365,11 @@ int main(int argc, char **argv)
 		{
 			const uint64_t start_time = get_clock();
 
-			uint32_t expected_crc32;
-			status = interleaved_decode(file_data, out_data, expected_crc32);
+			uint32_t expected_crc32 = 0;
+			if (is_blocked_format(file_data))
+				status = blocked_decode(file_data, out_data, expected_crc32);
+			else
+				status = interleaved_decode(file_data, out_data, expected_crc32);
 
 			const double total_time = (double)(get_clock() - start_time) / (double)get_ticks_per_sec();
 
@@ -563,6 +3392,10 @@ int main(int argc, char **argv)
 				
 		if (!write_data_to_file(pOut_filename, &out_data[0], out_data.size()))
 			panic("Failed writing output data!\n");
+
+		const double total_time = (double)(get_clock() - wall_start_time) / (double)get_ticks_per_sec();
+		printf("Total wall time: %.3f secs, %.1f MiB/sec.\n", total_time, (std::max(file_data.size(), out_data.size()) / total_time) / (1024 * 1024));
+		print_peak_rss(stdout);
 	}
 
 	printf("Success\n");
@@ -0,0 +1,111 @@
+// test_c99.c
+// Checks that sserangecoder_c.h compiles as C99 and exercises it from C, called by the test app, Richard Geldreich, Jr., public domain (see full text at unlicense.org)
+#include "sserangecoder_c.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int sserange_test_c99(const uint8_t* pData, size_t data_size);
+
+static int fail(const char* pMsg)
+{
+	fprintf(stderr, "C99 API test: %s\n", pMsg);
+	return 0;
+}
+
+// Returns 1 on success
+int sserange_test_c99(const uint8_t* pData, size_t data_size)
+{
+	if (!data_size)
+		return fail("empty input");
+
+	uint32_t sym_freq[256] = { 0 };
+	for (size_t i = 0; i < data_size; i++)
+		sym_freq[pData[i]]++;
+
+	uint32_t scaled_cum_prob[257];
+	if (!sserange_create_cum_probs(sym_freq, 256, scaled_cum_prob))
+		return fail("sserange_create_cum_probs() failed");
+
+	sserange_encoder* pEncoder = sserange_encoder_create(NULL, NULL, NULL);
+	sserange_decoder* pDecoder = sserange_decoder_create();
+
+	const size_t bound = sserange_compress_bound(data_size);
+	uint8_t* pComp = (uint8_t*)malloc(bound);
+	uint8_t* pDecoded = (uint8_t*)malloc(data_size);
+
+	int status = 0;
+
+	if ((!pEncoder) || (!pDecoder) || (!pComp) || (!pDecoded))
+	{
+		fail("out of memory");
+		goto cleanup;
+	}
+
+	if (!sserange_decoder_set_model(pDecoder, scaled_cum_prob, 256))
+	{
+		fail("sserange_decoder_set_model() failed");
+		goto cleanup;
+	}
+
+	// Every lane count, then the one picked for the input size
+	for (uint32_t pass = 0; pass < 4; pass++)
+	{
+		const uint32_t num_lanes = (pass < 3) ? (4U << pass) : sserange_choose_num_lanes(data_size);
+
+		const size_t comp_size = sserange_encode(pEncoder, pData, data_size, scaled_cum_prob, 256, num_lanes, pComp, bound);
+		if (!comp_size)
+		{
+			fail("sserange_encode() failed");
+			goto cleanup;
+		}
+
+		memset(pDecoded, 0xCD, data_size);
+		if ((!sserange_decode(pDecoder, pComp, comp_size, pDecoded, data_size, num_lanes)) || (memcmp(pDecoded, pData, data_size) != 0))
+		{
+			fail("sserange_decode() failed");
+			goto cleanup;
+		}
+	}
+
+	if (sserange_encode(pEncoder, pData, data_size, scaled_cum_prob, 256, 3, pComp, bound))
+	{
+		fail("sserange_encode() accepted an invalid lane count");
+		goto cleanup;
+	}
+
+	// A model with only 2 symbols can't code larger bytes
+	{
+		const uint32_t two_sym_cum_prob[3] = { 0, 2048, 4096 };
+		const uint8_t big_sym = 2;
+
+		if (sserange_encode(pEncoder, &big_sym, 1, two_sym_cum_prob, 2, SSERANGE_DEFAULT_LANES, pComp, bound))
+		{
+			fail("sserange_encode() accepted a byte outside of the model");
+			goto cleanup;
+		}
+	}
+
+	// Decreasing cumulative probabilities
+	{
+		uint32_t bad_cum_prob[257];
+		memcpy(bad_cum_prob, scaled_cum_prob, sizeof(bad_cum_prob));
+		bad_cum_prob[128] = bad_cum_prob[129] + 1;
+
+		if (sserange_encode(pEncoder, pData, data_size, bad_cum_prob, 256, SSERANGE_DEFAULT_LANES, pComp, bound))
+		{
+			fail("sserange_encode() accepted an invalid model");
+			goto cleanup;
+		}
+	}
+
+	status = 1;
+
+cleanup:
+	free(pComp);
+	free(pDecoded);
+	sserange_encoder_destroy(pEncoder);
+	sserange_decoder_destroy(pDecoder);
+
+	return status;
+}